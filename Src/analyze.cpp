@@ -0,0 +1,107 @@
+/**
+  @file analyze.cpp
+*/
+#include "analyze.h"
+#include "simd.h"
+#include <cstring>
+
+namespace Image {
+
+namespace /* unnamed */ {
+
+/** The accumulated flags of the analysis.
+
+  Each flag stays true while all pixels scanned so far satisfy it.
+*/
+struct Flags {
+  bool isOpaque;
+  bool isOneBit;
+  bool isSolid;
+
+  bool can_stop() const { return !isOneBit && !isSolid; }
+};
+
+/** Scan the pixels one by one.
+*/
+void scan_scalar(const uint8_t* p, uint32_t count, uint32_t bpp, const uint8_t* first, Flags& f)
+{
+  for (const uint8_t* end = p + count * bpp; p != end; p += bpp) {
+    if (bpp == 4) {
+      f.isOpaque &= p[3] == 255;
+      f.isOneBit &= p[3] == 0 || p[3] == 255;
+    }
+    f.isSolid &= memcmp(p, first, bpp) == 0;
+  }
+}
+
+#if ATCCONV_HAS_SSE2
+/** Scan 32bit pixels 4 by 4.
+
+  @return the number of scanned pixels. the rest should be scanned by
+          scan_scalar().
+*/
+uint32_t scan_sse2_32bit(const uint8_t* p, uint32_t count, const uint8_t* first, Flags& f)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_cmpeq_epi8(zero, zero);
+  uint32_t firstPixel;
+  memcpy(&firstPixel, first, 4);
+  const __m128i solid = _mm_set1_epi32(static_cast<int>(firstPixel));
+  __m128i accAnd = ones;
+  __m128i accOneBit = ones;
+  __m128i accSolid = ones;
+  const uint32_t simdCount = count & ~3U;
+  for (uint32_t i = 0; i < simdCount; i += 4) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 4));
+    accAnd = _mm_and_si128(accAnd, v);
+    accOneBit = _mm_and_si128(accOneBit, _mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, ones)));
+    accSolid = _mm_and_si128(accSolid, _mm_cmpeq_epi32(v, solid));
+  }
+  const int alphaLanes = 0x8888;
+  f.isOpaque &= (_mm_movemask_epi8(_mm_cmpeq_epi8(accAnd, ones)) & alphaLanes) == alphaLanes;
+  f.isOneBit &= (_mm_movemask_epi8(accOneBit) & alphaLanes) == alphaLanes;
+  f.isSolid &= _mm_movemask_epi8(accSolid) == 0xffff;
+  return simdCount;
+}
+#endif // ATCCONV_HAS_SSE2
+
+} // unnamed namespace
+
+/** Analyze the alpha usage and the color of the image.
+
+  The scan stops as soon as the result is determined.
+
+  @param image  the image to analyze. bytesPerPixel should be 3 or 4.
+
+  @return the result of the analysis.
+*/
+Analysis analyze(const Bitmap& image)
+{
+  const uint32_t bpp = image.bytesPerPixel;
+  // The image without alpha channel doesn't need the alpha check.
+  Flags f = { true, bpp == 4, true };
+  const uint8_t* first = image.row(0);
+  for (uint32_t y = 0; y < image.height && !f.can_stop(); ++y) {
+    const uint8_t* p = image.row(y);
+    uint32_t x = 0;
+#if ATCCONV_HAS_SSE2
+    if (bpp == 4) {
+      x = scan_sse2_32bit(p, image.width, first, f);
+    }
+#endif // ATCCONV_HAS_SSE2
+    scan_scalar(p + x * bpp, image.width - x, bpp, first, f);
+  }
+
+  Analysis result;
+  if (bpp != 4 || f.isOpaque) {
+    result.alphaType = AlphaType_None;
+  } else if (f.isOneBit) {
+    result.alphaType = AlphaType_OneBit;
+  } else {
+    result.alphaType = AlphaType_Smooth;
+  }
+  result.isSolid = f.isSolid;
+  return result;
+}
+
+} // namespace Image
@@ -0,0 +1,31 @@
+/**
+  @file analyze.h
+
+  Classify the image content to select the compressed format.
+*/
+#ifndef ANALYZE_H_INCLUDED
+#define ANALYZE_H_INCLUDED
+#include "image.h"
+
+namespace Image {
+
+/** The usage of the alpha channel.
+*/
+enum AlphaType {
+  AlphaType_None, ///< no alpha channel, or all alpha is 255.
+  AlphaType_OneBit, ///< all alpha is 0 or 255.
+  AlphaType_Smooth, ///< the alpha has intermediate values.
+};
+
+/** The result of analyze().
+*/
+struct Analysis {
+  AlphaType alphaType;
+  bool isSolid; ///< all pixels have the same color and alpha.
+};
+
+Analysis analyze(const Bitmap& image);
+
+} // namespace Image
+
+#endif // ANALYZE_H_INCLUDED
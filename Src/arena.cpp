@@ -0,0 +1,70 @@
+/**
+  @file arena.cpp
+*/
+#include "arena.h"
+
+/** Make sure the arena has the memory block of size bytes at least.
+
+  @param size  the required capacity in bytes. it should be the sum of
+               aligned_size() of all the allocations.
+
+  @note The block is re-allocated only when it is too small. In that case, all
+        memory allocated from the arena becomes invalid, so call this method
+        before allocate(), just after reset().
+*/
+void Arena::reserve(size_t size)
+{
+  if (size <= bufferSize) {
+    return;
+  }
+  // The block is allocated with the extra space to align its top address.
+  buffer.reset(new uint8_t[size + defaultAlignment]);
+  const uintptr_t p = reinterpret_cast<uintptr_t>(buffer.get());
+  top = reinterpret_cast<uint8_t*>((p + defaultAlignment - 1) & ~static_cast<uintptr_t>(defaultAlignment - 1));
+  bufferSize = size;
+  used = 0;
+}
+
+/** Use the memory owned by the other object as the block.
+
+  It is used to pass the part of the arena to the other thread. e.g.
+
+  @code
+  Arena sub;
+  sub.assign(arena.allocate(size), size);
+  @endcode
+
+  @param p     the pointer to the memory. it should be aligned to
+               defaultAlignment.
+  @param size  the byte size of the memory.
+*/
+void Arena::assign(void* p, size_t size)
+{
+  buffer.reset();
+  top = static_cast<uint8_t*>(p);
+  bufferSize = p ? size : 0;
+  used = 0;
+}
+
+/** Allocate the memory from the arena.
+
+  @param size       the byte size of the memory.
+  @param alignment  the alignment of the memory. it must be the power of 2.
+
+  @return the pointer to the allocated memory. if the arena doesn't have
+          enough space, return nullptr.
+*/
+void* Arena::allocate(size_t size, size_t alignment)
+{
+  if (!top) {
+    return nullptr;
+  }
+  const uintptr_t base = reinterpret_cast<uintptr_t>(top);
+  const uintptr_t p = (base + used + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+  const size_t newUsed = static_cast<size_t>(p - base) + aligned_size(size);
+  if (newUsed > bufferSize) {
+    return nullptr;
+  }
+  used = newUsed;
+  return reinterpret_cast<void*>(p);
+}
@@ -0,0 +1,51 @@
+/**
+  @file arena.h
+
+  The linear memory arena for the working buffers of the converter.
+*/
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+/** The linear memory arena.
+
+  All allocations are carved out of one memory block, and they are released at
+  once by reset(). The block is never shrunk, so the arena that is reused for
+  the next file doesn't touch the heap unless the file needs more memory.
+*/
+class Arena {
+public:
+  static const size_t defaultAlignment = 16;
+
+  Arena() : buffer(), top(nullptr), bufferSize(0), used(0) {}
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void reserve(size_t size);
+  void assign(void* p, size_t size);
+  void* allocate(size_t size, size_t alignment = defaultAlignment);
+  template<typename T> T* allocate_array(size_t count) {
+    return static_cast<T*>(allocate(sizeof(T) * count, alignof(T) > defaultAlignment ? alignof(T) : defaultAlignment));
+  }
+  void reset() { used = 0; }
+  size_t capacity() const { return bufferSize; }
+  size_t size() const { return used; }
+
+  /** Get the size that is needed to allocate size bytes in the arena.
+
+    Use this to sum up the argument of reserve().
+  */
+  static size_t aligned_size(size_t size, size_t alignment = defaultAlignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+private:
+  std::unique_ptr<uint8_t[]> buffer;
+  uint8_t* top; ///< the aligned top of the block.
+  size_t bufferSize;
+  size_t used;
+};
+
+#endif // ARENA_H_INCLUDED
@@ -0,0 +1,666 @@
+/**
+  @file atc.cpp
+
+  The block encoder and decoder of ATC.
+
+  The color block is 8 bytes of 2 colors and 2bit indices. The first color
+  is RGB555 with the mode bit, and the second is RGB565. The alpha block of
+  ATCA(explicit alpha) is 4bit per pixel, and the one of ATCI(interpolated
+  alpha) is 2 end points and 3bit indices. The alpha block precedes the color
+  block.
+*/
+#include "blockcodec.h"
+#include "simd.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace BlockCodec {
+
+namespace /* unnamed */ {
+
+inline int Clamp(int n, int lo, int hi) { return n < lo ? lo : n > hi ? hi : n; }
+inline int Expand5(int n) { return (n << 3) | (n >> 2); }
+inline int Expand6(int n) { return (n << 2) | (n >> 4); }
+
+/** Get the palette of the color block.
+
+  @param c0       the first color. the bit 15 is the mode.
+  @param c1       the second color.
+  @param palette  the array to store 4 colors of RGB.
+*/
+void GetColorPalette(uint32_t c0, uint32_t c1, int (*palette)[3]) {
+  const int e0[3] = { Expand5((c0 >> 10) & 31), Expand5((c0 >> 5) & 31), Expand5(c0 & 31) };
+  const int e1[3] = { Expand5((c1 >> 11) & 31), Expand6((c1 >> 5) & 63), Expand5(c1 & 31) };
+  for (int c = 0; c < 3; ++c) {
+    if (c0 & 0x8000) {
+      palette[0][c] = 0;
+      palette[1][c] = std::max(e0[c] - e1[c] / 4, 0);
+      palette[2][c] = e0[c];
+      palette[3][c] = e1[c];
+    } else {
+      palette[0][c] = e0[c];
+      palette[1][c] = (5 * e0[c] + 3 * e1[c]) / 8;
+      palette[2][c] = (3 * e0[c] + 5 * e1[c]) / 8;
+      palette[3][c] = e1[c];
+    }
+  }
+}
+
+/** Select the nearest palette color of each pixel.
+
+  @param pRGBA     16 pixels of the block.
+  @param palette   4 colors.
+  @param pIndices  the pointer to store 2bit indices.
+
+  @return the squared error.
+*/
+int SelectColorIndices(const uint8_t* pRGBA, const int (*palette)[3], uint32_t* pIndices) {
+  uint32_t indices = 0;
+  int error = 0;
+  for (int i = 0; i < 16; ++i) {
+    const uint8_t* p = pRGBA + i * 4;
+    int bestError = INT_MAX;
+    int bestIndex = 0;
+    for (int n = 0; n < 4; ++n) {
+      int e = 0;
+      for (int c = 0; c < 3; ++c) {
+        const int d = palette[n][c] - p[c];
+        e += d * d;
+      }
+      if (e < bestError) {
+        bestError = e;
+        bestIndex = n;
+      }
+    }
+    indices |= bestIndex << (i * 2);
+    error += bestError;
+  }
+  *pIndices = indices;
+  return error;
+}
+
+#if ATCCONV_HAS_SSE2
+/** Load 16 pixels as 4 groups of 4 pixels.
+
+  @param pRGBA  16 pixels of the block.
+  @param rg     the array to store R and G in 16bit lanes.
+  @param b      the array to store B and 0 in 16bit lanes.
+  @param a      the array to store A and 0 in 16bit lanes.
+*/
+void LoadPixelsSSE2(const uint8_t* pRGBA, __m128i* rg, __m128i* b, __m128i* a) {
+  const __m128i mask = _mm_set1_epi32(0xff);
+  for (int g = 0; g < 4; ++g) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRGBA + g * 16));
+    const __m128i green = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+    rg[g] = _mm_or_si128(_mm_and_si128(v, mask), _mm_slli_epi32(green, 16));
+    b[g] = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+    a[g] = _mm_srli_epi32(v, 24);
+  }
+}
+
+/** SelectColorIndices() by SSE2.
+*/
+int SelectColorIndicesSSE2(const uint8_t* pRGBA, const int (*palette)[3], uint32_t* pIndices) {
+  __m128i rg[4], b[4], a[4];
+  LoadPixelsSSE2(pRGBA, rg, b, a);
+  __m128i bestError[4];
+  __m128i bestIndex[4];
+  for (int g = 0; g < 4; ++g) {
+    bestError[g] = _mm_set1_epi32(INT_MAX);
+    bestIndex[g] = _mm_setzero_si128();
+  }
+  for (int n = 0; n < 4; ++n) {
+    const __m128i candRG = _mm_set1_epi32((palette[n][1] << 16) | palette[n][0]);
+    const __m128i candB = _mm_set1_epi32(palette[n][2]);
+    const __m128i index = _mm_set1_epi32(n);
+    for (int g = 0; g < 4; ++g) {
+      const __m128i dRG = _mm_sub_epi16(rg[g], candRG);
+      const __m128i dB = _mm_sub_epi16(b[g], candB);
+      const __m128i e = _mm_add_epi32(_mm_madd_epi16(dRG, dRG), _mm_madd_epi16(dB, dB));
+      const __m128i less = _mm_cmplt_epi32(e, bestError[g]);
+      bestError[g] = _mm_or_si128(_mm_and_si128(less, e), _mm_andnot_si128(less, bestError[g]));
+      bestIndex[g] = _mm_or_si128(_mm_and_si128(less, index), _mm_andnot_si128(less, bestIndex[g]));
+    }
+  }
+  int32_t errors[16];
+  int32_t indexList[16];
+  for (int g = 0; g < 4; ++g) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(errors + g * 4), bestError[g]);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indexList + g * 4), bestIndex[g]);
+  }
+  uint32_t indices = 0;
+  int error = 0;
+  for (int i = 0; i < 16; ++i) {
+    indices |= indexList[i] << (i * 2);
+    error += errors[i];
+  }
+  *pIndices = indices;
+  return error;
+}
+#endif // ATCCONV_HAS_SSE2
+
+/** Select the nearest palette color of each pixel by the kernel.
+*/
+int SelectColorIndices(const uint8_t* pRGBA, const int (*palette)[3], Kernel kernel, uint32_t* pIndices) {
+#if ATCCONV_HAS_SSE2
+  if (kernel == Kernel_SSE2) {
+    return SelectColorIndicesSSE2(pRGBA, palette, pIndices);
+  }
+#endif // ATCCONV_HAS_SSE2
+  return SelectColorIndices(pRGBA, palette, pIndices);
+}
+
+inline uint32_t Quantize555(const float* p) {
+  return (Clamp(static_cast<int>(p[0] * 31.0f / 255.0f + 0.5f), 0, 31) << 10) |
+    (Clamp(static_cast<int>(p[1] * 31.0f / 255.0f + 0.5f), 0, 31) << 5) |
+    Clamp(static_cast<int>(p[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+}
+
+inline uint32_t Quantize565(const float* p) {
+  return (Clamp(static_cast<int>(p[0] * 31.0f / 255.0f + 0.5f), 0, 31) << 11) |
+    (Clamp(static_cast<int>(p[1] * 63.0f / 255.0f + 0.5f), 0, 63) << 5) |
+    Clamp(static_cast<int>(p[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+}
+
+/** The candidate of the color block.
+*/
+struct ColorBlock {
+  uint32_t c0;
+  uint32_t c1;
+  uint32_t indices;
+  int error;
+};
+
+/** Quantize the end points and select the indices.
+
+  @param pRGBA  16 pixels of the block.
+  @param e0     the first end point in RGB.
+  @param e1     the second end point in RGB.
+  @param kernel the implementation of the search.
+  @param best   the best candidate. it is updated if this is better.
+*/
+void TryEndPoints(const uint8_t* pRGBA, const float* e0, const float* e1, Kernel kernel, ColorBlock& best) {
+  ColorBlock cb;
+  cb.c0 = Quantize555(e0);
+  cb.c1 = Quantize565(e1);
+  int palette[4][3];
+  GetColorPalette(cb.c0, cb.c1, palette);
+  cb.error = SelectColorIndices(pRGBA, palette, kernel, &cb.indices);
+  if (cb.error < best.error) {
+    best = cb;
+  }
+}
+
+/** Solve the end points that fit the indices in the least squares sense.
+
+  @retval true  the end points are solved.
+  @retval false all pixels use the same weight.
+*/
+bool RefineEndPoints(const uint8_t* pRGBA, uint32_t indices, float* e0, float* e1) {
+  static const float weightList[4] = { 1.0f, 5.0f / 8.0f, 3.0f / 8.0f, 0.0f };
+  float aa = 0, ab = 0, bb = 0;
+  float ax[3] = {}, bx[3] = {};
+  for (int i = 0; i < 16; ++i) {
+    const float a = weightList[(indices >> (i * 2)) & 3];
+    const float b = 1.0f - a;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c < 3; ++c) {
+      ax[c] += a * pRGBA[i * 4 + c];
+      bx[c] += b * pRGBA[i * 4 + c];
+    }
+  }
+  const float det = aa * bb - ab * ab;
+  if (std::fabs(det) < 1e-6f) {
+    return false;
+  }
+  for (int c = 0; c < 3; ++c) {
+    e0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / det, 0.0f), 255.0f);
+    e1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / det, 0.0f), 255.0f);
+  }
+  return true;
+}
+
+/** Get the alpha values of the interpolated alpha block.
+
+  @param a0       the first end point.
+  @param a1       the second end point.
+  @param palette  the array to store 8 values.
+*/
+void GetAlphaPalette(int a0, int a1, int* palette) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int i = 1; i < 7; ++i) {
+      palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    }
+  } else {
+    for (int i = 1; i < 5; ++i) {
+      palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+/** Select the nearest alpha value of each pixel.
+
+  @return the squared error.
+*/
+int SelectAlphaIndices(const uint8_t* pRGBA, int a0, int a1, uint64_t* pIndices) {
+  int palette[8];
+  GetAlphaPalette(a0, a1, palette);
+  uint64_t indices = 0;
+  int error = 0;
+  for (int i = 0; i < 16; ++i) {
+    const int a = pRGBA[i * 4 + 3];
+    int bestError = INT_MAX;
+    int bestIndex = 0;
+    for (int n = 0; n < 8; ++n) {
+      const int e = (palette[n] - a) * (palette[n] - a);
+      if (e < bestError) {
+        bestError = e;
+        bestIndex = n;
+      }
+    }
+    indices |= static_cast<uint64_t>(bestIndex) << (i * 3);
+    error += bestError;
+  }
+  *pIndices = indices;
+  return error;
+}
+
+#if ATCCONV_HAS_SSE2
+/** SelectAlphaIndices() by SSE2.
+*/
+int SelectAlphaIndicesSSE2(const uint8_t* pRGBA, int a0, int a1, uint64_t* pIndices) {
+  int palette[8];
+  GetAlphaPalette(a0, a1, palette);
+  __m128i rg[4], b[4], a[4];
+  LoadPixelsSSE2(pRGBA, rg, b, a);
+  __m128i bestError[4];
+  __m128i bestIndex[4];
+  for (int g = 0; g < 4; ++g) {
+    bestError[g] = _mm_set1_epi32(INT_MAX);
+    bestIndex[g] = _mm_setzero_si128();
+  }
+  for (int n = 0; n < 8; ++n) {
+    const __m128i cand = _mm_set1_epi32(palette[n]);
+    const __m128i index = _mm_set1_epi32(n);
+    for (int g = 0; g < 4; ++g) {
+      const __m128i d = _mm_sub_epi16(a[g], cand);
+      const __m128i e = _mm_madd_epi16(d, d);
+      const __m128i less = _mm_cmplt_epi32(e, bestError[g]);
+      bestError[g] = _mm_or_si128(_mm_and_si128(less, e), _mm_andnot_si128(less, bestError[g]));
+      bestIndex[g] = _mm_or_si128(_mm_and_si128(less, index), _mm_andnot_si128(less, bestIndex[g]));
+    }
+  }
+  int32_t errors[16];
+  int32_t indexList[16];
+  for (int g = 0; g < 4; ++g) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(errors + g * 4), bestError[g]);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indexList + g * 4), bestIndex[g]);
+  }
+  uint64_t indices = 0;
+  int error = 0;
+  for (int i = 0; i < 16; ++i) {
+    indices |= static_cast<uint64_t>(indexList[i]) << (i * 3);
+    error += errors[i];
+  }
+  *pIndices = indices;
+  return error;
+}
+#endif // ATCCONV_HAS_SSE2
+
+/** Select the nearest alpha value of each pixel by the kernel.
+*/
+int SelectAlphaIndices(const uint8_t* pRGBA, int a0, int a1, Kernel kernel, uint64_t* pIndices) {
+#if ATCCONV_HAS_SSE2
+  if (kernel == Kernel_SSE2) {
+    return SelectAlphaIndicesSSE2(pRGBA, a0, a1, pIndices);
+  }
+#endif // ATCCONV_HAS_SSE2
+  return SelectAlphaIndices(pRGBA, a0, a1, pIndices);
+}
+
+#if ATCCONV_HAS_SSE2
+/** Select 4 colors of the row by the masks of the index bits.
+
+  @param palette  4 colors that is broadcast to all lanes.
+  @param indices  8 bits of 4 indices of the row.
+*/
+inline __m128i SelectColorsSSE2(const __m128i* palette, uint32_t indices) {
+  const __m128i v = _mm_set1_epi32(static_cast<int>(indices));
+  const __m128i lsbBits = _mm_setr_epi32(1, 4, 16, 64);
+  const __m128i msbBits = _mm_setr_epi32(2, 8, 32, 128);
+  const __m128i isLsb = _mm_cmpeq_epi32(_mm_and_si128(v, lsbBits), lsbBits);
+  const __m128i isMsb = _mm_cmpeq_epi32(_mm_and_si128(v, msbBits), msbBits);
+  const __m128i lo = _mm_or_si128(_mm_and_si128(isLsb, palette[1]), _mm_andnot_si128(isLsb, palette[0]));
+  const __m128i hi = _mm_or_si128(_mm_and_si128(isLsb, palette[3]), _mm_andnot_si128(isLsb, palette[2]));
+  return _mm_or_si128(_mm_and_si128(isMsb, hi), _mm_andnot_si128(isMsb, lo));
+}
+
+/** Decompress the color of ATC block by SSE2.
+
+  The palette is made by the scalar code, and each row selects the colors of
+  4 pixels by the masks of their index bits. The alpha isn't changed.
+*/
+void DecodeColorBlockSSE2(const uint8_t* pIn, uint8_t* pRGBA) {
+  int colors[4][3];
+  GetColorPalette(pIn[0] | (pIn[1] << 8), pIn[2] | (pIn[3] << 8), colors);
+  __m128i palette[4];
+  for (int i = 0; i < 4; ++i) {
+    palette[i] = _mm_set1_epi32(colors[i][0] | (colors[i][1] << 8) | (colors[i][2] << 16));
+  }
+  const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xff000000));
+  for (int y = 0; y < 4; ++y) {
+    __m128i* p = reinterpret_cast<__m128i*>(pRGBA + y * 16);
+    const __m128i alpha = _mm_and_si128(_mm_loadu_si128(p), alphaMask);
+    _mm_storeu_si128(p, _mm_or_si128(SelectColorsSSE2(palette, pIn[4 + y]), alpha));
+  }
+}
+
+/** Decompress the explicit alpha block by SSE2.
+
+  The nibbles are interleaved to 16 bytes of the alpha, and they are moved
+  to the top byte of each pixel. The color isn't changed.
+*/
+void DecodeExplicitAlphaBlockSSE2(const uint8_t* pIn, uint8_t* pRGBA) {
+  const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pIn));
+  const __m128i nibbleMask = _mm_set1_epi8(15);
+  const __m128i n = _mm_unpacklo_epi8(_mm_and_si128(v, nibbleMask), _mm_and_si128(_mm_srli_epi16(v, 4), nibbleMask));
+  // n * 17 is n | (n << 4) for 4bit n.
+  const __m128i a = _mm_or_si128(n, _mm_slli_epi16(n, 4));
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i a16[2] = { _mm_unpacklo_epi8(zero, a), _mm_unpackhi_epi8(zero, a) };
+  const __m128i colorMask = _mm_set1_epi32(0xffffff);
+  for (int y = 0; y < 4; ++y) {
+    __m128i* p = reinterpret_cast<__m128i*>(pRGBA + y * 16);
+    const __m128i alpha = y & 1 ? _mm_unpackhi_epi16(zero, a16[y / 2]) : _mm_unpacklo_epi16(zero, a16[y / 2]);
+    _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(p), colorMask), alpha));
+  }
+}
+#endif // ATCCONV_HAS_SSE2
+
+} // unnamed namespace
+
+/** Compress the color of 4x4 pixels to ATC.
+
+  The end points are the range of the pixels along the principal axis, and
+  they are refined by the least squares once. Only the interpolated mode is
+  used. The rest of the search is skipped as soon as the error reaches
+  errorTarget.
+
+  @param pRGBA        16 pixels of the block.
+  @param kernel       the implementation of the search.
+  @param errorTarget  the squared error of RGB that is good enough. if it is
+                      0, all candidates are tried.
+  @param pOut         the buffer to store 8 bytes of the block.
+*/
+void encode_atc_color_block(const uint8_t* pRGBA, Kernel kernel, int errorTarget, uint8_t* pOut)
+{
+  float mean[3] = {};
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      mean[c] += pRGBA[i * 4 + c];
+    }
+  }
+  for (int c = 0; c < 3; ++c) {
+    mean[c] /= 16.0f;
+  }
+  float cov[6] = {};
+  for (int i = 0; i < 16; ++i) {
+    const float r = pRGBA[i * 4 + 0] - mean[0];
+    const float g = pRGBA[i * 4 + 1] - mean[1];
+    const float b = pRGBA[i * 4 + 2] - mean[2];
+    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+  }
+  // The principal axis by the power iteration.
+  float axis[3] = { 0.9f, 1.0f, 0.7f };
+  for (int n = 0; n < 8; ++n) {
+    const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    const float m = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+    if (m < 1e-6f) {
+      break;
+    }
+    axis[0] = x / m;
+    axis[1] = y / m;
+    axis[2] = z / m;
+  }
+  float minT = 0, maxT = 0;
+  for (int i = 0; i < 16; ++i) {
+    const float t = (pRGBA[i * 4 + 0] - mean[0]) * axis[0] + (pRGBA[i * 4 + 1] - mean[1]) * axis[1] + (pRGBA[i * 4 + 2] - mean[2]) * axis[2];
+    minT = std::min(minT, t);
+    maxT = std::max(maxT, t);
+  }
+  const float len = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+  float lo[3], hi[3];
+  for (int c = 0; c < 3; ++c) {
+    lo[c] = std::min(std::max(mean[c] + axis[c] * minT / len, 0.0f), 255.0f);
+    hi[c] = std::min(std::max(mean[c] + axis[c] * maxT / len, 0.0f), 255.0f);
+  }
+
+  ColorBlock best = { 0, 0, 0, INT_MAX };
+  TryEndPoints(pRGBA, hi, lo, kernel, best);
+  if (best.error > errorTarget) {
+    TryEndPoints(pRGBA, lo, hi, kernel, best);
+  }
+  float e0[3], e1[3];
+  if (best.error > errorTarget && RefineEndPoints(pRGBA, best.indices, e0, e1)) {
+    TryEndPoints(pRGBA, e0, e1, kernel, best);
+  }
+  pOut[0] = static_cast<uint8_t>(best.c0);
+  pOut[1] = static_cast<uint8_t>(best.c0 >> 8);
+  pOut[2] = static_cast<uint8_t>(best.c1);
+  pOut[3] = static_cast<uint8_t>(best.c1 >> 8);
+  for (int i = 0; i < 4; ++i) {
+    pOut[4 + i] = static_cast<uint8_t>(best.indices >> (i * 8));
+  }
+}
+
+/** Compress the color of 4x4 pixels to ATC without the search.
+
+  The end points are the corners of the bounding box, and each pixel selects
+  the index by the projection to the line between them.
+
+  @param pRGBA  16 pixels of the block.
+  @param pOut   the buffer to store 8 bytes of the block.
+*/
+void encode_atc_color_block_preview(const uint8_t* pRGBA, uint8_t* pOut)
+{
+  int lo[3] = { 255, 255, 255 };
+  int hi[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      lo[c] = std::min(lo[c], static_cast<int>(pRGBA[i * 4 + c]));
+      hi[c] = std::max(hi[c], static_cast<int>(pRGBA[i * 4 + c]));
+    }
+  }
+  const uint32_t c0 = (((hi[0] * 31 + 127) / 255) << 10) | (((hi[1] * 31 + 127) / 255) << 5) | ((hi[2] * 31 + 127) / 255);
+  const uint32_t c1 = (((lo[0] * 31 + 127) / 255) << 11) | (((lo[1] * 63 + 127) / 255) << 5) | ((lo[2] * 31 + 127) / 255);
+  int palette[4][3];
+  GetColorPalette(c0, c1, palette);
+  int axis[3];
+  int length = 0;
+  for (int c = 0; c < 3; ++c) {
+    axis[c] = palette[0][c] - palette[3][c];
+    length += axis[c] * axis[c];
+  }
+  uint32_t indices = 0;
+  if (length > 0) {
+    for (int i = 0; i < 16; ++i) {
+      const uint8_t* p = pRGBA + i * 4;
+      const int d = 16 * ((p[0] - palette[3][0]) * axis[0] + (p[1] - palette[3][1]) * axis[1] + (p[2] - palette[3][2]) * axis[2]);
+      // The palette is at 1, 5/8, 3/8 and 0 on the line.
+      const uint32_t index = d > 13 * length ? 0 : d > 8 * length ? 1 : d > 3 * length ? 2 : 3;
+      indices |= index << (i * 2);
+    }
+  }
+  pOut[0] = static_cast<uint8_t>(c0);
+  pOut[1] = static_cast<uint8_t>(c0 >> 8);
+  pOut[2] = static_cast<uint8_t>(c1);
+  pOut[3] = static_cast<uint8_t>(c1 >> 8);
+  for (int i = 0; i < 4; ++i) {
+    pOut[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+  }
+}
+
+/** Decompress the color of ATC block.
+
+  @param pIn     8 bytes of the color block.
+  @param kernel  the implementation of the decoder.
+  @param pRGBA   the buffer to store 16 pixels. the alpha isn't changed.
+*/
+void decode_atc_color_block(const uint8_t* pIn, Kernel kernel, uint8_t* pRGBA)
+{
+#if ATCCONV_HAS_SSE2
+  if (kernel == Kernel_SSE2) {
+    DecodeColorBlockSSE2(pIn, pRGBA);
+    return;
+  }
+#endif // ATCCONV_HAS_SSE2
+  const uint32_t c0 = pIn[0] | (pIn[1] << 8);
+  const uint32_t c1 = pIn[2] | (pIn[3] << 8);
+  const uint32_t indices = pIn[4] | (pIn[5] << 8) | (pIn[6] << 16) | (static_cast<uint32_t>(pIn[7]) << 24);
+  int palette[4][3];
+  GetColorPalette(c0, c1, palette);
+  for (int i = 0; i < 16; ++i) {
+    const int n = (indices >> (i * 2)) & 3;
+    for (int c = 0; c < 3; ++c) {
+      pRGBA[i * 4 + c] = static_cast<uint8_t>(palette[n][c]);
+    }
+  }
+}
+
+/** Compress the alpha of 4x4 pixels to 4bit per pixel.
+
+  @param pRGBA  16 pixels of the block.
+  @param pOut   the buffer to store 8 bytes of the block.
+*/
+void encode_explicit_alpha_block(const uint8_t* pRGBA, uint8_t* pOut)
+{
+  for (int i = 0; i < 8; ++i) {
+    const int lo = (pRGBA[i * 8 + 3] * 15 + 127) / 255;
+    const int hi = (pRGBA[i * 8 + 7] * 15 + 127) / 255;
+    pOut[i] = static_cast<uint8_t>(lo | (hi << 4));
+  }
+}
+
+/** Decompress the explicit alpha block.
+
+  @param pIn     8 bytes of the alpha block.
+  @param kernel  the implementation of the decoder.
+  @param pRGBA   the buffer to store the alpha of 16 pixels.
+*/
+void decode_explicit_alpha_block(const uint8_t* pIn, Kernel kernel, uint8_t* pRGBA)
+{
+#if ATCCONV_HAS_SSE2
+  if (kernel == Kernel_SSE2) {
+    DecodeExplicitAlphaBlockSSE2(pIn, pRGBA);
+    return;
+  }
+#endif // ATCCONV_HAS_SSE2
+  for (int i = 0; i < 8; ++i) {
+    pRGBA[i * 8 + 3] = static_cast<uint8_t>((pIn[i] & 15) * 17);
+    pRGBA[i * 8 + 7] = static_cast<uint8_t>((pIn[i] >> 4) * 17);
+  }
+}
+
+/** Compress the alpha of 4x4 pixels to the interpolated alpha block.
+
+  Both of the 8 values mode for the range of all pixels, and the 6 values mode
+  for the range except 0 and 255 are tried.
+
+  @param pRGBA   16 pixels of the block.
+  @param kernel  the implementation of the search.
+  @param pOut    the buffer to store 8 bytes of the block.
+*/
+void encode_interpolated_alpha_block(const uint8_t* pRGBA, Kernel kernel, uint8_t* pOut)
+{
+  int minA = 255, maxA = 0;
+  int minInner = 255, maxInner = 0;
+  for (int i = 0; i < 16; ++i) {
+    const int a = pRGBA[i * 4 + 3];
+    minA = std::min(minA, a);
+    maxA = std::max(maxA, a);
+    if (a != 0 && a != 255) {
+      minInner = std::min(minInner, a);
+      maxInner = std::max(maxInner, a);
+    }
+  }
+  if (minInner > maxInner) {
+    minInner = maxInner = minA;
+  }
+  int a0 = maxA, a1 = minA;
+  uint64_t indices;
+  int error = SelectAlphaIndices(pRGBA, a0, a1, kernel, &indices);
+  uint64_t indices6;
+  const int error6 = SelectAlphaIndices(pRGBA, minInner, maxInner, kernel, &indices6);
+  if (error6 < error) {
+    a0 = minInner;
+    a1 = maxInner;
+    indices = indices6;
+  }
+  pOut[0] = static_cast<uint8_t>(a0);
+  pOut[1] = static_cast<uint8_t>(a1);
+  for (int i = 0; i < 6; ++i) {
+    pOut[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+  }
+}
+
+/** Compress the alpha of 4x4 pixels to the interpolated alpha block without the search.
+
+  The 8 values mode for the range of all pixels is always used, and the
+  index is calculated from the alpha directly.
+
+  @param pRGBA  16 pixels of the block.
+  @param pOut   the buffer to store 8 bytes of the block.
+*/
+void encode_interpolated_alpha_block_preview(const uint8_t* pRGBA, uint8_t* pOut)
+{
+  int a0 = 0, a1 = 255;
+  for (int i = 0; i < 16; ++i) {
+    a0 = std::max(a0, static_cast<int>(pRGBA[i * 4 + 3]));
+    a1 = std::min(a1, static_cast<int>(pRGBA[i * 4 + 3]));
+  }
+  uint64_t indices = 0;
+  if (a0 > a1) {
+    // The step from a1 to a0 in 1/7 by 16bit fixed point.
+    const int scale = (7 << 16) / (a0 - a1);
+    for (int i = 0; i < 16; ++i) {
+      const int step = std::min(((pRGBA[i * 4 + 3] - a1) * scale + 0x8000) >> 16, 7);
+      const int index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+      indices |= static_cast<uint64_t>(index) << (i * 3);
+    }
+  }
+  pOut[0] = static_cast<uint8_t>(a0);
+  pOut[1] = static_cast<uint8_t>(a1);
+  for (int i = 0; i < 6; ++i) {
+    pOut[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+  }
+}
+
+/** Decompress the interpolated alpha block.
+
+  @param pIn    8 bytes of the alpha block.
+  @param pRGBA  the buffer to store the alpha of 16 pixels.
+*/
+void decode_interpolated_alpha_block(const uint8_t* pIn, uint8_t* pRGBA)
+{
+  int palette[8];
+  GetAlphaPalette(pIn[0], pIn[1], palette);
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; ++i) {
+    indices |= static_cast<uint64_t>(pIn[2 + i]) << (i * 8);
+  }
+  for (int i = 0; i < 16; ++i) {
+    pRGBA[i * 4 + 3] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 7]);
+  }
+}
+
+} // namespace BlockCodec
@@ -0,0 +1,226 @@
+/**
+  @file blockcodec.cpp
+*/
+#include "blockcodec.h"
+#include "format.h"
+#include "simd.h"
+#include <TextureConverter.h>
+#include <algorithm>
+
+namespace BlockCodec {
+
+namespace /* unnamed */ {
+
+/** The importance of the block that is encoded by Effort_Full.
+
+  The block under it is encoded by Effort_Preview. Above it, the error that
+  stops the search shrinks as the importance grows, and the block of 255 is
+  searched fully.
+*/
+const uint8_t fullEffortImportance = 64;
+
+/** The pixel of Image::Bitmap that has 3 bytes per pixel.
+
+  The layouts convert the pixels to RGBA for the block functions. They are
+  passed to FetchBlock() as the template argument, so the gather of each
+  layout is compiled without the branch by the bytes per pixel.
+*/
+struct LayoutBGR24 {
+  static const uint32_t bytesPerPixel = 3;
+
+  static void load(const uint8_t* p, uint8_t* q) {
+    q[0] = p[2];
+    q[1] = p[1];
+    q[2] = p[0];
+    q[3] = 255;
+  }
+  static void load_row(const uint8_t* p, uint8_t* q) {
+    for (uint32_t i = 0; i < 4; ++i) {
+      load(p + i * 3, q + i * 4);
+    }
+  }
+};
+
+/** The pixel of Image::Bitmap that has 4 bytes per pixel.
+*/
+struct LayoutBGRA32 {
+  static const uint32_t bytesPerPixel = 4;
+
+  static void load(const uint8_t* p, uint8_t* q) {
+    q[0] = p[2];
+    q[1] = p[1];
+    q[2] = p[0];
+    q[3] = p[3];
+  }
+  static void load_row(const uint8_t* p, uint8_t* q) {
+#if ATCCONV_HAS_SSE2
+    // Swap B and R of 4 pixels at once.
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i ga = _mm_and_si128(v, _mm_set1_epi32(static_cast<int>(0xff00ff00)));
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), _mm_set1_epi32(0xff));
+    const __m128i b = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xff)), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(q), _mm_or_si128(ga, _mm_or_si128(r, b)));
+#else
+    for (uint32_t i = 0; i < 4; ++i) {
+      load(p + i * 4, q + i * 4);
+    }
+#endif // ATCCONV_HAS_SSE2
+  }
+};
+
+/** Get 4x4 pixels from BGR(A) image.
+
+  The pixels out of the image are clamped to the edge. The vertical flip is
+  done by the negative pitch of the image, so it needs no pass either.
+
+  @tparam Layout  LayoutBGR24 or LayoutBGRA32 by the bytes per pixel of image.
+
+  @param image  the source image.
+  @param x      the left of the block.
+  @param y      the top of the block.
+  @param pRGBA  the buffer to store 16 pixels.
+*/
+template<typename Layout>
+void FetchBlock(const Image::Bitmap& image, uint32_t x, uint32_t y, uint8_t* pRGBA) {
+  if (x + 4 <= image.width && y + 4 <= image.height) {
+    // The block in the image needn't clamp.
+    for (uint32_t by = 0; by < 4; ++by) {
+      Layout::load_row(image.row(y + by) + x * Layout::bytesPerPixel, pRGBA + by * 16);
+    }
+    return;
+  }
+  for (uint32_t by = 0; by < 4; ++by) {
+    const uint8_t* pRow = image.row(std::min(y + by, image.height - 1));
+    for (uint32_t bx = 0; bx < 4; ++bx) {
+      Layout::load(pRow + std::min(x + bx, image.width - 1) * Layout::bytesPerPixel, pRGBA + (by * 4 + bx) * 4);
+    }
+  }
+}
+
+/** Compress 4x4 pixels.
+
+  @retval true  success.
+  @retval false the format isn't supported.
+*/
+bool EncodeBlock(const uint8_t* pRGBA, uint32_t outputFormat, Kernel kernel, Effort effort, int errorTarget, uint8_t* pOut) {
+  switch (outputFormat) {
+  case Q_FORMAT_ETC1_RGB8:
+    if (effort == Effort_Preview) {
+      encode_etc1_block_preview(pRGBA, pOut);
+    } else {
+      encode_etc1_block(pRGBA, kernel, errorTarget, pOut);
+    }
+    return true;
+  case Q_FORMAT_ATC_RGBA_EXPLICIT_ALPHA:
+    encode_explicit_alpha_block(pRGBA, pOut);
+    if (effort == Effort_Preview) {
+      encode_atc_color_block_preview(pRGBA, pOut + 8);
+    } else {
+      encode_atc_color_block(pRGBA, kernel, errorTarget, pOut + 8);
+    }
+    return true;
+  case Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA:
+    if (effort == Effort_Preview) {
+      encode_interpolated_alpha_block_preview(pRGBA, pOut);
+      encode_atc_color_block_preview(pRGBA, pOut + 8);
+    } else {
+      encode_interpolated_alpha_block(pRGBA, kernel, pOut);
+      encode_atc_color_block(pRGBA, kernel, errorTarget, pOut + 8);
+    }
+    return true;
+  default:
+    return false;
+  }
+}
+
+/** Get the squared error of RGB that stops the search of the block.
+
+  The RMS error per channel grows linearly from 0 at the importance 255 to
+  4 at fullEffortImportance.
+
+  @param importance  the importance of the block. it is fullEffortImportance
+                     or more.
+
+  @return the sum of the squared error of 16 pixels x 3 channels.
+*/
+int GetErrorTarget(uint32_t importance) {
+  const int rms = static_cast<int>((255 - importance) * 4 / (255 - fullEffortImportance));
+  return 16 * 3 * rms * rms;
+}
+
+/** Compress all blocks of the image in the row-major order.
+
+  @tparam Layout  the layout of the pixels of image.
+
+  @retval true  success.
+  @retval false the format isn't supported.
+*/
+template<typename Layout>
+bool EncodeBlocks(const Image::Bitmap& image, uint32_t outputFormat, uint32_t bytesPerBlock, Kernel kernel, Effort effort, const Image::Bitmap* pImportance, uint8_t* pOut) {
+  uint8_t block[16 * 4];
+  for (uint32_t y = 0; y < image.height; y += 4) {
+    const uint8_t* pImportanceRow = pImportance ? pImportance->row(y / 4) : nullptr;
+    for (uint32_t x = 0; x < image.width; x += 4) {
+      Effort blockEffort = effort;
+      int errorTarget = 0;
+      if (pImportanceRow && effort == Effort_Full) {
+        const uint32_t importance = pImportanceRow[x / 4];
+        if (importance < fullEffortImportance) {
+          blockEffort = Effort_Preview;
+        } else {
+          errorTarget = GetErrorTarget(importance);
+        }
+      }
+      FetchBlock<Layout>(image, x, y, block);
+      if (!EncodeBlock(block, outputFormat, kernel, blockEffort, errorTarget, pOut)) {
+        return false;
+      }
+      pOut += bytesPerBlock;
+    }
+  }
+  return true;
+}
+
+} // unnamed namespace
+
+/** Check the kernel is built in.
+*/
+bool has_kernel(Kernel kernel)
+{
+  return kernel == Kernel_Scalar || (kernel == Kernel_SSE2 && ATCCONV_HAS_SSE2);
+}
+
+/** Compress the image.
+
+  @param image        the source image. its bytesPerPixel is 3 or 4.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param kernel       the implementation of the search.
+  @param effort       the effort of the encoder.
+  @param pImportance  the importance of each block from 0 to 255. its
+                      bytesPerPixel is 1, and its size is the number of the
+                      blocks. the block of the low importance is encoded by
+                      Effort_Preview, and the search of the others stops at
+                      GetErrorTarget(). if it is nullptr, all blocks are
+                      encoded by effort.
+  @param pOut         the buffer to store the compressed image.
+  @param outSize      the byte size of pOut.
+
+  @retval true  success.
+  @retval false the format isn't the block format, pOut is too small, or
+                pImportance is smaller than the blocks.
+*/
+bool encode_image(const Image::Bitmap& image, uint32_t outputFormat, Kernel kernel, Effort effort, const Image::Bitmap* pImportance, uint8_t* pOut, uint32_t outSize)
+{
+  const TextureFormat::Traits* pTraits = TextureFormat::find(outputFormat);
+  if (!has_kernel(kernel) || !pTraits || !pTraits->isCompressed || outSize < TextureFormat::get_image_size(*pTraits, image.width, image.height)) {
+    return false;
+  }
+  if (pImportance && (pImportance->bytesPerPixel != 1 || pImportance->width * 4 < image.width || pImportance->height * 4 < image.height)) {
+    return false;
+  }
+  return image.bytesPerPixel == 4 ?
+    EncodeBlocks<LayoutBGRA32>(image, outputFormat, pTraits->bytesPerBlock, kernel, effort, pImportance, pOut) :
+    EncodeBlocks<LayoutBGR24>(image, outputFormat, pTraits->bytesPerBlock, kernel, effort, pImportance, pOut);
+}
+
+} // namespace BlockCodec
@@ -0,0 +1,52 @@
+/**
+  @file blockcodec.h
+
+  The native encoder and decoder of ETC1 and ATC.
+
+  The images are decoded by Decoder, which is built on the block decoders.
+  The block functions take 16 pixels of 4x4 block in the row-major order, and
+  each pixel is 4 bytes of R, G, B and A.
+*/
+#ifndef BLOCKCODEC_H_INCLUDED
+#define BLOCKCODEC_H_INCLUDED
+#include "image.h"
+#include <cstdint>
+
+namespace BlockCodec {
+
+/** The implementation of the search loops in the encoder and the decoder.
+
+  All kernels make the same blocks and pixels. They differ only in the speed.
+*/
+enum Kernel {
+  Kernel_Scalar,
+  Kernel_SSE2, ///< it is available only if ATCCONV_HAS_SSE2 is 1.
+};
+
+/** The effort of the encoder.
+*/
+enum Effort {
+  Effort_Preview, ///< the end points are taken from the bounding box without the search.
+  Effort_Full, ///< the end points and the tables are searched.
+};
+
+bool has_kernel(Kernel kernel);
+
+void encode_etc1_block(const uint8_t* pRGBA, Kernel kernel, int errorTarget, uint8_t* pOut);
+void encode_etc1_block_preview(const uint8_t* pRGBA, uint8_t* pOut);
+void decode_etc1_block(const uint8_t* pIn, Kernel kernel, uint8_t* pRGBA);
+
+void encode_atc_color_block(const uint8_t* pRGBA, Kernel kernel, int errorTarget, uint8_t* pOut);
+void encode_atc_color_block_preview(const uint8_t* pRGBA, uint8_t* pOut);
+void decode_atc_color_block(const uint8_t* pIn, Kernel kernel, uint8_t* pRGBA);
+void encode_explicit_alpha_block(const uint8_t* pRGBA, uint8_t* pOut);
+void decode_explicit_alpha_block(const uint8_t* pIn, Kernel kernel, uint8_t* pRGBA);
+void encode_interpolated_alpha_block(const uint8_t* pRGBA, Kernel kernel, uint8_t* pOut);
+void encode_interpolated_alpha_block_preview(const uint8_t* pRGBA, uint8_t* pOut);
+void decode_interpolated_alpha_block(const uint8_t* pIn, uint8_t* pRGBA);
+
+bool encode_image(const Image::Bitmap& image, uint32_t outputFormat, Kernel kernel, Effort effort, const Image::Bitmap* pImportance, uint8_t* pOut, uint32_t outSize);
+
+} // namespace BlockCodec
+
+#endif // BLOCKCODEC_H_INCLUDED
@@ -0,0 +1,192 @@
+/**
+  @file cmdline.cpp
+*/
+#include "cmdline.h"
+#include "format.h"
+#include "encoder.h"
+#include <TextureConverter.h>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+/** Parse the conversion options.
+
+  The first argument that isn't an option is infile, and the second is
+  outfile. The rest of the arguments are ignored.
+
+  @param argc        the number of arguments.
+  @param argv        the arguments without the program name.
+  @param options     the options to store the result. infilename and
+                     outfilename are empty if they aren't passed.
+  @param pFilenames  if it isn't nullptr, all the arguments that aren't
+                     options are added to it instead of infile and outfile.
+
+  @retval true  success.
+  @retval false the arguments are wrong. the error message is printed.
+*/
+bool ParseConvertOptions(int argc, char** argv, ConvertOptions& options, std::vector<std::string>* pFilenames) {
+  std::string infilename;
+  std::string outfilename;
+  uint32_t outputFormat = Q_FORMAT_UNKNOWN;
+  uint32_t maxLevel = 1;
+  bool flipY = false;
+  AlphaLayout alphaLayout = AlphaLayout_None;
+  Image::TransparentMode transparentMode = Image::TransparentMode_None;
+  uint32_t bandBlockRows = 0;
+  Image::NormalMapOptions normalMap;
+  uint32_t threadCount = 0;
+  Image::Filter mipFilter = Image::Filter_Bicubic;
+  bool isFilterPassed = false;
+  bool resizeToPowerOfTwo = false;
+  const Encoder::IBlockEncoder* encoder = nullptr;
+  bool preview = false;
+  std::string maskfilename;
+  bool srgb = false;
+  for (int i = 0; i < argc; ++i) {
+    if (argv[i][0] == '-') {
+      if (strcmp(argv[i], "-filter") == 0) {
+        if (i + 1 >= argc) {
+          std::cout << "Error: '-filter' needs the filter name." << std::endl;
+          return false;
+        }
+        if (!Image::get_filter_by_name(argv[i + 1], &mipFilter)) {
+          std::cout << "Error: '" << argv[i + 1] << "' is unknown filter." << std::endl;
+          return false;
+        }
+        isFilterPassed = true;
+        ++i;
+      } else if ((strcmp(argv[i], "-encoder") == 0 && (i + 1 < argc)) || strncmp(argv[i], "--encoder=", 10) == 0) {
+        const char* name = argv[i][1] == '-' ? argv[i] + 10 : argv[++i];
+        encoder = Encoder::find(name);
+        if (!encoder) {
+          std::cout << "Error: '" << name << "' is unknown encoder or isn't built in." << std::endl;
+          return false;
+        }
+      } else if (strcmp(argv[i], "--preview") == 0) {
+        preview = true;
+      } else if (strcmp(argv[i], "--srgb") == 0) {
+        srgb = true;
+      } else if ((strcmp(argv[i], "-mask") == 0 && (i + 1 < argc)) || strncmp(argv[i], "--mask=", 7) == 0) {
+        maskfilename = argv[i][1] == '-' ? argv[i] + 7 : argv[++i];
+      } else if ((argv[i][1] == 'f' || argv[i][1] == 'F') && argv[i][2] == '\0' && (i + 1 < argc)) {
+        const TextureFormat::Traits* pTraits = TextureFormat::find_by_name(argv[i + 1]);
+        if (pTraits && pTraits->isCompressed) {
+          outputFormat = pTraits->qformat;
+        }
+        if (outputFormat == Q_FORMAT_UNKNOWN) {
+          std::cout << "Error: '" << argv[i + 1] << "' is unknown format." << std::endl;
+          return false;
+        }
+        ++i;
+      } else if ((argv[i][1] == 'a' || argv[i][1] == 'A') && argv[i][2] == '\0' && (i + 1 < argc)) {
+        if (strcmp(argv[i + 1], "separate") == 0) {
+          alphaLayout = AlphaLayout_Separate;
+        } else if (strcmp(argv[i + 1], "stacked") == 0) {
+          alphaLayout = AlphaLayout_Stacked;
+        } else {
+          std::cout << "Error: '" << argv[i + 1] << "' is unknown alpha layout." << std::endl;
+          return false;
+        }
+        ++i;
+      } else if ((argv[i][1] == 't' || argv[i][1] == 'T') && argv[i][2] == '\0' && (i + 1 < argc)) {
+        if (strcmp(argv[i + 1], "premultiply") == 0) {
+          transparentMode = Image::TransparentMode_Premultiply;
+        } else if (strcmp(argv[i + 1], "bleed") == 0) {
+          transparentMode = Image::TransparentMode_Bleed;
+        } else {
+          std::cout << "Error: '" << argv[i + 1] << "' is unknown mode." << std::endl;
+          return false;
+        }
+        ++i;
+      } else if ((argv[i][1] == 'm' || argv[i][1] == 'M') && argv[i][2] == '\0' && (i + 1 < argc)) {
+		maxLevel = std::max(1, std::min(16, std::atoi(argv[i + 1])));
+		++i;
+	  } else if ((argv[i][1] == 'b' || argv[i][1] == 'B') && argv[i][2] == '\0' && (i + 1 < argc)) {
+        bandBlockRows = std::max(1, std::atoi(argv[i + 1]));
+        ++i;
+	  } else if ((argv[i][1] == 'n' || argv[i][1] == 'N') && argv[i][2] == '\0' && (i + 1 < argc)) {
+        if (strcmp(argv[i + 1], "sobel") == 0) {
+          normalMap.filter = Image::NormalFilter_Sobel;
+        } else if (strcmp(argv[i + 1], "prewitt") == 0) {
+          normalMap.filter = Image::NormalFilter_Prewitt;
+        } else {
+          std::cout << "Error: '" << argv[i + 1] << "' is unknown filter." << std::endl;
+          return false;
+        }
+        ++i;
+	  } else if ((argv[i][1] == 's' || argv[i][1] == 'S') && argv[i][2] == '\0' && (i + 1 < argc)) {
+        normalMap.scale = static_cast<float>(std::atof(argv[i + 1]));
+        ++i;
+	  } else if ((argv[i][1] == 'w' || argv[i][1] == 'W') && argv[i][2] == '\0') {
+        normalMap.wrap = true;
+	  } else if ((argv[i][1] == 'j' || argv[i][1] == 'J') && argv[i][2] == '\0' && (i + 1 < argc)) {
+        threadCount = std::max(1, std::atoi(argv[i + 1]));
+        ++i;
+	  } else if ((argv[i][1] == 'p' || argv[i][1] == 'P') && argv[i][2] == '\0') {
+        resizeToPowerOfTwo = true;
+	  } else if ((argv[i][1] == 'v' || argv[i][1] == 'V') && argv[i][2] == '\0') {
+		flipY = true;
+	  }
+      continue;
+    }
+	if (pFilenames) {
+	  pFilenames->push_back(argv[i]);
+	} else if (infilename.empty()) {
+	  infilename = argv[i];
+	} else if (outfilename.empty()) {
+	  outfilename = argv[i];
+	  break;
+	}
+  }
+  if (bandBlockRows && (alphaLayout != AlphaLayout_None || transparentMode == Image::TransparentMode_Bleed || (isFilterPassed && mipFilter != Image::Filter_Mean))) {
+    std::cout << "Error: '-b' can't be used with '-a', '-t bleed' and '-filter' other than 'mean'." << std::endl;
+    return false;
+  }
+  // The band by band conversion makes the mipmaps by the 2x2 box filter only.
+  if (bandBlockRows) {
+    mipFilter = Image::Filter_Mean;
+  }
+  if (normalMap.filter != Image::NormalFilter_None && (alphaLayout != AlphaLayout_None || transparentMode != Image::TransparentMode_None || bandBlockRows)) {
+    std::cout << "Error: '-n' can't be used with '-a', '-t' and '-b'." << std::endl;
+    return false;
+  }
+  if (!maskfilename.empty() && (bandBlockRows || normalMap.filter != Image::NormalFilter_None || alphaLayout == AlphaLayout_Stacked)) {
+    std::cout << "Error: '-mask' can't be used with '-b', '-n' and '-a stacked'." << std::endl;
+    return false;
+  }
+  if (srgb && (bandBlockRows || normalMap.filter != Image::NormalFilter_None || alphaLayout == AlphaLayout_Stacked)) {
+    std::cout << "Error: '--srgb' can't be used with '-b', '-n' and '-a stacked'." << std::endl;
+    return false;
+  }
+  if (preview) {
+    if (encoder) {
+      std::cout << "Error: '--preview' can't be used with '-encoder'." << std::endl;
+      return false;
+    }
+    encoder = Encoder::find("preview");
+    maxLevel = std::min(maxLevel, 2U);
+  }
+  if (resizeToPowerOfTwo && (bandBlockRows || normalMap.filter != Image::NormalFilter_None)) {
+    std::cout << "Error: '-p' can't be used with '-b' and '-n'." << std::endl;
+    return false;
+  }
+
+  options.infilename = infilename;
+  options.outfilename = outfilename;
+  options.outputFormat = outputFormat;
+  options.maxLevel = maxLevel;
+  options.flipY = flipY;
+  options.alphaLayout = alphaLayout;
+  options.transparentMode = transparentMode;
+  options.bandBlockRows = bandBlockRows;
+  options.normalMap = normalMap;
+  options.threadCount = threadCount;
+  options.mipFilter = mipFilter;
+  options.resizeToPowerOfTwo = resizeToPowerOfTwo;
+  options.encoder = encoder ? encoder : &Encoder::get_default();
+  options.preview = preview;
+  options.maskfilename = maskfilename;
+  options.srgb = srgb;
+  return true;
+}
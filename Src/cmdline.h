@@ -0,0 +1,14 @@
+/**
+  @file cmdline.h
+
+  Parse the command line options of the conversion.
+*/
+#ifndef CMDLINE_H_INCLUDED
+#define CMDLINE_H_INCLUDED
+#include "convert.h"
+#include <string>
+#include <vector>
+
+bool ParseConvertOptions(int argc, char** argv, ConvertOptions& options, std::vector<std::string>* pFilenames = nullptr);
+
+#endif // CMDLINE_H_INCLUDED
@@ -0,0 +1,218 @@
+/**
+  @file compare.cpp
+*/
+#include "compare.h"
+#include "convert.h"
+#include "encoder.h"
+#include "format.h"
+#include "parallel.h"
+#include "pngfile.h"
+#include "srgb.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+namespace /* unnamed */ {
+
+/** The error of the decoded image.
+*/
+struct Error {
+  double colorPsnr; ///< PSNR of RGB in dB.
+  double alphaPsnr; ///< PSNR of the alpha in dB.
+};
+
+/** Convert the mean squared error to PSNR.
+
+  @param mse   the mean squared error.
+  @param peak  the maximum value of the channel.
+
+  @return PSNR in dB. if mse is 0, infinity.
+*/
+double GetPsnr(double mse, double peak) {
+  return mse > 0 ? 10.0 * std::log10(peak * peak / mse) : INFINITY;
+}
+
+/** Measure the error of the decoded image.
+
+  @param src      the source image. bytesPerPixel is 3 or 4.
+  @param decoded  the decoded image. bytesPerPixel is 4.
+  @param srgb     if true, the color is compared by 16bit linear values.
+*/
+Error MeasureError(const Image::Bitmap& src, const Image::Bitmap& decoded, bool srgb) {
+  uint64_t colorSum = 0;
+  uint64_t alphaSum = 0;
+  for (uint32_t y = 0; y < src.height; ++y) {
+    const uint8_t* p = src.row(y);
+    const uint8_t* q = decoded.row(y);
+    for (uint32_t x = 0; x < src.width; ++x, p += src.bytesPerPixel, q += 4) {
+      for (int c = 0; c < 3; ++c) {
+        const int64_t d = srgb ? static_cast<int64_t>(Image::srgb_to_linear(p[c])) - Image::srgb_to_linear(q[c]) : p[c] - q[c];
+        colorSum += d * d;
+      }
+      const int d = (src.bytesPerPixel == 4 ? p[3] : 255) - q[3];
+      alphaSum += d * d;
+    }
+  }
+  const double pixelCount = static_cast<double>(src.width) * src.height;
+  return { GetPsnr(colorSum / (pixelCount * 3), srgb ? 65535.0 : 255.0), GetPsnr(alphaSum / pixelCount, 255.0) };
+}
+
+/** Compress the image by the encoder.
+
+  The block rows are split into the threads.
+
+  @return the elapsed time in seconds. if the encoder fails, negative value.
+*/
+double EncodeParallel(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t format, uint32_t threadCount, std::vector<uint8_t>& out) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(format);
+  const uint32_t blockRows = (image.height + traits.blockHeight - 1) / traits.blockHeight;
+  const uint32_t rowSize = TextureFormat::get_image_size(traits, image.width, 1);
+  out.resize(static_cast<size_t>(rowSize) * blockRows);
+  std::atomic<bool> isSuccess(true);
+  const auto start = std::chrono::steady_clock::now();
+  Parallel::for_range(blockRows, threadCount, [&](uint32_t begin, uint32_t end) {
+    Image::Bitmap strip = image;
+    strip.bits = image.row(begin * traits.blockHeight);
+    strip.height = std::min(end * traits.blockHeight, image.height) - begin * traits.blockHeight;
+    if (!EncodeImage(encoder, strip, format, out.data() + static_cast<size_t>(begin) * rowSize, (end - begin) * rowSize)) {
+      isSuccess = false;
+    }
+  });
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return isSuccess ? seconds : -1.0;
+}
+
+/** Print PSNR.
+*/
+void PrintPsnr(double psnr) {
+  if (std::isinf(psnr)) {
+    std::cout << std::setw(11) << "inf";
+  } else {
+    std::cout << std::setw(11) << psnr;
+  }
+}
+
+} // unnamed namespace
+
+/** Encode the files by each encoder, and print the time and PSNR.
+
+  usage: --compare[=name,...] [-f format] [-j count] [-r count] [--srgb] [-l listfile] [file...]
+
+  The output is decoded by the reference decoder, so the error of the
+  decoder isn't included in PSNR. With --srgb, PSNR of RGB is measured by
+  the linear values.
+
+  @param encoderNames  the comma separated names of the encoders. if it is
+                       empty, all encoders that are built in.
+  @param argc          the number of arguments after the option.
+  @param argv          the arguments after the option.
+
+  @return the exit code. 0 if all encoders succeeded, otherwise 1.
+*/
+int RunCompare(const char* encoderNames, int argc, char** argv) {
+  std::vector<const Encoder::IBlockEncoder*> encoders;
+  for (const char* p = encoderNames; *p; ) {
+    const char* end = strchr(p, ',');
+    const std::string name = end ? std::string(p, end) : std::string(p);
+    const Encoder::IBlockEncoder* pEncoder = Encoder::find(name.c_str());
+    if (!pEncoder) {
+      std::cout << "Error: '" << name << "' is unknown encoder or isn't built in." << std::endl;
+      return 1;
+    }
+    encoders.push_back(pEncoder);
+    p = end ? end + 1 : p + name.size();
+  }
+  if (encoders.empty()) {
+    for (size_t i = 0; i < Encoder::get_count(); ++i) {
+      encoders.push_back(&Encoder::get(i));
+    }
+  }
+
+  std::vector<std::string> filenames;
+  uint32_t outputFormat = Q_FORMAT_UNKNOWN;
+  uint32_t threadCount = 0;
+  uint32_t repeatCount = 3;
+  bool srgb = false;
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      const TextureFormat::Traits* pTraits = TextureFormat::find_by_name(argv[++i]);
+      if (!pTraits || !pTraits->isCompressed) {
+        std::cout << "Error: '" << argv[i] << "' is unknown format." << std::endl;
+        return 1;
+      }
+      outputFormat = pTraits->qformat;
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      threadCount = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      repeatCount = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--srgb") == 0) {
+      srgb = true;
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      if (!ReadFileList(argv[++i], filenames)) {
+        std::cout << "Error: can't read '" << argv[i] << "'." << std::endl;
+        return 1;
+      }
+    } else {
+      filenames.push_back(argv[i]);
+    }
+  }
+  threadCount = Parallel::get_thread_count(threadCount);
+
+  int exitCode = 0;
+  for (const auto& filename : filenames) {
+    Image::PngFile png;
+    if (!png.load(filename)) {
+      std::cout << "Error: can't read '" << filename << "'." << std::endl;
+      exitCode = 1;
+      continue;
+    }
+    const Image::Bitmap image = png.get_bitmap(false);
+    uint32_t format = outputFormat;
+    if (format == Q_FORMAT_UNKNOWN) {
+      format = image.bytesPerPixel == 4 ? Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA : Q_FORMAT_ETC1_RGB8;
+    }
+    const TextureFormat::Traits& traits = *TextureFormat::find(format);
+    std::cout << filename << " " << image.width << "x" << image.height << " " << traits.name << " by " << threadCount << " thread(s)" << std::endl;
+    std::cout << std::left << std::setw(10) << "encoder" << std::right << std::setw(12) << "time(ms)" <<
+      std::setw(11) << "MPixel/s" << std::setw(11) << (srgb ? "PSNR(lin)" : "PSNR(RGB)") << std::setw(11) << "PSNR(A)" << std::endl;
+
+    std::vector<uint8_t> decodedBuffer(static_cast<size_t>(image.width) * image.height * 4);
+    const Image::Bitmap decoded = Image::make_bitmap(decodedBuffer.data(), image.width, image.height, 4);
+    std::vector<uint8_t> out;
+    for (const Encoder::IBlockEncoder* pEncoder : encoders) {
+      std::cout << std::left << std::setw(10) << pEncoder->name() << std::right;
+      if (!(pEncoder->get_capabilities(format) & Encoder::Capability_Encode)) {
+        std::cout << " can't encode " << traits.name << "." << std::endl;
+        continue;
+      }
+      double seconds = INFINITY;
+      for (uint32_t n = 0; n < repeatCount && seconds >= 0; ++n) {
+        const double t = EncodeParallel(*pEncoder, image, format, threadCount, out);
+        seconds = t < 0 ? t : std::min(seconds, t);
+      }
+      if (seconds < 0 || !Encoder::get_reference().decode(out.data(), static_cast<uint32_t>(out.size()), format, decoded)) {
+        std::cout << " failed." << std::endl;
+        exitCode = 1;
+        continue;
+      }
+      const Error error = MeasureError(image, decoded, srgb);
+      std::cout << std::fixed << std::setprecision(3) << std::setw(12) << seconds * 1000.0 <<
+        std::setprecision(2) << std::setw(11) << image.width * image.height / std::max(seconds, 1e-9) / 1000000.0;
+      PrintPsnr(error.colorPsnr);
+      if (traits.hasAlpha) {
+        PrintPsnr(error.alphaPsnr);
+      } else {
+        std::cout << std::setw(11) << "-";
+      }
+      std::cout << std::defaultfloat << std::endl;
+    }
+  }
+  return exitCode;
+}
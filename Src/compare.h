@@ -0,0 +1,11 @@
+/**
+  @file compare.h
+
+  Compare the speed and the quality of the encoders.
+*/
+#ifndef COMPARE_H_INCLUDED
+#define COMPARE_H_INCLUDED
+
+int RunCompare(const char* encoderNames, int argc, char** argv);
+
+#endif // COMPARE_H_INCLUDED
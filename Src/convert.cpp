@@ -0,0 +1,1205 @@
+/**
+  @file convert.cpp
+*/
+#include "convert.h"
+#include "arena.h"
+#include "format.h"
+#include "analyze.h"
+#include "stream.h"
+#include "parallel.h"
+#include "pngfile.h"
+#include "encoder.h"
+#include <TextureConverter.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+/** Get bytes per pixel from the format.
+
+  @param format Q_FORMAT_??? of the uncompressed format.
+
+  @return byte per pixel.
+*/
+uint32_t GetBytePerPixel(uint32_t format) {
+  const TextureFormat::Traits* p = TextureFormat::find(format);
+  return p && !p->isCompressed ? p->bytesPerBlock : 4;
+}
+
+/** Get the number of mip levels.
+
+  @param w         the pixel width of the top level image.
+  @param h         the pixel height of the top level image.
+  @param maxLevel  the maximum number of mip levels.
+
+  @return the number of mip levels. the chain ends at 1x1 image or maxLevel.
+*/
+uint32_t GetMipLevelCount(uint32_t w, uint32_t h, uint32_t maxLevel) {
+  uint32_t level = 1;
+  while (level < maxLevel && (w > 1 || h > 1)) {
+    w = std::max(w / 2, 1U);
+    h = std::max(h / 2, 1U);
+    ++level;
+  }
+  return level;
+}
+
+/** Estimate the time to convert the image.
+
+  The cost is the number of the blocks of all levels that is weighted by the
+  time per block of the format, plus the time to read the top level. The
+  weights are measured with the native encoder, and only the ratio between
+  the costs of the files is meaningful.
+
+  @param width         the pixel width of the image.
+  @param height        the pixel height of the image.
+  @param outputFormat  Q_FORMAT_??? of the output.
+  @param maxLevel      the maximum number of mip levels.
+
+  @return the cost in the unit of reading 16 pixels.
+*/
+uint64_t EstimateConvertCost(uint32_t width, uint32_t height, uint32_t outputFormat, uint32_t maxLevel) {
+  uint64_t weight;
+  switch (outputFormat) {
+  case Q_FORMAT_ETC1_RGB8: weight = 8; break;
+  case Q_FORMAT_ATC_RGBA_EXPLICIT_ALPHA: weight = 3; break;
+  default: weight = 4; break;
+  }
+  uint64_t cost = (static_cast<uint64_t>(width) * height + 15) / 16;
+  const uint32_t levelCount = GetMipLevelCount(width, height, maxLevel);
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    cost += static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * weight;
+    width = std::max(width / 2, 1U);
+    height = std::max(height / 2, 1U);
+  }
+  return cost;
+}
+
+/** The levels whose width and height are less than this size are encoded at once.
+*/
+static const uint32_t tailLevelSize = 16;
+
+/** The minimum number of the block rows in a band of EncodeImageBands().
+*/
+static const uint32_t minBandBlockRows = 8;
+
+/** Check whether the rest of the mip chain is encoded at once from this level.
+*/
+bool IsTailLevel(uint32_t width, uint32_t height) {
+  return width < tailLevelSize && height < tailLevelSize;
+}
+
+/** Get the pixel height of the atlas of the tail levels.
+
+  @param height      the pixel height of the first tail level.
+  @param levelCount  the number of the tail levels.
+  @param traits      the traits of the compressed format.
+
+  @return the sum of the level heights that are rounded up to the block.
+*/
+uint32_t GetTailAtlasHeight(uint32_t height, uint32_t levelCount, const TextureFormat::Traits& traits) {
+  uint32_t atlasHeight = 0;
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    atlasHeight += (height + traits.blockHeight - 1) / traits.blockHeight * traits.blockHeight;
+    height = std::max(height / 2, 1U);
+  }
+  return atlasHeight;
+}
+
+/** Get the arena size that is used by EncodeMipChain().
+
+  @param image        the top level image.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param maxLevel     the maximum number of mip levels.
+  @param filter       the filter to make the mipmaps.
+  @param srgb         true if the mipmaps are made in the linear space.
+
+  @return the byte size of the arena to encode the whole mip chain.
+*/
+size_t GetMipChainArenaSize(const Image::Bitmap& image, uint32_t outputFormat, uint32_t maxLevel, Image::Filter filter, bool srgb) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t levelCount = GetMipLevelCount(image.width, image.height, maxLevel);
+  size_t size = 0;
+  if (levelCount > 1) {
+    size += Arena::aligned_size(Image::get_mip_work_size(image.width, image.height, image.bytesPerPixel, filter, srgb));
+  }
+  uint32_t width = image.width;
+  uint32_t height = image.height;
+  bool hasTail = false;
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    size += Arena::aligned_size(TextureFormat::get_image_size(traits, width, height));
+    if (!hasTail && levelCount - level > 1 && IsTailLevel(width, height)) {
+      // The atlas of the tail levels and its compressed image.
+      const uint32_t atlasWidth = (width + traits.blockWidth - 1) / traits.blockWidth * traits.blockWidth;
+      const uint32_t atlasHeight = GetTailAtlasHeight(height, levelCount - level, traits);
+      size += Arena::aligned_size(Image::get_size(atlasWidth, atlasHeight, image.bytesPerPixel));
+      size += Arena::aligned_size(TextureFormat::get_image_size(traits, atlasWidth, atlasHeight));
+      hasTail = true;
+    }
+    // The level 1 and 2 images are the ping-pong buffers for the rest of levels.
+    if (level == 1 || level == 2) {
+      size += Arena::aligned_size(Image::get_size(width, height, image.bytesPerPixel));
+    }
+    width = std::max(width / 2, 1U);
+    height = std::max(height / 2, 1U);
+  }
+  return size;
+}
+
+/** Compress the image.
+
+  The size of the image needn't be the multiple of the block. The aligned
+  part is compressed from the image as is, and the partial blocks at the
+  right and the bottom edges are fetched with the edge pixels clamped. So the
+  result doesn't depend on the edge handling of the encoder, and the image isn't
+  copied to the padded image.
+
+  @param encoder      the encoder of the blocks.
+  @param image        the source image.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param pOut         the buffer to store the compressed image.
+  @param outSize      the byte size of pOut. it should be the size that is
+                      calculated by TextureFormat::get_image_size().
+  @param pImportance  the importance of each block for the encoder. its size
+                      is the number of the blocks. if it is nullptr, all
+                      blocks are encoded by the full effort.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeImage(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, uint8_t* pOut, uint32_t outSize, const Image::Bitmap* pImportance) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t blockSize = traits.bytesPerBlock;
+  const uint32_t innerCols = image.width / traits.blockWidth;
+  const uint32_t innerRows = image.height / traits.blockHeight;
+  const uint32_t cols = (image.width + traits.blockWidth - 1) / traits.blockWidth;
+  const uint32_t rows = (image.height + traits.blockHeight - 1) / traits.blockHeight;
+  if (innerCols == cols && innerRows == rows) {
+    return Encoder::encode(encoder, image, outputFormat, pImportance, pOut, outSize);
+  }
+
+  // The views of the importance of the inner part and the edge strips.
+  Image::Bitmap innerImportance, rightImportance, bottomImportance;
+  if (pImportance) {
+    innerImportance = *pImportance;
+    innerImportance.width = innerCols;
+    innerImportance.height = innerRows;
+    rightImportance = *pImportance;
+    rightImportance.bits = pImportance->bits + innerCols;
+    rightImportance.width = 1;
+    rightImportance.height = rows;
+    bottomImportance = *pImportance;
+    bottomImportance.bits = pImportance->row(innerRows);
+    bottomImportance.width = innerCols;
+    bottomImportance.height = 1;
+  }
+
+  if (innerCols && innerRows) {
+    Image::Bitmap inner = image;
+    inner.width = innerCols * traits.blockWidth;
+    inner.height = innerRows * traits.blockHeight;
+    if (!Encoder::encode(encoder, inner, outputFormat, pImportance ? &innerImportance : nullptr, pOut, innerCols * innerRows * blockSize)) {
+      return false;
+    }
+    // Make the room for the right edge blocks from the last row.
+    if (cols > innerCols) {
+      for (uint32_t r = innerRows; r-- > 1; ) {
+        memmove(pOut + r * cols * blockSize, pOut + r * innerCols * blockSize, innerCols * blockSize);
+      }
+    }
+  }
+
+  std::vector<uint8_t> buffer;
+  if (cols > innerCols) {
+    // The right edge blocks include the bottom right corner.
+    Image::Bitmap strip = Image::make_bitmap(nullptr, traits.blockWidth, rows * traits.blockHeight, image.bytesPerPixel);
+    const size_t stripSize = Image::get_size(strip.width, strip.height, strip.bytesPerPixel);
+    buffer.resize(stripSize + rows * blockSize);
+    strip.bits = buffer.data();
+    Image::fetch_clamped(image, innerCols * traits.blockWidth, 0, strip);
+    uint8_t* pEdge = buffer.data() + stripSize;
+    if (!Encoder::encode(encoder, strip, outputFormat, pImportance ? &rightImportance : nullptr, pEdge, rows * blockSize)) {
+      return false;
+    }
+    for (uint32_t r = 0; r < rows; ++r) {
+      memcpy(pOut + (r * cols + innerCols) * blockSize, pEdge + r * blockSize, blockSize);
+    }
+  }
+  if (rows > innerRows && innerCols) {
+    // The bottom edge blocks are contiguous in the output.
+    Image::Bitmap strip = Image::make_bitmap(nullptr, innerCols * traits.blockWidth, traits.blockHeight, image.bytesPerPixel);
+    buffer.resize(Image::get_size(strip.width, strip.height, strip.bytesPerPixel));
+    strip.bits = buffer.data();
+    Image::fetch_clamped(image, 0, innerRows * traits.blockHeight, strip);
+    if (!Encoder::encode(encoder, strip, outputFormat, pImportance ? &bottomImportance : nullptr, pOut + innerRows * cols * blockSize, innerCols * blockSize)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Compress the bands of the block rows concurrently.
+
+  The image is split into the bands that are aligned to the block, and each
+  band is encoded as the separate image. The blocks are independent of each
+  other, so the result is same as the whole image for any number of bands.
+  The small image is encoded at once, because the threads cost more than
+  they save.
+
+  @param encoder      the encoder of the blocks.
+  @param image        the source image.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param pOut         the buffer to store the compressed image.
+  @param outSize      the byte size of pOut.
+  @param pImportance  the importance of each block. it may be nullptr.
+  @param threadCount  the maximum number of the bands.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeImageBands(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, uint8_t* pOut, uint32_t outSize, const Image::Bitmap* pImportance, uint32_t threadCount) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t rows = (image.height + traits.blockHeight - 1) / traits.blockHeight;
+  const uint32_t bandCount = std::min(threadCount, rows / minBandBlockRows);
+  if (bandCount <= 1) {
+    return EncodeImage(encoder, image, outputFormat, pOut, outSize, pImportance);
+  }
+  const uint32_t rowSize = TextureFormat::get_image_size(traits, image.width, traits.blockHeight);
+  std::atomic<bool> isFailed(false);
+  Parallel::for_range(rows, bandCount, [&](uint32_t begin, uint32_t end) {
+    Image::Bitmap band = image;
+    band.bits = image.row(begin * traits.blockHeight);
+    band.height = std::min(end * traits.blockHeight, image.height) - begin * traits.blockHeight;
+    Image::Bitmap bandImportance;
+    if (pImportance) {
+      bandImportance = *pImportance;
+      bandImportance.bits = pImportance->row(begin);
+      bandImportance.height = end - begin;
+    }
+    if (!EncodeImage(encoder, band, outputFormat, pOut + begin * rowSize, (end - begin) * rowSize, pImportance ? &bandImportance : nullptr)) {
+      isFailed = true;
+    }
+  });
+  return !isFailed;
+}
+
+/** Compress the small levels at the tail of the mip chain at once.
+
+  The levels are made in the small buffer, and are stacked in one atlas.
+  Each level is padded to the block with its edge pixels clamped, so the
+  blocks are same as the blocks that are compressed level by level. The
+  atlas is compressed by one call, and its blocks are copied to each level.
+
+  @param encoder      the encoder of the blocks.
+  @param image        the first tail level. its width and height should be
+                      less than tailLevelSize.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param firstLevel   the mip level of image.
+  @param filter       the filter to make the mipmaps.
+  @param srgb         if true, the mipmaps are made in the linear space.
+  @param pWork        the work memory for Image::make_mip().
+  @param arena        the arena to allocate the atlas and the compressed images.
+  @param ktx          the KTX file to store the compressed images. its header
+                      and data should be initialized by EncodeMipChain().
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeTailMipChain(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, uint32_t firstLevel, Image::Filter filter, bool srgb, uint8_t* pWork, Arena& arena, KTX::File& ktx) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t bpp = image.bytesPerPixel;
+  const uint32_t levelCount = static_cast<uint32_t>(ktx.data.size()) - firstLevel;
+  const uint32_t atlasWidth = (image.width + traits.blockWidth - 1) / traits.blockWidth * traits.blockWidth;
+  const uint32_t atlasHeight = GetTailAtlasHeight(image.height, levelCount, traits);
+  const Image::Bitmap atlas = Image::make_bitmap(arena.allocate(Image::get_size(atlasWidth, atlasHeight, bpp)), atlasWidth, atlasHeight, bpp);
+  const uint32_t atlasSize = TextureFormat::get_image_size(traits, atlasWidth, atlasHeight);
+  uint8_t* pAtlasOut = arena.allocate_array<uint8_t>(atlasSize);
+  if (!atlas.bits || !pAtlasOut) {
+    return false;
+  }
+
+  // The levels below the first are 7x7 at most.
+  uint8_t pixels[2][(tailLevelSize / 2) * (tailLevelSize / 2) * 4];
+  uint32_t top[32];
+  Image::Bitmap current = image;
+  for (uint32_t level = 0, y = 0; ; ) {
+    const uint32_t cols = (current.width + traits.blockWidth - 1) / traits.blockWidth;
+    const uint32_t rows = (current.height + traits.blockHeight - 1) / traits.blockHeight;
+    Image::Bitmap area = atlas;
+    area.bits = atlas.row(y);
+    area.width = cols * traits.blockWidth;
+    area.height = rows * traits.blockHeight;
+    Image::fetch_clamped(current, 0, 0, area);
+    top[level] = y / traits.blockHeight;
+    y += area.height;
+    if (++level >= levelCount) {
+      break;
+    }
+    const Image::Bitmap next = Image::make_bitmap(pixels[level & 1], std::max(current.width / 2, 1U), std::max(current.height / 2, 1U), bpp);
+    Image::make_mip(current, next, filter, srgb, pWork, 1);
+    current = next;
+  }
+  if (!EncodeImage(encoder, atlas, outputFormat, pAtlasOut, atlasSize)) {
+    return false;
+  }
+
+  const uint32_t atlasCols = atlasWidth / traits.blockWidth;
+  uint32_t width = image.width;
+  uint32_t height = image.height;
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const uint32_t cols = (width + traits.blockWidth - 1) / traits.blockWidth;
+    const uint32_t rows = (height + traits.blockHeight - 1) / traits.blockHeight;
+    const uint32_t imageSize = TextureFormat::get_image_size(traits, width, height);
+    uint8_t* pOut = arena.allocate_array<uint8_t>(imageSize);
+    if (!pOut) {
+      return false;
+    }
+    for (uint32_t r = 0; r < rows; ++r) {
+      memcpy(pOut + r * cols * traits.bytesPerBlock, pAtlasOut + (top[level] + r) * atlasCols * traits.bytesPerBlock, cols * traits.bytesPerBlock);
+    }
+    ktx.data[firstLevel + level].imageSize = imageSize;
+    ktx.data[firstLevel + level].pBorrowed = pOut;
+    width = std::max(width / 2, 1U);
+    height = std::max(height / 2, 1U);
+  }
+  return true;
+}
+
+/** Compress the image and its mipmaps.
+
+  @param encoder      the encoder of the blocks.
+  @param image        the top level image.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param maxLevel     the maximum number of mip levels.
+  @param filter       the filter to make the mipmaps.
+  @param srgb         if true, the color of the image is sRGB, and the
+                      mipmaps are made in the linear space.
+  @param threadCount  the maximum number of threads to make the mipmaps.
+                      the large level is also split into the bands of the
+                      block rows for the threads.
+  @param arena        the arena to allocate the compressed images and the
+                      mipmap images. it should have the space of
+                      GetMipChainArenaSize() at least.
+  @param ktx          the KTX file to store the compressed images. its data
+                      refer to the memory in the arena.
+  @param pMask        the mask image that is stretched to each level as the
+                      importance of the blocks. the small levels at the tail
+                      are encoded by the full effort. if it is nullptr, all
+                      levels are encoded by the full effort.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeMipChain(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, uint32_t maxLevel, Image::Filter filter, bool srgb, uint32_t threadCount, Arena& arena, KTX::File& ktx, const Image::Bitmap* pMask) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t levelCount = GetMipLevelCount(image.width, image.height, maxLevel);
+  KTX::initialize(&ktx.header, image.width, image.height, traits.glInternalFormat, traits.glBaseInternalFormat);
+  ktx.header.numberOfMipmapLevels = levelCount;
+  ktx.data.resize(levelCount);
+
+  // The work memory for the level 1 is large enough for all levels.
+  uint8_t* pWork = nullptr;
+  if (levelCount > 1) {
+    const size_t workSize = Image::get_mip_work_size(image.width, image.height, image.bytesPerPixel, filter, srgb);
+    pWork = arena.allocate_array<uint8_t>(workSize);
+    if (workSize && !pWork) {
+      return false;
+    }
+  }
+
+  Image::Bitmap scratch[2];
+  Image::Bitmap current = image;
+  std::vector<uint8_t> importanceBuffer;
+  for (uint32_t level = 0; ; ) {
+    // The small levels pay the call overhead rather than the compression, so
+    // they are compressed at once.
+    if (levelCount - level > 1 && IsTailLevel(current.width, current.height)) {
+      return EncodeTailMipChain(encoder, current, outputFormat, level, filter, srgb, pWork, arena, ktx);
+    }
+    const uint32_t imageSize = TextureFormat::get_image_size(traits, current.width, current.height);
+    uint8_t* pOut = arena.allocate_array<uint8_t>(imageSize);
+    if (!pOut) {
+      return false;
+    }
+    Image::Bitmap importance;
+    if (pMask) {
+      const uint32_t cols = (current.width + traits.blockWidth - 1) / traits.blockWidth;
+      const uint32_t rows = (current.height + traits.blockHeight - 1) / traits.blockHeight;
+      importanceBuffer.resize(Image::get_size(cols, rows, 1));
+      importance = Image::make_bitmap(importanceBuffer.data(), cols, rows, 1);
+      Image::make_importance_map(*pMask, importance);
+    }
+    const Image::Bitmap* pImportance = pMask ? &importance : nullptr;
+    if (!EncodeImageBands(encoder, current, outputFormat, pOut, imageSize, pImportance, threadCount)) {
+      return false;
+    }
+    ktx.data[level].imageSize = imageSize;
+    ktx.data[level].pBorrowed = pOut;
+    if (++level >= levelCount) {
+      break;
+    }
+    const uint32_t width = std::max(current.width / 2, 1U);
+    const uint32_t height = std::max(current.height / 2, 1U);
+    Image::Bitmap& next = scratch[level & 1];
+    if (level <= 2) {
+      void* p = arena.allocate(Image::get_size(width, height, image.bytesPerPixel));
+      if (!p) {
+        return false;
+      }
+      next = Image::make_bitmap(p, width, height, image.bytesPerPixel);
+    } else {
+      // The buffer of 2 levels above is large enough for this level.
+      next = Image::make_bitmap(next.bits, width, height, image.bytesPerPixel);
+    }
+    Image::make_mip(current, next, filter, srgb, pWork, threadCount);
+    current = next;
+  }
+  return true;
+}
+
+/** Compress the image filled with one color and its mipmaps.
+
+  All blocks of all levels are same, so only one block is compressed and it
+  is copied to the others.
+
+  @param encoder      the encoder of the blocks.
+  @param image        the top level image. its all pixels should be same.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param maxLevel     the maximum number of mip levels.
+  @param arena        the arena to allocate the compressed images. it should
+                      have the space of GetMipChainArenaSize() at least.
+  @param ktx          the KTX file to store the compressed images. its data
+                      refer to the memory in the arena.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeSolidMipChain(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, uint32_t maxLevel, Arena& arena, KTX::File& ktx) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t levelCount = GetMipLevelCount(image.width, image.height, maxLevel);
+  KTX::initialize(&ktx.header, image.width, image.height, traits.glInternalFormat, traits.glBaseInternalFormat);
+  ktx.header.numberOfMipmapLevels = levelCount;
+  ktx.data.resize(levelCount);
+
+  const uint32_t bpp = image.bytesPerPixel;
+  uint8_t pixels[4 * 4 * 4];
+  for (uint32_t i = 0; i < 4 * 4; ++i) {
+    memcpy(pixels + i * bpp, image.row(0), bpp);
+  }
+  uint8_t block[16];
+  if (!EncodeImage(encoder, Image::make_bitmap(pixels, 4, 4, bpp), outputFormat, block, traits.bytesPerBlock)) {
+    return false;
+  }
+
+  uint32_t width = image.width;
+  uint32_t height = image.height;
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const uint32_t imageSize = TextureFormat::get_image_size(traits, width, height);
+    uint8_t* pOut = arena.allocate_array<uint8_t>(imageSize);
+    if (!pOut) {
+      return false;
+    }
+    for (uint32_t offset = 0; offset < imageSize; offset += traits.bytesPerBlock) {
+      memcpy(pOut + offset, block, traits.bytesPerBlock);
+    }
+    ktx.data[level].imageSize = imageSize;
+    ktx.data[level].pBorrowed = pOut;
+    width = std::max(width / 2, 1U);
+    height = std::max(height / 2, 1U);
+  }
+  return true;
+}
+
+/** Select the cheapest format that can represent the image.
+
+  @param analysis  the result of Image::analyze().
+
+  @return Q_FORMAT_??? of the compressed image.
+*/
+uint32_t SelectOutputFormat(const Image::Analysis& analysis) {
+  switch (analysis.alphaType) {
+  case Image::AlphaType_None: return Q_FORMAT_ETC1_RGB8;
+  // The explicit alpha keeps 0 and 255 exactly without the endpoint search.
+  case Image::AlphaType_OneBit: return Q_FORMAT_ATC_RGBA_EXPLICIT_ALPHA;
+  default:
+  case Image::AlphaType_Smooth: return Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA;
+  }
+}
+
+/** Get the file name of the alpha texture.
+
+  @param filename  the file name of the color texture.
+
+  @return filename that has "_alpha" before the extension.
+*/
+std::string GetAlphaFileName(const std::string& filename) {
+  const size_t dotPos = filename.find_last_of('.');
+  const size_t separatorPos = filename.find_last_of("/\\");
+  if (dotPos == std::string::npos || (separatorPos != std::string::npos && dotPos < separatorPos)) {
+    return filename + "_alpha";
+  }
+  return filename.substr(0, dotPos) + "_alpha" + filename.substr(dotPos);
+}
+
+/** Get the default output file path.
+
+  @param infilename  the input file path.
+
+  @return infilename whose extension is replaced to '.ktx'.
+*/
+std::string GetOutputFileName(const std::string& infilename) {
+  std::string outfilename = infilename;
+  auto dotPos = outfilename.find_last_of('.');
+  if (dotPos != std::string::npos) {
+    outfilename.erase(dotPos, std::string::npos);
+  }
+  return outfilename + ".ktx";
+}
+
+/** Read the list of the file paths.
+
+  @param listfile   the text file that has a path per line. the empty lines
+                    are skipped.
+  @param filenames  the list to append the paths.
+
+  @retval true  success.
+  @retval false listfile can't be read.
+*/
+bool ReadFileList(const std::string& listfile, std::vector<std::string>& filenames) {
+  std::ifstream ifs(listfile.c_str());
+  if (!ifs) {
+    return false;
+  }
+  for (std::string line; std::getline(ifs, line); ) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (!line.empty()) {
+      filenames.push_back(line);
+    }
+  }
+  return true;
+}
+
+/** Get the file name without the directory.
+*/
+std::string GetBaseName(const std::string& filename) {
+  const size_t separatorPos = filename.find_last_of("/\\");
+  return separatorPos == std::string::npos ? filename : filename.substr(separatorPos + 1);
+}
+
+/** Encode the color and the alpha as two ETC1 textures.
+
+  The alpha texture is encoded on the other thread with the part of the arena.
+
+  @param image     the top level image.
+  @param options   the conversion parameters.
+  @param pMask     the mask image for the importance of the blocks. it may be
+                   nullptr.
+  @param isSolid   true if all pixels of the image are same.
+  @param arena     the arena for the working memory. it should have the
+                   space of GetArenaSize() at least.
+  @param ktx       the KTX file to store the color texture.
+  @param alphaKtx  the KTX file to store the alpha texture.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeSeparateAlpha(const Image::Bitmap& image, const ConvertOptions& options, const Image::Bitmap* pMask, bool isSolid, Arena& arena, KTX::File& ktx, KTX::File& alphaKtx) {
+  const uint32_t format = Q_FORMAT_ETC1_RGB8;
+  const size_t alphaImageSize = Image::get_size(image.width, image.height, 3);
+  Image::Bitmap alphaImage = Image::make_bitmap(nullptr, image.width, image.height, 3);
+  const size_t alphaArenaSize = GetMipChainArenaSize(alphaImage, format, options.maxLevel, options.mipFilter, false);
+  alphaImage.bits = arena.allocate_array<uint8_t>(alphaImageSize);
+  Arena alphaArena;
+  alphaArena.assign(arena.allocate(alphaArenaSize), alphaArenaSize);
+  if (!alphaImage.bits) {
+    return false;
+  }
+  Image::extract_alpha(image, alphaImage);
+
+  if (isSolid) {
+    return EncodeSolidMipChain(*options.encoder, image, format, options.maxLevel, arena, ktx) &&
+      EncodeSolidMipChain(*options.encoder, alphaImage, format, options.maxLevel, alphaArena, alphaKtx);
+  }
+  // The threads for the filter are shared by the color and the alpha.
+  const uint32_t threadCount = std::max(Parallel::get_thread_count(options.threadCount) / 2, 1U);
+  bool alphaResult = false;
+  std::thread alphaThread([&]() {
+    alphaResult = EncodeMipChain(*options.encoder, alphaImage, format, options.maxLevel, options.mipFilter, false, threadCount, alphaArena, alphaKtx, pMask);
+  });
+  const bool colorResult = EncodeMipChain(*options.encoder, image, format, options.maxLevel, options.mipFilter, options.srgb, threadCount, arena, ktx, pMask);
+  alphaThread.join();
+  return colorResult && alphaResult;
+}
+
+/** Encode the color and the alpha as one double height ETC1 texture.
+
+  The color is in the upper half, and the alpha is in the lower half.
+
+  @param image     the top level image.
+  @param options   the conversion parameters.
+  @param arena     the arena for the working memory. it should have the
+                   space of GetArenaSize() at least.
+  @param ktx       the KTX file to store the texture.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeStackedAlpha(const Image::Bitmap& image, const ConvertOptions& options, Arena& arena, KTX::File& ktx) {
+  const uint32_t format = Q_FORMAT_ETC1_RGB8;
+  const size_t stackedImageSize = Image::get_size(image.width, image.height * 2, 3);
+  Image::Bitmap stackedImage = Image::make_bitmap(nullptr, image.width, image.height * 2, 3);
+  stackedImage.bits = arena.allocate_array<uint8_t>(stackedImageSize);
+  if (!stackedImage.bits) {
+    return false;
+  }
+  Image::Bitmap upper = stackedImage;
+  upper.height = image.height;
+  Image::Bitmap lower = upper;
+  lower.bits = stackedImage.row(image.height);
+  Image::copy_color(image, upper);
+  Image::extract_alpha(image, lower);
+  // The filter wider than 2x2 mixes a few rows at the boundary of the halves,
+  // same as the texture sampling does.
+  const uint32_t threadCount = Parallel::get_thread_count(options.threadCount);
+  return EncodeMipChain(*options.encoder, stackedImage, format, options.maxLevel, options.mipFilter, false, threadCount, arena, ktx);
+}
+
+/** Get the arena size that is used by ConvertFile().
+
+  @param image         the top level image.
+  @param options       the conversion parameters.
+  @param outputFormat  Q_FORMAT_??? of the compressed image.
+
+  @return the byte size of the arena to convert the image.
+*/
+size_t GetArenaSize(const Image::Bitmap& image, const ConvertOptions& options, uint32_t outputFormat) {
+  size_t size = 0;
+  switch (options.alphaLayout) {
+  case AlphaLayout_Separate: {
+    const Image::Bitmap alphaImage = Image::make_bitmap(nullptr, image.width, image.height, 3);
+    size += GetMipChainArenaSize(image, Q_FORMAT_ETC1_RGB8, options.maxLevel, options.mipFilter, options.srgb);
+    size += Arena::aligned_size(Image::get_size(alphaImage.width, alphaImage.height, 3));
+    size += Arena::aligned_size(GetMipChainArenaSize(alphaImage, Q_FORMAT_ETC1_RGB8, options.maxLevel, options.mipFilter, false));
+    break;
+  }
+  case AlphaLayout_Stacked: {
+    const Image::Bitmap stackedImage = Image::make_bitmap(nullptr, image.width, image.height * 2, 3);
+    size += Arena::aligned_size(Image::get_size(stackedImage.width, stackedImage.height, 3));
+    size += GetMipChainArenaSize(stackedImage, Q_FORMAT_ETC1_RGB8, options.maxLevel, options.mipFilter, false);
+    break;
+  }
+  default:
+  case AlphaLayout_None:
+    size += GetMipChainArenaSize(image, outputFormat, options.maxLevel, options.mipFilter, options.srgb);
+    break;
+  }
+  return size;
+}
+
+/** Get the nearest power of two.
+
+  The larger one is selected if n is just the middle.
+*/
+uint32_t GetNearestPowerOfTwo(uint32_t n) {
+  uint32_t p = 1;
+  while (p <= n / 2) {
+    p *= 2;
+  }
+  return n - p >= p * 2 - n ? p * 2 : p;
+}
+
+/** Resize the image to the power of two size with the mip filter.
+
+  The resized image is in the arena, so the space for the rest of the
+  conversion is reserved together. It is estimated by the largest format if
+  the format isn't passed, because the format is selected after the resize.
+
+  @param image    the top level image. it is replaced by the resized image.
+  @param options  the conversion parameters.
+  @param arena    the arena for the working memory. it should be empty.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool ResizeToPowerOfTwo(Image::Bitmap& image, const ConvertOptions& options, Arena& arena) {
+  const uint32_t width = GetNearestPowerOfTwo(image.width);
+  const uint32_t height = GetNearestPowerOfTwo(image.height);
+  if (width == image.width && height == image.height) {
+    return true;
+  }
+  const uint32_t bpp = image.bytesPerPixel;
+  Image::Bitmap resized = Image::make_bitmap(nullptr, width, height, bpp);
+  const uint32_t format = options.outputFormat != Q_FORMAT_UNKNOWN ? options.outputFormat : static_cast<uint32_t>(Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA);
+  const size_t imageSize = Image::get_size(width, height, bpp);
+  const size_t workSize = Image::get_resample_work_size(image.width, image.height, width, height, bpp, options.mipFilter, options.srgb);
+  arena.reserve(Arena::aligned_size(imageSize) + Arena::aligned_size(workSize) + GetArenaSize(resized, options, format));
+  resized.bits = arena.allocate_array<uint8_t>(imageSize);
+  uint8_t* pWork = arena.allocate_array<uint8_t>(workSize);
+  if (!resized.bits || !pWork) {
+    return false;
+  }
+  Image::resample(image, resized, options.mipFilter, options.srgb, pWork, Parallel::get_thread_count(options.threadCount));
+  image = resized;
+  return true;
+}
+
+/** The initial value of 64bit FNV-1a.
+*/
+static const uint64_t fnv1aOffsetBasis = 0xcbf29ce484222325ULL;
+
+/** Add the bytes to 64bit FNV-1a hash.
+*/
+uint64_t UpdateHash(uint64_t hash, const uint8_t* p, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ p[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/** Get the hash of the file.
+
+  The source is hashed by 64bit FNV-1a, so that the downstream cache can
+  validate the KTX file without reading the source again.
+
+  @param filename  the file path.
+  @param pHash     the pointer to store the hash.
+  @param pSize     the pointer to store the byte size of the file. if it is
+                   nullptr, the size isn't stored.
+
+  @retval true  success.
+  @retval false the file can't be read.
+*/
+bool GetFileHash(const std::string& filename, uint64_t* pHash, uint64_t* pSize) {
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs) {
+    return false;
+  }
+  uint64_t hash = fnv1aOffsetBasis;
+  uint64_t size = 0;
+  std::vector<char> buf(64 * 1024);
+  while (ifs) {
+    ifs.read(buf.data(), buf.size());
+    hash = UpdateHash(hash, reinterpret_cast<const uint8_t*>(buf.data()), static_cast<size_t>(ifs.gcount()));
+    size += static_cast<uint64_t>(ifs.gcount());
+  }
+  if (ifs.bad()) {
+    return false;
+  }
+  *pHash = hash;
+  if (pSize) {
+    *pSize = size;
+  }
+  return true;
+}
+
+/** Read the whole file.
+
+  @param filename  the file path.
+  @param data      the buffer to store the content of the file.
+
+  @retval true  success.
+  @retval false the file can't be read.
+*/
+bool ReadFileData(const std::string& filename, std::vector<uint8_t>& data) {
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+  if (!ifs) {
+    return false;
+  }
+  const std::streamoff size = ifs.tellg();
+  if (size < 0) {
+    return false;
+  }
+  data.resize(static_cast<size_t>(size));
+  ifs.seekg(0);
+  return ifs.read(reinterpret_cast<char*>(data.data()), size) || size == 0;
+}
+
+/** Get the text of the conversion parameters that affect the encoded image.
+
+  The file names and the thread count aren't included, because they don't
+  change the output.
+*/
+std::string GetSettingsText(const ConvertOptions& options) {
+  static const char* const alphaLayoutNames[] = { "none", "separate", "stacked" };
+  static const char* const transparentModeNames[] = { "none", "premultiply", "bleed" };
+  static const char* const normalFilterNames[] = { "none", "sobel", "prewitt" };
+  const TextureFormat::Traits* pTraits = TextureFormat::find(options.outputFormat);
+  std::ostringstream ss;
+  ss << "format=" << (pTraits ? pTraits->name : "auto") <<
+    " alpha=" << alphaLayoutNames[options.alphaLayout] <<
+    " transparent=" << transparentModeNames[options.transparentMode] <<
+    " levels=" << options.maxLevel <<
+    " filter=" << Image::get_filter_name(options.mipFilter) <<
+    " flip=" << options.flipY <<
+    " pot=" << options.resizeToPowerOfTwo <<
+    " band=" << options.bandBlockRows <<
+    " normal=" << normalFilterNames[options.normalMap.filter] <<
+    " encoder=" << options.encoder->name() <<
+    " srgb=" << options.srgb;
+  if (options.normalMap.filter != Image::NormalFilter_None) {
+    ss << " scale=" << options.normalMap.scale << " wrap=" << options.normalMap.wrap;
+  }
+  return ss.str();
+}
+
+/** Add the hash of the source and the conversion parameters to the key/value data.
+
+  @param ktx         the KTX file to add the pairs.
+  @param options     the conversion parameters.
+  @param sourceHash  the hash of the source file by GetFileHash().
+  @param pMaskHash   the hash of the mask file. if it is nullptr, the mask
+                     isn't used.
+*/
+void AddSourceKeyValues(KTX::File& ktx, const ConvertOptions& options, uint64_t sourceHash, const uint64_t* pMaskHash) {
+  std::ostringstream ss;
+  ss << "fnv1a64:" << std::hex << std::setw(16) << std::setfill('0') << sourceHash;
+  KTX::add_key_value(ktx, "ATCConv.sourceHash", ss.str());
+  KTX::add_key_value(ktx, "ATCConv.settings", GetSettingsText(options));
+  if (pMaskHash) {
+    ss.str("");
+    ss << "fnv1a64:" << std::setw(16) << *pMaskHash;
+    KTX::add_key_value(ktx, "ATCConv.maskHash", ss.str());
+  }
+}
+
+/** Convert the image band by band.
+
+  The image is read through RowSource, and only the bands of each level are
+  in the arena. The format isn't selected by Image::analyze() that needs the
+  whole image, but by the bytes per pixel.
+
+  @param source   the rows of the top level image.
+  @param options  the conversion parameters.
+  @param arena    the arena for the working memory. it is reset in this
+                  function.
+  @param ktx      the KTX file that has the key/value data.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool ConvertStream(RowSource& source, const ConvertOptions& options, Arena& arena, const KTX::File& ktx) {
+  uint32_t outputFormat = options.outputFormat;
+  if (outputFormat == Q_FORMAT_UNKNOWN) {
+    outputFormat = source.bytes_per_pixel() == 3 ? Q_FORMAT_ETC1_RGB8 : Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA;
+  }
+  arena.reset();
+  arena.reserve(GetStreamArenaSize(source.width(), source.height(), source.bytes_per_pixel(), outputFormat, options.maxLevel, options.bandBlockRows));
+  const bool premultiply = options.transparentMode == Image::TransparentMode_Premultiply;
+  return EncodeStream(*options.encoder, source, outputFormat, options.maxLevel, options.bandBlockRows, premultiply, arena, ktx, options.outfilename);
+}
+
+/** Convert the input file band by band.
+
+  If the source is streamed, the rows are decoded from the file on demand,
+  so neither the file nor the image is in the memory. The interlaced PNG
+  can't be decoded row by row, and it is decoded as a whole instead.
+
+  @param options  the conversion parameters.
+  @param source   the source that is decoded by DecodeSource().
+  @param arena    the arena for the working memory.
+  @param ktx      the KTX file that has the key/value data.
+
+  @return ConvertResult_Success if the conversion is succeeded, otherwise
+          the error code.
+*/
+ConvertResult ConvertSourceStream(const ConvertOptions& options, ConvertSource& source, Arena& arena, const KTX::File& ktx) {
+  const std::string& infilename = options.infilename;
+#if !ATCCONV_USE_FREEIMAGE
+  if (source.isStreamed) {
+    Image::PngRowSource rows;
+    if (rows.open(infilename)) {
+      if (ConvertStream(rows, options, arena, ktx)) {
+        return ConvertResult_Success;
+      }
+      if (rows.has_error()) {
+        std::cout << "Can't read '" << infilename << "'." << std::endl;
+        return ConvertResult_ReadError;
+      }
+      std::cout << "Can't convert '" << infilename << "'." << std::endl;
+      return ConvertResult_ConvertError;
+    }
+    if (!source.png.load(infilename)) {
+      std::cout << "Can't read '" << infilename << "'." << std::endl;
+      return ConvertResult_ReadError;
+    }
+  }
+#endif // !ATCCONV_USE_FREEIMAGE
+  BitmapRowSource rows(source.png.get_bitmap(options.flipY));
+  const bool result = ConvertStream(rows, options, arena, ktx);
+  source.png.unload();
+  if (!result) {
+    std::cout << "Can't convert '" << infilename << "'." << std::endl;
+    return ConvertResult_ConvertError;
+  }
+  return ConvertResult_Success;
+}
+
+/** Convert the height map to the normal map.
+
+  If the output format isn't passed, ATC with interpolated alpha is used,
+  because it compresses X in the alpha independently of Y.
+
+  @param image    the height map.
+  @param options  the conversion parameters.
+  @param arena    the arena for the working memory. it is reset in this
+                  function.
+  @param ktx      the KTX file to store the normal map.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool ConvertNormalMap(const Image::Bitmap& image, const ConvertOptions& options, Arena& arena, KTX::File& ktx) {
+  uint32_t outputFormat = options.outputFormat;
+  if (outputFormat == Q_FORMAT_UNKNOWN) {
+    outputFormat = Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA;
+  }
+  const Image::NormalLayout layout = TextureFormat::find(outputFormat)->hasAlpha ? Image::NormalLayout_AG : Image::NormalLayout_RG;
+  arena.reset();
+  arena.reserve(GetNormalMipChainArenaSize(image.width, image.height, outputFormat, layout, options.maxLevel, options.mipFilter));
+  const uint32_t threadCount = Parallel::get_thread_count(options.threadCount);
+  if (!EncodeNormalMipChain(*options.encoder, image, outputFormat, layout, options.normalMap, options.maxLevel, options.mipFilter, threadCount, arena, ktx)) {
+    return false;
+  }
+  KTX::add_key_value(ktx, "ATCConv.normalLayout", layout == Image::NormalLayout_AG ? "ag" : "rg");
+  return true;
+}
+
+/** Read the input file and the mask file.
+
+  It is the file I/O stage of the conversion. The content is decoded by
+  DecodeSource().
+
+  @param options  the conversion parameters.
+  @param source   the source to store the content of the files.
+
+  @return ConvertResult_Success if the files are read, otherwise
+          ConvertResult_ReadError.
+*/
+ConvertResult ReadSource(const ConvertOptions& options, ConvertSource& source) {
+#if !ATCCONV_USE_FREEIMAGE
+  // The band by band conversion decodes the rows from the file by itself.
+  // The flipped image needs the last row first, so it is decoded as a whole.
+  if (options.bandBlockRows && !options.flipY) {
+    if (!GetFileHash(options.infilename, &source.hash, &source.size)) {
+      std::cout << "Can't read '" << options.infilename << "'." << std::endl;
+      return ConvertResult_ReadError;
+    }
+    source.isStreamed = true;
+    return ConvertResult_Success;
+  }
+#endif // !ATCCONV_USE_FREEIMAGE
+  if (!ReadFileData(options.infilename, source.data)) {
+    std::cout << "Can't read '" << options.infilename << "'." << std::endl;
+    return ConvertResult_ReadError;
+  }
+  source.size = source.data.size();
+  if (!options.maskfilename.empty() && !ReadFileData(options.maskfilename, source.maskData)) {
+    std::cout << "Can't read '" << options.maskfilename << "'." << std::endl;
+    return ConvertResult_ReadError;
+  }
+  return ConvertResult_Success;
+}
+
+/** Hash and decode the files that are read by ReadSource().
+
+  The content of the files is released after the decoding. The streamed
+  source is decoded by EncodeSource().
+
+  @param options  the conversion parameters.
+  @param source   the source that is read by ReadSource().
+
+  @return ConvertResult_Success if the files are decoded, otherwise
+          ConvertResult_ReadError.
+*/
+ConvertResult DecodeSource(const ConvertOptions& options, ConvertSource& source) {
+  if (source.isStreamed) {
+    return ConvertResult_Success;
+  }
+  source.hash = UpdateHash(fnv1aOffsetBasis, source.data.data(), source.data.size());
+  const bool result = source.png.load(source.data.data(), source.data.size());
+  std::vector<uint8_t>().swap(source.data);
+  if (!result) {
+    std::cout << "Can't read '" << options.infilename << "'." << std::endl;
+    return ConvertResult_ReadError;
+  }
+  if (!options.maskfilename.empty()) {
+    source.maskHash = UpdateHash(fnv1aOffsetBasis, source.maskData.data(), source.maskData.size());
+    const bool maskResult = source.maskPng.load(source.maskData.data(), source.maskData.size());
+    std::vector<uint8_t>().swap(source.maskData);
+    if (!maskResult) {
+      std::cout << "Can't read '" << options.maskfilename << "'." << std::endl;
+      return ConvertResult_ReadError;
+    }
+  }
+  return ConvertResult_Success;
+}
+
+/** Encode the source that is decoded by DecodeSource().
+
+  The decoded images are released after the encoding. The band by band
+  conversion writes the file by itself, and the others store the textures
+  to output for WriteOutput().
+
+  @param options  the conversion parameters.
+  @param source   the source that is decoded by DecodeSource().
+  @param arena    the arena for the working memory. it is reset at the start
+                  of the encoding. the textures in output refer to it, so
+                  it should be kept until WriteOutput().
+  @param output   the textures to write.
+
+  @return ConvertResult_Success if the conversion is succeeded, otherwise
+          the error code.
+*/
+ConvertResult EncodeSource(const ConvertOptions& options, ConvertSource& source, Arena& arena, ConvertOutput& output) {
+  const std::string& infilename = options.infilename;
+  Image::PngFile& png = source.png;
+
+  KTX::File& ktx = output.ktx;
+  if (options.bandBlockRows) {
+    AddSourceKeyValues(ktx, options, source.hash, nullptr);
+    const ConvertResult result = ConvertSourceStream(options, source, arena, ktx);
+    output.isWritten = result == ConvertResult_Success;
+    return result;
+  }
+
+  // NOTE: png has a virtucal reversed image. The view of the flipped image is
+  //       made by walking the rows in the memory order.
+  Image::Bitmap image = png.get_bitmap(options.flipY);
+
+  // The mask is flipped with the image, and is stretched to each level.
+  Image::Bitmap mask;
+  const Image::Bitmap* pMask = nullptr;
+  if (!options.maskfilename.empty()) {
+    mask = source.maskPng.get_bitmap(options.flipY);
+    pMask = &mask;
+  }
+
+  AddSourceKeyValues(ktx, options, source.hash, pMask ? &source.maskHash : nullptr);
+
+  if (options.normalMap.filter != Image::NormalFilter_None) {
+    const bool result = ConvertNormalMap(image, options, arena, ktx);
+    png.unload();
+    if (!result) {
+      std::cout << "Can't convert '" << infilename << "'." << std::endl;
+      return ConvertResult_ConvertError;
+    }
+    return ConvertResult_Success;
+  }
+
+  // The preprocess runs before the analysis, because the premultiplied color
+  // may become the solid color. Its work memory is released soon.
+  arena.reset();
+  if (options.transparentMode != Image::TransparentMode_None) {
+    const size_t workSize = Image::get_preprocess_work_size(image.width);
+    arena.reserve(Arena::aligned_size(workSize));
+    Image::preprocess(image, options.transparentMode, arena.allocate_array<uint8_t>(workSize));
+    arena.reset();
+  }
+
+  if (options.resizeToPowerOfTwo && !ResizeToPowerOfTwo(image, options, arena)) {
+    png.unload();
+    std::cout << "Can't resize '" << infilename << "'." << std::endl;
+    return ConvertResult_ConvertError;
+  }
+
+  const Image::Analysis analysis = Image::analyze(image);
+  uint32_t outputFormat = options.outputFormat;
+  if (outputFormat == Q_FORMAT_UNKNOWN) {
+    outputFormat = SelectOutputFormat(analysis);
+  }
+  arena.reserve(GetArenaSize(image, options, outputFormat));
+
+  KTX::File& alphaKtx = output.alphaKtx;
+  alphaKtx.keyValues = ktx.keyValues;
+  const std::string alphaFilename = GetAlphaFileName(options.outfilename);
+  bool result;
+  switch (options.alphaLayout) {
+  case AlphaLayout_Separate:
+    result = EncodeSeparateAlpha(image, options, pMask, analysis.isSolid, arena, ktx, alphaKtx);
+    KTX::add_key_value(ktx, "ATCConv.alphaLayout", "separate");
+    KTX::add_key_value(ktx, "ATCConv.alphaFile", GetBaseName(alphaFilename));
+    KTX::add_key_value(alphaKtx, "ATCConv.alphaLayout", "alpha");
+    KTX::add_key_value(alphaKtx, "ATCConv.colorFile", GetBaseName(options.outfilename));
+    output.hasAlphaFile = true;
+    break;
+  case AlphaLayout_Stacked:
+    result = EncodeStackedAlpha(image, options, arena, ktx);
+    KTX::add_key_value(ktx, "ATCConv.alphaLayout", "stacked");
+    break;
+  default:
+  case AlphaLayout_None:
+    result = analysis.isSolid ?
+      EncodeSolidMipChain(*options.encoder, image, outputFormat, options.maxLevel, arena, ktx) :
+      EncodeMipChain(*options.encoder, image, outputFormat, options.maxLevel, options.mipFilter, options.srgb, Parallel::get_thread_count(options.threadCount), arena, ktx, pMask);
+    break;
+  }
+  png.unload();
+  source.maskPng.unload();
+  if (!result) {
+    std::cout << "Can't convert '" << infilename << "'." << std::endl;
+    return ConvertResult_ConvertError;
+  }
+  // ETC1 and ATC have no sRGB internal format. The alpha texture is linear.
+  if (options.srgb) {
+    KTX::add_key_value(ktx, "ATCConv.colorSpace", "srgb");
+  }
+  return ConvertResult_Success;
+}
+
+/** Write the textures that are encoded by EncodeSource().
+
+  @param options  the conversion parameters.
+  @param output   the textures to write.
+
+  @return ConvertResult_Success if the files are written, otherwise
+          ConvertResult_WriteError.
+*/
+ConvertResult WriteOutput(const ConvertOptions& options, const ConvertOutput& output) {
+  if (output.isWritten) {
+    return ConvertResult_Success;
+  }
+  if (!KTX::write_texture(options.outfilename, output.ktx)) {
+    return ConvertResult_WriteError;
+  }
+  if (output.hasAlphaFile && !KTX::write_texture(GetAlphaFileName(options.outfilename), output.alphaKtx)) {
+    return ConvertResult_WriteError;
+  }
+  return ConvertResult_Success;
+}
+
+/** Convert PNG file to KTX file.
+
+  The stages of ReadSource(), DecodeSource(), EncodeSource() and
+  WriteOutput() run in order on the caller thread.
+
+  @param options  the conversion parameters.
+  @param arena    the arena for the working memory. it is reset at the start
+                  of the conversion, and can be reused for the next file.
+
+  @return ConvertResult_Success if the conversion is succeeded, otherwise
+          the error code.
+*/
+ConvertResult ConvertFile(const ConvertOptions& options, Arena& arena) {
+  ConvertSource source;
+  ConvertResult result = ReadSource(options, source);
+  if (result != ConvertResult_Success) {
+    return result;
+  }
+  result = DecodeSource(options, source);
+  if (result != ConvertResult_Success) {
+    return result;
+  }
+  ConvertOutput output;
+  result = EncodeSource(options, source, arena, output);
+  if (result != ConvertResult_Success) {
+    return result;
+  }
+  return WriteOutput(options, output);
+}
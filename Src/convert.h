@@ -0,0 +1,113 @@
+/**
+  @file convert.h
+
+  Convert PNG image to KTX image.
+*/
+#ifndef CONVERT_H_INCLUDED
+#define CONVERT_H_INCLUDED
+#include "image.h"
+#include "preprocess.h"
+#include "normalmap.h"
+#include "resample.h"
+#include "ktx.h"
+#include "encoder.h"
+#include "pngfile.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Arena;
+
+static const uint32_t Q_FORMAT_UNKNOWN = 0xffffffffU;
+
+/** The output layout of the alpha for ETC1.
+*/
+enum AlphaLayout {
+  AlphaLayout_None, ///< the alpha is encoded by the output format.
+  AlphaLayout_Separate, ///< the color and the alpha are written to the separate ETC1 files.
+  AlphaLayout_Stacked, ///< the alpha is stacked below the color in one double height ETC1 image.
+};
+
+/** The conversion parameters.
+*/
+struct ConvertOptions {
+  std::string infilename;
+  std::string outfilename;
+  uint32_t outputFormat; ///< Q_FORMAT_???. if Q_FORMAT_UNKNOWN, it is selected by the input image.
+  uint32_t maxLevel;
+  bool flipY;
+  AlphaLayout alphaLayout; ///< if it isn't AlphaLayout_None, outputFormat is ignored and ETC1 is used.
+  Image::TransparentMode transparentMode;
+  uint32_t bandBlockRows; ///< if it isn't 0, the image is encoded band by band with this number of block rows.
+  Image::NormalMapOptions normalMap; ///< if its filter isn't NormalFilter_None, the image is converted to the normal map.
+  uint32_t threadCount; ///< the maximum number of threads. if 0, the number of the hardware threads.
+  Image::Filter mipFilter; ///< the filter to make the mipmaps.
+  bool resizeToPowerOfTwo; ///< if true, the image is resized to the nearest power of two size by mipFilter.
+  const Encoder::IBlockEncoder* encoder; ///< the encoder of all the blocks of the conversion.
+  bool preview; ///< if true, encoder is the preview encoder and maxLevel is 2 or less. the full quality conversion should follow.
+  std::string maskfilename; ///< if it isn't empty, the luminance of this image is the importance of the blocks for the native encoder.
+  bool srgb; ///< if true, the color is sRGB. the mipmaps and the resize are filtered in the linear space.
+
+  ConvertOptions() : outputFormat(Q_FORMAT_UNKNOWN), maxLevel(1), flipY(false), alphaLayout(AlphaLayout_None), transparentMode(Image::TransparentMode_None), bandBlockRows(0), threadCount(0), mipFilter(Image::Filter_Bicubic), resizeToPowerOfTwo(false), encoder(&Encoder::get_default()), preview(false), srgb(false) {}
+};
+
+/** The result code of ConvertFile().
+
+  It is used as the exit code of the program.
+*/
+enum ConvertResult {
+  ConvertResult_Success = 0,
+  ConvertResult_ReadError = 1,
+  ConvertResult_ConvertError = 2,
+  ConvertResult_WriteError = 3,
+};
+
+/** The source files of the conversion.
+
+  It is filled by ReadSource() and DecodeSource(), so that the files can be
+  read and decoded ahead of the encoding.
+*/
+struct ConvertSource {
+  std::vector<uint8_t> data; ///< the content of the input file. it is released by DecodeSource().
+  std::vector<uint8_t> maskData; ///< the content of the mask file. it is released by DecodeSource().
+  uint64_t hash; ///< the hash of the input file.
+  uint64_t maskHash; ///< the hash of the mask file.
+  uint64_t size; ///< the byte size of the input file.
+  bool isStreamed; ///< if true, the input file is decoded row by row by EncodeSource(), and data and png are empty.
+  Image::PngFile png;
+  Image::PngFile maskPng;
+
+  ConvertSource() : hash(0), maskHash(0), size(0), isStreamed(false) {}
+};
+
+/** The textures that are encoded by EncodeSource().
+
+  The image data refer to the arena of EncodeSource().
+*/
+struct ConvertOutput {
+  KTX::File ktx;
+  KTX::File alphaKtx; ///< the alpha texture of AlphaLayout_Separate.
+  bool hasAlphaFile; ///< if true, alphaKtx is written.
+  bool isWritten; ///< if true, the file is written by EncodeSource() and there is nothing to write.
+
+  ConvertOutput() : hasAlphaFile(false), isWritten(false) {}
+};
+
+uint32_t GetBytePerPixel(uint32_t format);
+uint32_t GetMipLevelCount(uint32_t w, uint32_t h, uint32_t maxLevel);
+uint32_t GetNearestPowerOfTwo(uint32_t n);
+uint64_t EstimateConvertCost(uint32_t width, uint32_t height, uint32_t outputFormat, uint32_t maxLevel);
+size_t GetMipChainArenaSize(const Image::Bitmap& image, uint32_t outputFormat, uint32_t maxLevel, Image::Filter filter, bool srgb);
+bool EncodeImage(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, uint8_t* pOut, uint32_t outSize, const Image::Bitmap* pImportance = nullptr);
+bool EncodeMipChain(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, uint32_t maxLevel, Image::Filter filter, bool srgb, uint32_t threadCount, Arena& arena, KTX::File& ktx, const Image::Bitmap* pMask = nullptr);
+std::string GetAlphaFileName(const std::string& filename);
+std::string GetOutputFileName(const std::string& infilename);
+bool ReadFileList(const std::string& listfile, std::vector<std::string>& filenames);
+bool GetFileHash(const std::string& filename, uint64_t* pHash, uint64_t* pSize = nullptr);
+ConvertResult ReadSource(const ConvertOptions& options, ConvertSource& source);
+ConvertResult DecodeSource(const ConvertOptions& options, ConvertSource& source);
+ConvertResult EncodeSource(const ConvertOptions& options, ConvertSource& source, Arena& arena, ConvertOutput& output);
+ConvertResult WriteOutput(const ConvertOptions& options, const ConvertOutput& output);
+ConvertResult ConvertFile(const ConvertOptions& options, Arena& arena);
+
+#endif // CONVERT_H_INCLUDED
@@ -0,0 +1,206 @@
+/**
+  @file decbench.cpp
+*/
+#include "decbench.h"
+#include "convert.h"
+#include "decoder.h"
+#include "format.h"
+#include "parallel.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+namespace /* unnamed */ {
+
+/** The kernel that is measured.
+*/
+struct KernelEntry {
+  BlockCodec::Kernel kernel;
+  const char* name;
+};
+
+const KernelEntry kernelList[] = {
+  { BlockCodec::Kernel_Scalar, "scalar" },
+  { BlockCodec::Kernel_SSE2, "sse2" },
+};
+const size_t kernelCount = sizeof(kernelList) / sizeof(kernelList[0]);
+
+/** The total of the files of the format.
+*/
+struct FormatTotal {
+  uint64_t pixelCount;
+  double seconds[kernelCount];
+};
+
+/** Decode all levels and faces of the texture.
+
+  @param file         the texture.
+  @param levelCount   the number of the levels to decode.
+  @param faceCount    the number of the faces to decode.
+  @param kernel       the implementation of the block decoder.
+  @param threadCount  the number of threads.
+  @param pOut         the buffer to store the pixels of all images in the
+                      order of the levels and the faces.
+
+  @return the time in seconds. if the decoding is failed, -1.
+*/
+double DecodeTexture(const KTX::File& file, uint32_t levelCount, uint32_t faceCount, BlockCodec::Kernel kernel, uint32_t threadCount, uint8_t* pOut) {
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    uint32_t w, h;
+    Decoder::get_level_size(file, level, &w, &h);
+    for (uint32_t face = 0; face < faceCount; ++face) {
+      const Image::Bitmap image = Image::make_bitmap(pOut, w, h, 4);
+      if (!Decoder::decode_level(file, level, face, image, Decoder::Order_RGBA, kernel, threadCount)) {
+        return -1;
+      }
+      pOut += Image::get_size(w, h, 4);
+    }
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Print the speed in GPixel/s.
+*/
+void PrintSpeed(uint64_t pixelCount, double seconds) {
+  if (seconds < 0) {
+    std::cout << std::setw(11) << "-";
+  } else {
+    std::cout << std::setw(11) << pixelCount / std::max(seconds, 1e-9) / 1000000000.0;
+  }
+}
+
+} // unnamed namespace
+
+/** Decode the KTX files by each kernel, and print the speed.
+
+  usage: decbench [-j count] [-r count] [-l listfile] [file...]
+
+  All levels and faces are decoded to RGBA, and the fastest of the runs is
+  measured. The pixels of each kernel are compared with the scalar kernel.
+
+  @param argc  the number of arguments after the subcommand.
+  @param argv  the arguments after the subcommand.
+
+  @return the exit code. 0 if all files are decoded and all kernels make the
+          same pixels, otherwise 1.
+*/
+int RunDecodeBenchmark(int argc, char** argv) {
+  std::vector<std::string> filenames;
+  uint32_t threadCount = 0;
+  uint32_t repeatCount = 3;
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      threadCount = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      repeatCount = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      if (!ReadFileList(argv[++i], filenames)) {
+        std::cout << "Error: can't read '" << argv[i] << "'." << std::endl;
+        return 1;
+      }
+    } else {
+      filenames.push_back(argv[i]);
+    }
+  }
+  threadCount = Parallel::get_thread_count(threadCount);
+
+  std::cout << "decode to RGBA by " << threadCount << " thread(s), the fastest of " << repeatCount << " run(s) in GPixel/s." << std::endl;
+  std::cout << std::left << std::setw(6) << "fmt" << std::setw(12) << "size" << std::right << std::setw(4) << "lv" << std::setw(4) << "fc";
+  for (const KernelEntry& e : kernelList) {
+    std::cout << std::setw(11) << e.name;
+  }
+  std::cout << "  file" << std::endl;
+
+  int exitCode = 0;
+  FormatTotal totals[TextureFormat::traitsCount] = {};
+  std::vector<uint8_t> reference;
+  std::vector<uint8_t> decoded;
+  for (const auto& filename : filenames) {
+    KTX::File file;
+    if (!KTX::read_texture(filename, file)) {
+      std::cout << "Error: can't read '" << filename << "'." << std::endl;
+      exitCode = 1;
+      continue;
+    }
+    const KTX::Endian e = KTX::get_endian(file.header);
+    const TextureFormat::Traits* pTraits = TextureFormat::find_by_gl_format(KTX::get_value(&file.header.glInternalFormat, e));
+    if (!pTraits || file.data.empty()) {
+      std::cout << "Error: '" << filename << "' has unsupported format or no image." << std::endl;
+      exitCode = 1;
+      continue;
+    }
+    const uint32_t levelCount = static_cast<uint32_t>(file.data.size());
+    const uint32_t faceCount = std::max(KTX::get_value(&file.header.numberOfFaces, e), 1U);
+    uint64_t pixelCount = 0;
+    for (uint32_t level = 0; level < levelCount; ++level) {
+      uint32_t w, h;
+      Decoder::get_level_size(file, level, &w, &h);
+      pixelCount += static_cast<uint64_t>(w) * h * faceCount;
+    }
+    reference.resize(static_cast<size_t>(pixelCount) * 4);
+    decoded.resize(reference.size());
+
+    double seconds[kernelCount];
+    bool isFailed = false;
+    for (size_t k = 0; k < kernelCount; ++k) {
+      seconds[k] = -1;
+      if (!BlockCodec::has_kernel(kernelList[k].kernel)) {
+        continue;
+      }
+      uint8_t* pOut = k == 0 ? reference.data() : decoded.data();
+      seconds[k] = INFINITY;
+      for (uint32_t n = 0; n < repeatCount && seconds[k] >= 0; ++n) {
+        const double t = DecodeTexture(file, levelCount, faceCount, kernelList[k].kernel, threadCount, pOut);
+        seconds[k] = t < 0 ? t : std::min(seconds[k], t);
+      }
+      if (seconds[k] < 0) {
+        std::cout << "Error: can't decode '" << filename << "' by " << kernelList[k].name << "." << std::endl;
+        isFailed = true;
+        break;
+      }
+      if (k != 0 && reference != decoded) {
+        std::cout << "Error: " << kernelList[k].name << " differs from " << kernelList[0].name << " in '" << filename << "'." << std::endl;
+        isFailed = true;
+        break;
+      }
+    }
+    if (isFailed) {
+      exitCode = 1;
+      continue;
+    }
+
+    uint32_t width, height;
+    Decoder::get_level_size(file, 0, &width, &height);
+    FormatTotal& total = totals[pTraits - TextureFormat::traitsList];
+    total.pixelCount += pixelCount;
+    std::cout << std::left << std::setw(6) << pTraits->name << std::setw(12) << (std::to_string(width) + "x" + std::to_string(height)) <<
+      std::right << std::setw(4) << levelCount << std::setw(4) << faceCount << std::fixed << std::setprecision(3);
+    for (size_t k = 0; k < kernelCount; ++k) {
+      total.seconds[k] += std::max(seconds[k], 0.0);
+      PrintSpeed(pixelCount, seconds[k]);
+    }
+    std::cout << std::defaultfloat << "  " << filename << std::endl;
+  }
+
+  std::cout << "total:" << std::endl;
+  for (size_t i = 0; i < TextureFormat::traitsCount; ++i) {
+    const FormatTotal& total = totals[i];
+    if (!total.pixelCount) {
+      continue;
+    }
+    std::cout << std::left << std::setw(6) << TextureFormat::traitsList[i].name << std::setw(20) << (std::to_string(total.pixelCount) + " pixels") <<
+      std::right << std::fixed << std::setprecision(3);
+    for (size_t k = 0; k < kernelCount; ++k) {
+      PrintSpeed(total.pixelCount, BlockCodec::has_kernel(kernelList[k].kernel) ? total.seconds[k] : -1);
+    }
+    std::cout << std::defaultfloat << std::endl;
+  }
+  return exitCode;
+}
@@ -0,0 +1,11 @@
+/**
+  @file decbench.h
+
+  Measure the speed of the decoder for each format.
+*/
+#ifndef DECBENCH_H_INCLUDED
+#define DECBENCH_H_INCLUDED
+
+int RunDecodeBenchmark(int argc, char** argv);
+
+#endif // DECBENCH_H_INCLUDED
@@ -0,0 +1,215 @@
+/**
+  @file decoder.cpp
+*/
+#include "decoder.h"
+#include "format.h"
+#include "parallel.h"
+#include "simd.h"
+#include <TextureConverter.h>
+#include <algorithm>
+#include <cstring>
+
+namespace Decoder {
+
+namespace /* unnamed */ {
+
+/** Store the pixels of the block row to the image row.
+
+  @param pRGBA   the pixels of R, G, B and A.
+  @param q       the image row.
+  @param count   the number of the pixels.
+  @param order   the byte order of q.
+  @param kernel  the implementation of the swap.
+*/
+void StoreRow(const uint8_t* pRGBA, uint8_t* q, uint32_t count, Order order, BlockCodec::Kernel kernel) {
+  if (order == Order_RGBA) {
+    memcpy(q, pRGBA, count * 4);
+    return;
+  }
+#if ATCCONV_HAS_SSE2
+  if (kernel == BlockCodec::Kernel_SSE2 && count == 4) {
+    // Swap R and B of 4 pixels at once.
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRGBA));
+    const __m128i ga = _mm_and_si128(v, _mm_set1_epi32(static_cast<int>(0xff00ff00)));
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), _mm_set1_epi32(0xff));
+    const __m128i r = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xff)), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(q), _mm_or_si128(ga, _mm_or_si128(r, b)));
+    return;
+  }
+#endif // ATCCONV_HAS_SSE2
+  for (uint32_t i = 0; i < count; ++i, pRGBA += 4, q += 4) {
+    q[0] = pRGBA[2];
+    q[1] = pRGBA[1];
+    q[2] = pRGBA[0];
+    q[3] = pRGBA[3];
+  }
+}
+
+/** Decompress 4x4 pixels.
+
+  @param pIn     the block.
+  @param format  Q_FORMAT_??? of the block. it should be the block format.
+  @param kernel  the implementation of the block decoder.
+  @param pRGBA   the buffer to store 16 pixels.
+*/
+void DecodeBlock(const uint8_t* pIn, uint32_t format, BlockCodec::Kernel kernel, uint8_t* pRGBA) {
+  switch (format) {
+  case Q_FORMAT_ETC1_RGB8:
+    BlockCodec::decode_etc1_block(pIn, kernel, pRGBA);
+    break;
+  case Q_FORMAT_ATC_RGBA_EXPLICIT_ALPHA:
+    BlockCodec::decode_explicit_alpha_block(pIn, kernel, pRGBA);
+    BlockCodec::decode_atc_color_block(pIn + 8, kernel, pRGBA);
+    break;
+  case Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA:
+    BlockCodec::decode_interpolated_alpha_block(pIn, pRGBA);
+    BlockCodec::decode_atc_color_block(pIn + 8, kernel, pRGBA);
+    break;
+  }
+}
+
+/** Decompress the block rows [begin, end) of the image.
+
+  The pixels out of the image are discarded.
+*/
+void DecodeBlockRows(const uint8_t* pData, const TextureFormat::Traits& traits, const Image::Bitmap& image, Order order, BlockCodec::Kernel kernel, uint32_t begin, uint32_t end) {
+  const uint32_t blocksPerRow = (image.width + 3) / 4;
+  const uint8_t* pIn = pData + static_cast<size_t>(begin) * blocksPerRow * traits.bytesPerBlock;
+  uint8_t block[16 * 4] = {};
+  for (uint32_t by = begin; by < end; ++by) {
+    const uint32_t y = by * 4;
+    const uint32_t h = std::min(image.height - y, 4U);
+    for (uint32_t x = 0; x < image.width; x += 4, pIn += traits.bytesPerBlock) {
+      DecodeBlock(pIn, traits.qformat, kernel, block);
+      const uint32_t w = std::min(image.width - x, 4U);
+      for (uint32_t i = 0; i < h; ++i) {
+        StoreRow(block + i * 16, image.row(y + i) + x * 4, w, order, kernel);
+      }
+    }
+  }
+}
+
+/** Convert the rows [begin, end) of the uncompressed image.
+
+  The rows of pData are aligned to 4 bytes as KTX.
+*/
+void ConvertRows(const uint8_t* pData, const TextureFormat::Traits& traits, const Image::Bitmap& image, Order order, uint32_t begin, uint32_t end) {
+  const uint32_t bpp = traits.bytesPerBlock;
+  const uint32_t stride = (image.width * bpp + 3) & ~3U;
+  const uint32_t r = order == Order_RGBA ? 0 : 2;
+  for (uint32_t y = begin; y < end; ++y) {
+    const uint8_t* p = pData + static_cast<size_t>(y) * stride;
+    uint8_t* q = image.row(y);
+    for (uint32_t x = 0; x < image.width; ++x, p += bpp, q += 4) {
+      q[r] = p[0];
+      q[1] = p[1];
+      q[2 - r] = p[2];
+      q[3] = bpp == 4 ? p[3] : 255;
+    }
+  }
+}
+
+} // unnamed namespace
+
+/** Decompress the image.
+
+  The uncompressed format is also accepted. Its pixels are RGB(A) and its
+  rows are aligned to 4 bytes as KTX.
+
+  @param pData        the image data.
+  @param size         the byte size of pData.
+  @param format       Q_FORMAT_??? of pData.
+  @param image        the image to store the pixels. its bytesPerPixel should
+                      be 4.
+  @param order        the byte order of the pixels in image.
+  @param kernel       the implementation of the block decoder.
+  @param threadCount  the number of threads. the block rows are split into
+                      them.
+
+  @retval true  success.
+  @retval false the format isn't supported, the kernel isn't built in, or
+                pData is too small.
+*/
+bool decode_image(const uint8_t* pData, uint32_t size, uint32_t format, const Image::Bitmap& image, Order order, BlockCodec::Kernel kernel, uint32_t threadCount)
+{
+  const TextureFormat::Traits* pTraits = TextureFormat::find(format);
+  if (!pTraits || image.bytesPerPixel != 4 || !BlockCodec::has_kernel(kernel)) {
+    return false;
+  }
+  const TextureFormat::Traits& traits = *pTraits;
+  if (!traits.isCompressed) {
+    const uint32_t stride = (image.width * traits.bytesPerBlock + 3) & ~3U;
+    if (size < static_cast<uint64_t>(stride) * image.height) {
+      return false;
+    }
+    Parallel::for_range(image.height, threadCount, [&](uint32_t begin, uint32_t end) {
+      ConvertRows(pData, traits, image, order, begin, end);
+    });
+    return true;
+  }
+  if (size < TextureFormat::get_image_size(traits, image.width, image.height)) {
+    return false;
+  }
+  Parallel::for_range((image.height + 3) / 4, threadCount, [&](uint32_t begin, uint32_t end) {
+    DecodeBlockRows(pData, traits, image, order, kernel, begin, end);
+  });
+  return true;
+}
+
+/** Get the size of the mip level.
+
+  @param file     the texture.
+  @param level    the mip level.
+  @param pWidth   the pointer to store the width.
+  @param pHeight  the pointer to store the height.
+
+  @retval true  success.
+  @retval false file doesn't have level.
+*/
+bool get_level_size(const KTX::File& file, uint32_t level, uint32_t* pWidth, uint32_t* pHeight)
+{
+  if (level >= file.data.size() || level >= 32) {
+    return false;
+  }
+  const KTX::Endian e = KTX::get_endian(file.header);
+  *pWidth = std::max(KTX::get_value(&file.header.pixelWidth, e) >> level, 1U);
+  *pHeight = std::max(std::max(KTX::get_value(&file.header.pixelHeight, e), 1U) >> level, 1U);
+  return true;
+}
+
+/** Decompress the face of the mip level.
+
+  @param file         the texture.
+  @param level        the mip level.
+  @param face         the face. it is 0 if file isn't the cubemap.
+  @param image        the image to store the pixels. its size should be
+                      get_level_size(), and its bytesPerPixel should be 4.
+  @param order        the byte order of the pixels in image.
+  @param kernel       the implementation of the block decoder.
+  @param threadCount  the number of threads.
+
+  @retval true  success.
+  @retval false the format isn't supported, file doesn't have the face of
+                level, or the size of image is wrong.
+*/
+bool decode_level(const KTX::File& file, uint32_t level, uint32_t face, const Image::Bitmap& image, Order order, BlockCodec::Kernel kernel, uint32_t threadCount)
+{
+  const KTX::Endian e = KTX::get_endian(file.header);
+  const TextureFormat::Traits* pTraits = TextureFormat::find_by_gl_format(KTX::get_value(&file.header.glInternalFormat, e));
+  uint32_t w, h;
+  if (!pTraits || !get_level_size(file, level, &w, &h) || image.width != w || image.height != h) {
+    return false;
+  }
+  if (face >= std::max(KTX::get_value(&file.header.numberOfFaces, e), 1U)) {
+    return false;
+  }
+  const KTX::File::Data& data = file.data[level];
+  // Each face is padded to 4 bytes.
+  const size_t offset = static_cast<size_t>(face) * ((data.imageSize + 3) & ~3U);
+  if (offset + data.imageSize > data.size()) {
+    return false;
+  }
+  return decode_image(data.bytes() + offset, data.imageSize, pTraits->qformat, image, order, kernel, threadCount);
+}
+
+} // namespace Decoder
@@ -0,0 +1,32 @@
+/**
+  @file decoder.h
+
+  Decode the KTX images to the uncompressed pixels.
+
+  The block rows are split into the threads, and each block is decoded by
+  the block decoder of BlockCodec with the selected kernel. The result is
+  same for any kernel and any thread count.
+*/
+#ifndef DECODER_H_INCLUDED
+#define DECODER_H_INCLUDED
+#include "blockcodec.h"
+#include "image.h"
+#include "ktx.h"
+#include <cstdint>
+
+namespace Decoder {
+
+/** The byte order of the decoded pixel.
+*/
+enum Order {
+  Order_RGBA, ///< as OpenGL.
+  Order_BGRA, ///< as FreeImage and the conversion pipeline.
+};
+
+bool decode_image(const uint8_t* pData, uint32_t size, uint32_t format, const Image::Bitmap& image, Order order, BlockCodec::Kernel kernel, uint32_t threadCount);
+bool get_level_size(const KTX::File& file, uint32_t level, uint32_t* pWidth, uint32_t* pHeight);
+bool decode_level(const KTX::File& file, uint32_t level, uint32_t face, const Image::Bitmap& image, Order order, BlockCodec::Kernel kernel, uint32_t threadCount);
+
+} // namespace Decoder
+
+#endif // DECODER_H_INCLUDED
@@ -0,0 +1,192 @@
+/**
+  @file dettest.cpp
+*/
+#include "dettest.h"
+#include "convert.h"
+#include "cmdline.h"
+#include "arena.h"
+#include "parallel.h"
+#include <FreeImage.h>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+namespace /* unnamed */ {
+
+/** The conversion that is tested.
+
+  Each of them runs the different threaded path of ConvertFile(). The
+  options are added after the passed options.
+*/
+struct Preset {
+  const char* name;
+  const char* args[5]; ///< the options. it ends with nullptr.
+};
+
+const Preset presetList[] = {
+  { "default", { nullptr } },
+  { "mip", { "-filter", "kaiser", nullptr } },
+  { "pot", { "-filter", "bicubic", "-p", nullptr } },
+  { "separate", { "-a", "separate", nullptr } },
+  { "stacked", { "-a", "stacked", nullptr } },
+  { "normal", { "-n", "sobel", nullptr } },
+  { "srgb", { "-filter", "kaiser", "--srgb", "-p", nullptr } },
+};
+
+/** Parse the conversion options by ParseConvertOptions().
+
+  @param args        the arguments.
+  @param options     the options to store the result.
+  @param pFilenames  the pointer to store the files, or nullptr.
+
+  @retval true  success.
+  @retval false the arguments are wrong. the error message is printed.
+*/
+bool ParseArgs(std::vector<std::string> args, ConvertOptions& options, std::vector<std::string>* pFilenames) {
+  std::vector<char*> argp;
+  for (auto& e : args) {
+    argp.push_back(&e[0]);
+  }
+  argp.push_back(nullptr);
+  std::vector<std::string> filenames;
+  if (!ParseConvertOptions(static_cast<int>(argp.size() - 1), argp.data(), options, &filenames)) {
+    return false;
+  }
+  if (pFilenames) {
+    pFilenames->insert(pFilenames->end(), filenames.begin(), filenames.end());
+  }
+  return true;
+}
+
+/** Get the hash of the output files.
+
+  @retval true  success.
+  @retval false the output can't be read.
+*/
+bool GetOutputHash(const ConvertOptions& options, uint64_t* pHash) {
+  uint64_t hash;
+  if (!GetFileHash(options.outfilename, &hash)) {
+    return false;
+  }
+  uint64_t alphaHash = 0;
+  if (options.alphaLayout == AlphaLayout_Separate && !GetFileHash(GetAlphaFileName(options.outfilename), &alphaHash)) {
+    return false;
+  }
+  *pHash = hash ^ (alphaHash * 0x100000001b3ULL);
+  return true;
+}
+
+} // unnamed namespace
+
+/** Encode the files by 1, 2 and N threads, and compare the hashes of the output.
+
+  usage: dettest [-o outfile] [-l listfile] [options...] [file...]
+
+  The options are same as the conversion, and '-j count' is N. Each preset
+  is tested with them, and the preset that can't be used with them is
+  skipped.
+
+  @param argc  the number of arguments after the subcommand.
+  @param argv  the arguments after the subcommand.
+
+  @return the exit code. 0 if all outputs are same, otherwise 1.
+*/
+int RunDeterminismTest(int argc, char** argv) {
+  std::vector<std::string> filenames;
+  std::string outfilename = "atcconv_dettest.ktx";
+  // All the levels are made unless '-m' is passed.
+  std::vector<std::string> args = { "-m", "16" };
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outfilename = argv[++i];
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      if (!ReadFileList(argv[++i], filenames)) {
+        std::cout << "Error: can't read '" << argv[i] << "'." << std::endl;
+        return 1;
+      }
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  ConvertOptions baseOptions;
+  if (!ParseArgs(args, baseOptions, &filenames)) {
+    return 1;
+  }
+
+  std::vector<const Preset*> presets;
+  std::vector<ConvertOptions> presetOptions;
+  for (const auto& preset : presetList) {
+    std::vector<std::string> presetArgs = args;
+    for (const char* const* p = preset.args; *p; ++p) {
+      presetArgs.push_back(*p);
+    }
+    ConvertOptions options;
+    if (!ParseArgs(presetArgs, options, nullptr)) {
+      std::cout << "skip     " << preset.name << ": it can't be used with the options." << std::endl;
+      continue;
+    }
+    presets.push_back(&preset);
+    presetOptions.push_back(options);
+  }
+
+  std::vector<uint32_t> threadCounts = { 1, 2, Parallel::get_thread_count(baseOptions.threadCount) };
+  std::sort(threadCounts.begin(), threadCounts.end());
+  threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+#ifdef FREE_IMAGE_STATIC_LIBRARY
+  FreeImage_Initialise(FALSE);
+#endif // FREE_ISTATIC_LIBRARY
+
+  Arena arena;
+  size_t runCount = 0;
+  size_t errorCount = 0;
+  for (const auto& filename : filenames) {
+    for (size_t presetIndex = 0; presetIndex < presets.size(); ++presetIndex) {
+      const Preset& preset = *presets[presetIndex];
+      ConvertOptions options = presetOptions[presetIndex];
+      options.infilename = filename;
+      options.outfilename = outfilename;
+      std::vector<uint64_t> hashes;
+      for (uint32_t n : threadCounts) {
+        options.threadCount = n;
+        uint64_t hash = 0;
+        if (ConvertFile(options, arena) != ConvertResult_Success || !GetOutputHash(options, &hash)) {
+          std::cout << "error    " << filename << " " << preset.name << ": can't convert by " << n << " thread(s)." << std::endl;
+          ++errorCount;
+          hashes.clear();
+          break;
+        }
+        hashes.push_back(hash);
+        ++runCount;
+      }
+      if (!hashes.empty() && std::count(hashes.begin(), hashes.end(), hashes[0]) != static_cast<ptrdiff_t>(hashes.size())) {
+        std::cout << "mismatch " << filename << " " << preset.name << ":";
+        for (size_t i = 0; i < hashes.size(); ++i) {
+          std::cout << " " << threadCounts[i] << "=" << std::hex << std::setw(16) << std::setfill('0') << hashes[i] << std::dec << std::setfill(' ');
+        }
+        std::cout << std::endl;
+        ++errorCount;
+      }
+      std::remove(outfilename.c_str());
+      if (options.alphaLayout == AlphaLayout_Separate) {
+        std::remove(GetAlphaFileName(outfilename).c_str());
+      }
+    }
+  }
+
+#ifdef FREE_IMAGE_STATIC_LIBRARY
+  FreeImage_Deinitialise();
+#endif // FREE_ISTATIC_LIBRARY
+
+  std::cout << filenames.size() << " files, " << runCount << " runs by";
+  for (uint32_t n : threadCounts) {
+    std::cout << " " << n;
+  }
+  std::cout << " thread(s), " << errorCount << " error(s)." << std::endl;
+  return errorCount ? 1 : 0;
+}
@@ -0,0 +1,11 @@
+/**
+  @file dettest.h
+
+  Test that the output doesn't depend on the number of threads.
+*/
+#ifndef DETTEST_H_INCLUDED
+#define DETTEST_H_INCLUDED
+
+int RunDeterminismTest(int argc, char** argv);
+
+#endif // DETTEST_H_INCLUDED
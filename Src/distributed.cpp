@@ -0,0 +1,690 @@
+/**
+  @file distributed.cpp
+
+  The protocol is the text lines over TCP.
+
+  worker -> coordinator:
+    NEXT                                        request the next file. it is sent before the
+                                                results of the previous files to read them ahead.
+    RESULT index code inBytes outBytes usec     report the result of the file.
+
+  coordinator -> worker:
+    FILE index<TAB>infile<TAB>outfile           convert the file.
+    WAIT                                        no file now. request again later.
+    DONE                                        all files are finished.
+*/
+// The socket headers are included first, because winsock2.h should precede windows.h.
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+#include "distributed.h"
+#include "convert.h"
+#include "cmdline.h"
+#include "arena.h"
+#include "format.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "pngfile.h"
+#include <FreeImage.h>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+namespace /* unnamed */ {
+
+#ifdef _WIN32
+typedef SOCKET Socket;
+const Socket invalidSocket = INVALID_SOCKET;
+const int sendFlags = 0;
+inline void CloseSocket(Socket s) { closesocket(s); }
+#else
+typedef int Socket;
+const Socket invalidSocket = -1;
+const int sendFlags = MSG_NOSIGNAL;
+inline void CloseSocket(Socket s) { close(s); }
+#endif
+
+/// The default port of the coordinator.
+const uint16_t defaultPort = 20480;
+
+/** Initialize the socket library.
+*/
+class SocketLibrary {
+public:
+#ifdef _WIN32
+  SocketLibrary() { WSADATA data; isInitialized = WSAStartup(MAKEWORD(2, 2), &data) == 0; }
+  ~SocketLibrary() { if (isInitialized) { WSACleanup(); } }
+  bool isInitialized;
+#else
+  SocketLibrary() : isInitialized(true) {}
+  bool isInitialized;
+#endif
+};
+
+/** Send all bytes of the text.
+
+  @retval true  success.
+  @retval false the connection is closed.
+*/
+bool SendText(Socket s, const std::string& text) {
+  const char* p = text.data();
+  size_t rest = text.size();
+  while (rest) {
+    const int n = send(s, p, static_cast<int>(rest), sendFlags);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    rest -= n;
+  }
+  return true;
+}
+
+/** The buffer to split the received bytes into the lines.
+*/
+struct LineReader {
+  std::string buf;
+
+  /** Receive the bytes once.
+
+    @retval true  success.
+    @retval false the connection is closed.
+  */
+  bool receive(Socket s) {
+    char tmp[4096];
+    const int n = recv(s, tmp, sizeof(tmp), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buf.append(tmp, n);
+    return true;
+  }
+
+  /** Take the first line from the buffer.
+
+    @retval true  line has the line without the line feed.
+    @retval false there is no complete line.
+  */
+  bool get_line(std::string& line) {
+    const size_t pos = buf.find('\n');
+    if (pos == std::string::npos) {
+      return false;
+    }
+    line.assign(buf, 0, pos);
+    buf.erase(0, pos + 1);
+    return true;
+  }
+};
+
+/** Get the byte size of the file.
+
+  @return the size. 0 if the file can't be opened.
+*/
+uint64_t GetFileSize(const std::string& filename) {
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+  return ifs ? static_cast<uint64_t>(ifs.tellg()) : 0;
+}
+
+/** The file in the manifest.
+*/
+struct Entry {
+  std::string infilename;
+  std::string outfilename;
+  int result; ///< ConvertResult. -1 while it isn't finished.
+  uint32_t attempts;
+  uint64_t inBytes;
+  uint64_t outBytes;
+  uint64_t usec; ///< the conversion time on the worker.
+  uint32_t worker; ///< the id of the worker that finished the file.
+  uint64_t cost; ///< the estimated conversion time. 0 if the header can't be read.
+  Entry() : result(-1), attempts(0), inBytes(0), outBytes(0), usec(0), worker(0), cost(0) {}
+};
+
+/** The range of the indices in the order list.
+*/
+struct Shard {
+  uint32_t begin;
+  uint32_t end;
+  uint32_t size() const { return end - begin; }
+};
+
+/** The worker that is connected to the coordinator.
+*/
+struct Worker {
+  Socket socket;
+  uint32_t id;
+  LineReader reader;
+  Shard shard; ///< the rest of the files owned by the worker.
+  std::vector<uint32_t> inFlight; ///< the indices of the files in the conversion.
+};
+
+/** The state of the coordinator.
+*/
+class Coordinator {
+public:
+  Coordinator(std::vector<Entry>& e, uint32_t shardSize, uint32_t retry);
+  bool on_line(Worker& worker, const std::string& line);
+  void on_disconnect(Worker& worker);
+  bool is_finished() const { return finishedCount == entries.size(); }
+
+  std::vector<Entry>& entries;
+  std::vector<Worker> workers;
+  uint32_t retryCount;
+  uint32_t retriedCount;
+  uint32_t stolenCount; ///< the number of the shards that are stolen.
+
+private:
+  bool take(Worker& worker, uint32_t* pIndex);
+  void retry(uint32_t index);
+
+  std::vector<uint32_t> order; ///< the indices of entries. the retried files are appended.
+  std::deque<Shard> queue; ///< the shards that aren't owned by any worker.
+  size_t finishedCount;
+};
+
+Coordinator::Coordinator(std::vector<Entry>& e, uint32_t shardSize, uint32_t retry) :
+  entries(e), retryCount(retry), retriedCount(0), stolenCount(0), finishedCount(0)
+{
+  const uint32_t count = static_cast<uint32_t>(entries.size());
+  order.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    order.push_back(i);
+  }
+  // The most costly files are dispatched first, so that the last files are
+  // short and all workers finish at nearly the same time.
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) {
+    return entries[lhs].cost > entries[rhs].cost;
+  });
+  for (uint32_t i = 0; i < count; i += shardSize) {
+    queue.push_back(Shard{ i, std::min(i + shardSize, count) });
+  }
+}
+
+/** Take the next file for the worker.
+
+  The file is taken from the front of the own shard. If the shard is empty,
+  the new shard is taken from the queue, or the latter half of the largest
+  shard of the other workers is stolen.
+
+  @retval true  pIndex has the index of the file.
+  @retval false there is no file to convert now.
+*/
+bool Coordinator::take(Worker& worker, uint32_t* pIndex)
+{
+  if (!worker.shard.size()) {
+    if (!queue.empty()) {
+      worker.shard = queue.front();
+      queue.pop_front();
+    } else {
+      Worker* pVictim = nullptr;
+      for (auto& e : workers) {
+        if (&e != &worker && (!pVictim || e.shard.size() > pVictim->shard.size())) {
+          pVictim = &e;
+        }
+      }
+      if (!pVictim || !pVictim->shard.size()) {
+        return false;
+      }
+      const uint32_t mid = pVictim->shard.begin + pVictim->shard.size() / 2;
+      worker.shard = Shard{ mid, pVictim->shard.end };
+      pVictim->shard.end = mid;
+      ++stolenCount;
+    }
+  }
+  *pIndex = order[worker.shard.begin++];
+  return true;
+}
+
+/** Put the failed file to the queue again.
+*/
+void Coordinator::retry(uint32_t index)
+{
+  const uint32_t pos = static_cast<uint32_t>(order.size());
+  order.push_back(index);
+  queue.push_back(Shard{ pos, pos + 1 });
+  ++retriedCount;
+}
+
+/** Process the line from the worker.
+
+  @retval true  success.
+  @retval false the line is wrong or the connection is closed.
+*/
+bool Coordinator::on_line(Worker& worker, const std::string& line)
+{
+  std::istringstream ss(line);
+  std::string command;
+  ss >> command;
+  if (command == "NEXT") {
+    uint32_t index;
+    if (take(worker, &index)) {
+      Entry& e = entries[index];
+      ++e.attempts;
+      worker.inFlight.push_back(index);
+      return SendText(worker.socket, "FILE " + std::to_string(index) + "\t" + e.infilename + "\t" + e.outfilename + "\n");
+    }
+    const bool isBusy = std::any_of(workers.begin(), workers.end(), [](const Worker& e) { return !e.inFlight.empty(); });
+    return SendText(worker.socket, isBusy ? "WAIT\n" : "DONE\n");
+  } else if (command == "RESULT") {
+    uint32_t index;
+    int code;
+    uint64_t inBytes, outBytes, usec;
+    if (!(ss >> index >> code >> inBytes >> outBytes >> usec)) {
+      return false;
+    }
+    const auto i = std::find(worker.inFlight.begin(), worker.inFlight.end(), index);
+    if (i == worker.inFlight.end()) {
+      return false;
+    }
+    worker.inFlight.erase(i);
+    Entry& e = entries[index];
+    if (code != ConvertResult_Success && e.attempts <= retryCount) {
+      retry(index);
+      return true;
+    }
+    e.result = code;
+    e.inBytes = inBytes;
+    e.outBytes = outBytes;
+    e.usec = usec;
+    e.worker = worker.id;
+    ++finishedCount;
+    return true;
+  }
+  return false;
+}
+
+/** Return the files of the disconnected worker to the queue.
+*/
+void Coordinator::on_disconnect(Worker& worker)
+{
+  if (worker.shard.size()) {
+    queue.push_front(worker.shard);
+    worker.shard.begin = worker.shard.end;
+  }
+  for (const uint32_t index : worker.inFlight) {
+    Entry& e = entries[index];
+    if (e.attempts <= retryCount) {
+      retry(index);
+    } else {
+      e.result = ConvertResult_ConvertError;
+      e.worker = worker.id;
+      ++finishedCount;
+    }
+  }
+  worker.inFlight.clear();
+}
+
+/** Open the socket that listens on the address.
+*/
+Socket Listen(const std::string& host, uint16_t port) {
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+    return invalidSocket;
+  }
+  const Socket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (s == invalidSocket) {
+    return invalidSocket;
+  }
+  const int reuse = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+  if (bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(s, 16) != 0) {
+    CloseSocket(s);
+    return invalidSocket;
+  }
+  return s;
+}
+
+/** Connect to the coordinator.
+
+  The connection is tried again for a while, so the workers can be started
+  before the coordinator.
+*/
+Socket Connect(const std::string& host, uint16_t port) {
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+    return invalidSocket;
+  }
+  for (int i = 0; i < 50; ++i) {
+    const Socket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == invalidSocket) {
+      return invalidSocket;
+    }
+    if (connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+      const int noDelay = 1;
+      setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+      return s;
+    }
+    CloseSocket(s);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  return invalidSocket;
+}
+
+/** Estimate the conversion time of each file from the PNG header.
+
+  Only the header is read, so it is far faster than the conversion.
+
+  @param entries       the files.
+  @param outputFormat  Q_FORMAT_??? that is passed to the workers. if
+                       Q_FORMAT_UNKNOWN, it is guessed by the alpha channel.
+  @param maxLevel      the maximum number of mip levels that is passed to
+                       the workers.
+*/
+void EstimateCosts(std::vector<Entry>& entries, uint32_t outputFormat, uint32_t maxLevel) {
+  Parallel::for_each(static_cast<uint32_t>(entries.size()), 0, [&](uint32_t i) {
+    Image::PngHeader header;
+    if (!Image::read_png_header(entries[i].infilename, &header)) {
+      return;
+    }
+    uint32_t format = outputFormat;
+    if (format == Q_FORMAT_UNKNOWN) {
+      format = header.hasAlpha ? Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA : Q_FORMAT_ETC1_RGB8;
+    }
+    entries[i].cost = EstimateConvertCost(header.width, header.height, format, maxLevel);
+  });
+}
+
+/** Write the result of each file as the tab separated values.
+*/
+bool WriteStats(const std::string& filename, const std::vector<Entry>& entries) {
+  std::ofstream ofs(filename.c_str());
+  if (!ofs) {
+    return false;
+  }
+  ofs << "infile\toutfile\tresult\tattempts\tworker\tinBytes\toutBytes\tusec\tcost\n";
+  for (const auto& e : entries) {
+    ofs << e.infilename << '\t' << e.outfilename << '\t' << e.result << '\t' << e.attempts << '\t' <<
+      e.worker << '\t' << e.inBytes << '\t' << e.outBytes << '\t' << e.usec << '\t' << e.cost << '\n';
+  }
+  return !ofs.bad();
+}
+
+} // unnamed namespace
+
+/** Run the coordinator.
+
+  usage: coordinator [-host address] [-port number] [-shard count] [-retry count] [-f format] [-m count] [-o statsfile] [-l manifest] [file...]
+
+  Each line of the manifest is 'infile' or 'infile<TAB>outfile'.
+  The files are dispatched in the descending order of the cost that is
+  estimated from the PNG header. '-f' and '-m' should be same as the workers
+  to estimate it well.
+
+  @param argc  the number of arguments after the subcommand.
+  @param argv  the arguments after the subcommand.
+
+  @return the exit code. 0 if all files are converted, otherwise 1.
+*/
+int RunCoordinator(int argc, char** argv) {
+  std::string host = "127.0.0.1";
+  uint16_t port = defaultPort;
+  uint32_t shardSize = 16;
+  uint32_t retryCount = 2;
+  uint32_t outputFormat = Q_FORMAT_UNKNOWN;
+  uint32_t maxLevel = 1;
+  std::string statsFilename;
+  std::vector<std::string> lines;
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-host") == 0 && i + 1 < argc) {
+      host = argv[++i];
+    } else if (strcmp(argv[i], "-port") == 0 && i + 1 < argc) {
+      port = static_cast<uint16_t>(std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-shard") == 0 && i + 1 < argc) {
+      shardSize = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-retry") == 0 && i + 1 < argc) {
+      retryCount = std::max(0, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      const TextureFormat::Traits* pTraits = TextureFormat::find_by_name(argv[++i]);
+      if (!pTraits || !pTraits->isCompressed) {
+        std::cout << "Error: '" << argv[i] << "' is unknown format." << std::endl;
+        return 1;
+      }
+      outputFormat = pTraits->qformat;
+    } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      maxLevel = std::max(1, std::min(16, std::atoi(argv[++i])));
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      statsFilename = argv[++i];
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      if (!ReadFileList(argv[++i], lines)) {
+        std::cout << "Error: can't read '" << argv[i] << "'." << std::endl;
+        return 1;
+      }
+    } else {
+      lines.push_back(argv[i]);
+    }
+  }
+  std::vector<Entry> entries(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const size_t tabPos = lines[i].find('\t');
+    entries[i].infilename = lines[i].substr(0, tabPos);
+    entries[i].outfilename = tabPos == std::string::npos ? GetOutputFileName(entries[i].infilename) : lines[i].substr(tabPos + 1);
+  }
+  EstimateCosts(entries, outputFormat, maxLevel);
+
+  SocketLibrary library;
+  const Socket listener = library.isInitialized ? Listen(host, port) : invalidSocket;
+  if (listener == invalidSocket) {
+    std::cout << "Error: can't listen on " << host << ":" << port << "." << std::endl;
+    return 1;
+  }
+  std::cout << "Listening on " << host << ":" << port << ", " << entries.size() << " files." << std::endl;
+
+  const auto start = std::chrono::steady_clock::now();
+  Coordinator coordinator(entries, shardSize, retryCount);
+  uint32_t nextId = 1;
+  while (!coordinator.is_finished()) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(listener, &readSet);
+    Socket maxSocket = listener;
+    for (const auto& e : coordinator.workers) {
+      FD_SET(e.socket, &readSet);
+      maxSocket = std::max(maxSocket, e.socket);
+    }
+    if (select(static_cast<int>(maxSocket + 1), &readSet, nullptr, nullptr, nullptr) < 0) {
+      std::cout << "Error: select() is failed." << std::endl;
+      break;
+    }
+    if (FD_ISSET(listener, &readSet)) {
+      const Socket s = accept(listener, nullptr, nullptr);
+      if (s != invalidSocket) {
+        const int noDelay = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+        Worker worker = {};
+        worker.socket = s;
+        worker.id = nextId++;
+        coordinator.workers.push_back(worker);
+      }
+    }
+    for (size_t i = 0; i < coordinator.workers.size(); ) {
+      Worker& worker = coordinator.workers[i];
+      bool isAlive = true;
+      if (FD_ISSET(worker.socket, &readSet)) {
+        isAlive = worker.reader.receive(worker.socket);
+        for (std::string line; isAlive && worker.reader.get_line(line); ) {
+          isAlive = coordinator.on_line(worker, line);
+        }
+      }
+      if (isAlive) {
+        ++i;
+        continue;
+      }
+      coordinator.on_disconnect(worker);
+      CloseSocket(worker.socket);
+      coordinator.workers.erase(coordinator.workers.begin() + i);
+    }
+  }
+  for (const auto& e : coordinator.workers) {
+    SendText(e.socket, "DONE\n");
+    CloseSocket(e.socket);
+  }
+  CloseSocket(listener);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Merge the stats of each file.
+  size_t okCount = 0;
+  uint64_t inBytes = 0;
+  uint64_t outBytes = 0;
+  uint64_t usec = 0;
+  std::vector<uint32_t> fileCounts(nextId, 0);
+  for (const auto& e : entries) {
+    if (e.result == ConvertResult_Success) {
+      ++okCount;
+    } else {
+      std::cout << "error " << e.infilename << ": result " << e.result << " after " << e.attempts << " attempt(s)." << std::endl;
+    }
+    inBytes += e.inBytes;
+    outBytes += e.outBytes;
+    usec += e.usec;
+    ++fileCounts[e.worker];
+  }
+  for (uint32_t id = 1; id < nextId; ++id) {
+    std::cout << "worker " << id << ": " << fileCounts[id] << " files." << std::endl;
+  }
+  std::cout << entries.size() << " files, " << okCount << " ok, " << (entries.size() - okCount) << " error(s), " <<
+    coordinator.retriedCount << " retries, " << coordinator.stolenCount << " steals, " << inBytes << " -> " << outBytes << " bytes, " <<
+    std::fixed << std::setprecision(3) << (usec / 1000000.0) << " sec in workers, " << seconds << " sec." << std::endl;
+  if (!statsFilename.empty() && !WriteStats(statsFilename, entries)) {
+    std::cout << "Error: can't write '" << statsFilename << "'." << std::endl;
+    return 1;
+  }
+  return okCount == entries.size() ? 0 : 1;
+}
+
+/** Run the worker.
+
+  usage: worker [-host address] [-port number] [-prefetch count] [options...]
+
+  The options are same as the conversion, and are applied to all files.
+  The files are converted by Pipeline::run(), and '-prefetch' files(the
+  default is 2) are requested and read ahead of the encoding.
+
+  @param argc  the number of arguments after the subcommand.
+  @param argv  the arguments after the subcommand.
+
+  @return the exit code.
+*/
+int RunWorker(int argc, char** argv) {
+  std::string host = "127.0.0.1";
+  uint16_t port = defaultPort;
+  uint32_t prefetchCount = 2;
+  std::vector<char*> rest;
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-host") == 0 && i + 1 < argc) {
+      host = argv[++i];
+    } else if (strcmp(argv[i], "-port") == 0 && i + 1 < argc) {
+      port = static_cast<uint16_t>(std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-prefetch") == 0 && i + 1 < argc) {
+      prefetchCount = std::max(1, std::atoi(argv[++i]));
+    } else {
+      rest.push_back(argv[i]);
+    }
+  }
+  ConvertOptions baseOptions;
+  rest.push_back(nullptr);
+  if (!ParseConvertOptions(static_cast<int>(rest.size() - 1), rest.data(), baseOptions)) {
+    return 1;
+  }
+
+  SocketLibrary library;
+  const Socket s = library.isInitialized ? Connect(host, port) : invalidSocket;
+  if (s == invalidSocket) {
+    std::cout << "Error: can't connect to " << host << ":" << port << "." << std::endl;
+    return 1;
+  }
+
+#ifdef FREE_IMAGE_STATIC_LIBRARY
+  FreeImage_Initialise(FALSE);
+#endif // FREE_ISTATIC_LIBRARY
+
+  // NEXT is sent on the read thread of the pipeline, and RESULT is sent on
+  // the write thread. Only the read thread receives the lines.
+  LineReader reader;
+  std::mutex sendMutex;
+  std::atomic<bool> isFailed(false);
+  const auto next = [&](Pipeline::Input& input) {
+    for (;;) {
+      {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (!SendText(s, "NEXT\n")) {
+          isFailed = true;
+          return false;
+        }
+      }
+      std::string line;
+      while (!reader.get_line(line)) {
+        if (!reader.receive(s)) {
+          line.clear();
+          break;
+        }
+      }
+      if (line.compare(0, 5, "FILE ") == 0) {
+        const size_t tab1 = line.find('\t');
+        const size_t tab2 = line.find('\t', tab1 + 1);
+        if (tab1 == std::string::npos || tab2 == std::string::npos) {
+          isFailed = true;
+          return false;
+        }
+        input.id = static_cast<uint32_t>(std::strtoul(line.c_str() + 5, nullptr, 10));
+        input.options = baseOptions;
+        input.options.infilename = line.substr(tab1 + 1, tab2 - tab1 - 1);
+        input.options.outfilename = line.substr(tab2 + 1);
+        return true;
+      } else if (line == "WAIT") {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      } else {
+        // DONE, or the coordinator is closed.
+        return false;
+      }
+    }
+  };
+  const auto onResult = [&](const Pipeline::Result& result) {
+    const ConvertOptions& options = result.input.options;
+    uint64_t outBytes = 0;
+    if (result.code == ConvertResult_Success) {
+      outBytes = GetFileSize(options.outfilename);
+      if (options.alphaLayout == AlphaLayout_Separate) {
+        outBytes += GetFileSize(GetAlphaFileName(options.outfilename));
+      }
+    }
+    std::ostringstream ss;
+    ss << "RESULT " << result.input.id << " " << static_cast<int>(result.code) << " " << result.inBytes << " " << outBytes << " " << result.usec << "\n";
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if (!SendText(s, ss.str())) {
+      isFailed = true;
+    }
+  };
+  Pipeline::run(next, onResult, prefetchCount);
+  const int exitCode = isFailed ? 1 : 0;
+  CloseSocket(s);
+
+#ifdef FREE_IMAGE_STATIC_LIBRARY
+  FreeImage_Deinitialise();
+#endif // FREE_ISTATIC_LIBRARY
+  return exitCode;
+}
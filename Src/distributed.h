@@ -0,0 +1,18 @@
+/**
+  @file distributed.h
+
+  Distribute the conversion of many files to the worker processes.
+
+  The coordinator reads the manifest and splits it into the shards. The
+  workers connect to the coordinator by TCP, and take the files one by one
+  from their shards. The idle worker steals the latter half of the shard of
+  the busiest worker, and the files that are failed are retried on the next
+  request of any worker.
+*/
+#ifndef DISTRIBUTED_H_INCLUDED
+#define DISTRIBUTED_H_INCLUDED
+
+int RunCoordinator(int argc, char** argv);
+int RunWorker(int argc, char** argv);
+
+#endif // DISTRIBUTED_H_INCLUDED
@@ -0,0 +1,190 @@
+/**
+  @file edgetest.cpp
+*/
+#include "edgetest.h"
+#include "convert.h"
+#include "cmdline.h"
+#include "arena.h"
+#include "format.h"
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstring>
+
+namespace /* unnamed */ {
+
+/// The image sizes that have the partial blocks at the edges.
+const uint32_t sizeList[][2] = { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 3, 5 }, { 5, 7 }, { 301, 203 } };
+
+/// The formats that are tested.
+const uint32_t formatList[] = { Q_FORMAT_ETC1_RGB8, Q_FORMAT_ATC_RGBA_EXPLICIT_ALPHA, Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA };
+
+/// The pairs of the size and its nearest power of two. the middle goes to the larger.
+const uint32_t powerOfTwoList[][2] = {
+  { 1, 1 }, { 2, 2 }, { 3, 4 }, { 5, 4 }, { 6, 8 }, { 7, 8 }, { 11, 8 }, { 12, 16 },
+  { 203, 256 }, { 301, 256 }, { 383, 256 }, { 384, 512 }, { 1023, 1024 }, { 1024, 1024 },
+};
+
+/** Fill the image with the pseudo random pixels.
+*/
+void FillImage(const Image::Bitmap& image, uint32_t seed) {
+  uint32_t x = seed * 2654435761U + 1;
+  for (uint32_t y = 0; y < image.height; ++y) {
+    uint8_t* p = image.row(y);
+    for (uint32_t i = 0; i < image.width * image.bytesPerPixel; ++i) {
+      x = x * 1664525U + 1013904223U;
+      p[i] = static_cast<uint8_t>(x >> 24);
+    }
+  }
+}
+
+/** Compress the image after copying it to the padded image.
+
+  The padded pixels repeat the edge pixels. It is the reference of
+  EncodeImage() that fetches the edge blocks without the copy.
+*/
+bool EncodePadded(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t format, std::vector<uint8_t>& out) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(format);
+  const uint32_t bpp = image.bytesPerPixel;
+  const uint32_t w = (image.width + traits.blockWidth - 1) / traits.blockWidth * traits.blockWidth;
+  const uint32_t h = (image.height + traits.blockHeight - 1) / traits.blockHeight * traits.blockHeight;
+  std::vector<uint8_t> buffer(Image::get_size(w, h, bpp));
+  const Image::Bitmap padded = Image::make_bitmap(buffer.data(), w, h, bpp);
+  for (uint32_t y = 0; y < h; ++y) {
+    const uint8_t* src = image.row(std::min(y, image.height - 1));
+    for (uint32_t x = 0; x < w; ++x) {
+      memcpy(padded.row(y) + x * bpp, src + std::min(x, image.width - 1) * bpp, bpp);
+    }
+  }
+  out.resize(TextureFormat::get_image_size(traits, image.width, image.height));
+  return Encoder::encode(encoder, padded, format, nullptr, out.data(), static_cast<uint32_t>(out.size()));
+}
+
+/** Compare EncodeImage() with the padded image.
+
+  @retval true  the blocks are same.
+  @retval false the blocks are different, or the encoder fails.
+*/
+bool TestImage(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t format) {
+  const uint32_t size = TextureFormat::get_image_size(*TextureFormat::find(format), image.width, image.height);
+  std::vector<uint8_t> actual(size);
+  std::vector<uint8_t> expected;
+  return EncodeImage(encoder, image, format, actual.data(), size) && EncodePadded(encoder, image, format, expected) && actual == expected;
+}
+
+/** Compare EncodeMipChain() with the levels that are made and padded one by one.
+
+  The small levels at the tail are encoded in one atlas by EncodeMipChain(),
+  so it tests the edges of the levels down to 1x1.
+
+  @return the first different level. if all levels are same, -1.
+*/
+int TestMipChain(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t format, Image::Filter filter, Arena& arena) {
+  const uint32_t maxLevel = 16;
+  arena.reset();
+  arena.reserve(GetMipChainArenaSize(image, format, maxLevel, filter, false));
+  KTX::File ktx;
+  if (!EncodeMipChain(encoder, image, format, maxLevel, filter, false, 2, arena, ktx)) {
+    return 0;
+  }
+  const uint32_t bpp = image.bytesPerPixel;
+  std::vector<uint8_t> work(Image::get_mip_work_size(image.width, image.height, bpp, filter, false));
+  std::vector<uint8_t> buffers[2];
+  Image::Bitmap current = image;
+  std::vector<uint8_t> expected;
+  for (size_t level = 0; level < ktx.data.size(); ++level) {
+    const KTX::File::Data& data = ktx.data[level];
+    if (!EncodePadded(encoder, current, format, expected) || data.imageSize != expected.size() || memcmp(data.bytes(), expected.data(), expected.size()) != 0) {
+      return static_cast<int>(level);
+    }
+    std::vector<uint8_t>& buffer = buffers[level & 1];
+    const uint32_t w = std::max(current.width / 2, 1U);
+    const uint32_t h = std::max(current.height / 2, 1U);
+    buffer.resize(Image::get_size(w, h, bpp));
+    const Image::Bitmap next = Image::make_bitmap(buffer.data(), w, h, bpp);
+    Image::make_mip(current, next, filter, false, work.data(), 1);
+    current = next;
+  }
+  return ktx.data.size() == GetMipLevelCount(image.width, image.height, maxLevel) ? -1 : 0;
+}
+
+} // unnamed namespace
+
+/** Test the partial blocks at the edges of the odd size images.
+
+  usage: edgetest [options...]
+
+  The images of the odd sizes down to 1x1 are encoded by EncodeImage() and
+  EncodeMipChain(), and the blocks are compared with the image that is
+  padded by the copy. Each image is tested in the memory order of the PNG
+  file(bottom-up) and flipped, at 24 and 32bit. GetNearestPowerOfTwo() of
+  '-p' is also tested. The options are same as the conversion, and
+  '-encoder' and '-filter' are used.
+
+  @param argc  the number of arguments after the subcommand.
+  @param argv  the arguments after the subcommand.
+
+  @return the exit code. 0 if all tests pass, otherwise 1.
+*/
+int RunEdgeTest(int argc, char** argv) {
+  ConvertOptions options;
+  std::vector<std::string> filenames;
+  if (!ParseConvertOptions(argc, argv, options, &filenames)) {
+    return 1;
+  }
+  if (!filenames.empty()) {
+    std::cout << "Error: 'edgetest' takes no file." << std::endl;
+    return 1;
+  }
+  const Encoder::IBlockEncoder& encoder = *options.encoder;
+
+  size_t caseCount = 0;
+  size_t errorCount = 0;
+  for (const auto& e : powerOfTwoList) {
+    ++caseCount;
+    const uint32_t result = GetNearestPowerOfTwo(e[0]);
+    if (result != e[1]) {
+      std::cout << "error    GetNearestPowerOfTwo(" << e[0] << ") is " << result << ", expected " << e[1] << "." << std::endl;
+      ++errorCount;
+    }
+  }
+
+  Arena arena;
+  for (const auto& size : sizeList) {
+    for (uint32_t bpp = 3; bpp <= 4; ++bpp) {
+      std::vector<uint8_t> buffer(Image::get_size(size[0], size[1], bpp));
+      const Image::Bitmap flipped = Image::make_bitmap(buffer.data(), size[0], size[1], bpp);
+      FillImage(flipped, size[0] * 1000 + size[1] * 10 + bpp);
+      // PngFile has the rows from bottom to top, and it is the view of the negative pitch.
+      Image::Bitmap bottomUp = flipped;
+      bottomUp.bits = flipped.row(flipped.height - 1);
+      bottomUp.pitch = -flipped.pitch;
+      const Image::Bitmap* const views[] = { &bottomUp, &flipped };
+      const char* const viewNames[] = { "bottom-up", "flipped" };
+      for (int view = 0; view < 2; ++view) {
+        const Image::Bitmap& image = *views[view];
+        for (uint32_t format : formatList) {
+          const TextureFormat::Traits& traits = *TextureFormat::find(format);
+          if (!(encoder.get_capabilities(format) & Encoder::Capability_Encode)) {
+            continue;
+          }
+          const std::string name = std::to_string(size[0]) + "x" + std::to_string(size[1]) + " " + std::to_string(bpp * 8) + "bit " + viewNames[view] + " " + traits.name;
+          ++caseCount;
+          if (!TestImage(encoder, image, format)) {
+            std::cout << "error    " << name << ": EncodeImage() differs from the padded image." << std::endl;
+            ++errorCount;
+          }
+          ++caseCount;
+          const int level = TestMipChain(encoder, image, format, options.mipFilter, arena);
+          if (level >= 0) {
+            std::cout << "error    " << name << ": the level " << level << " of EncodeMipChain() differs from the padded image." << std::endl;
+            ++errorCount;
+          }
+        }
+      }
+    }
+  }
+  std::cout << caseCount << " cases by " << encoder.name() << ", " << errorCount << " error(s)." << std::endl;
+  return errorCount ? 1 : 0;
+}
@@ -0,0 +1,11 @@
+/**
+  @file edgetest.h
+
+  Test the partial blocks at the edges of the odd size images.
+*/
+#ifndef EDGETEST_H_INCLUDED
+#define EDGETEST_H_INCLUDED
+
+int RunEdgeTest(int argc, char** argv);
+
+#endif // EDGETEST_H_INCLUDED
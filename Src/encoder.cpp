@@ -0,0 +1,285 @@
+/**
+  @file encoder.cpp
+*/
+#include "encoder.h"
+#include "blockcodec.h"
+#include "decoder.h"
+#include "simd.h"
+#include "format.h"
+#include "convert.h"
+#include <TextureConverter.h>
+#include <FreeImage.h>
+#include <cstring>
+
+namespace Encoder {
+
+namespace /* unnamed */ {
+
+#if ATCCONV_USE_QONVERT
+
+/** Create TQonvertImage structure.
+
+  @param data    the pointer to the raw image data.
+  @param w       the pixel width of the image.
+  @param h       the pixel height of the image.
+  @param foramt  Q_FORMAT_???
+
+  @return TQonvertImage object created with the parameter.
+*/
+TQonvertImage TQonvertImage_Create( void* data, uint32_t w, uint32_t h, uint32_t format) {
+  TQonvertImage n;
+  n.nWidth = w;
+  n.nHeight = h;
+  n.nFormat = format;
+  n.pFormatFlags = nullptr;
+  n.nDataSize = data ? w * h * GetBytePerPixel(format) : 0;
+  n.pData = reinterpret_cast<unsigned char*>(data);
+  n.compressionOptions = nullptr;
+  return n;
+}
+
+/** Compress the image whose size is the multiple of the block by Qonvert.
+
+  @param image        the source image.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param pOut         the buffer to store the compressed image.
+  @param outSize      the byte size of pOut.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeByQonvert(const Image::Bitmap& image, uint32_t outputFormat, uint8_t* pOut, uint32_t outSize) {
+  // Qonvert accepts only the positive stride, so the bottom-up image is passed
+  // from the bottom row, and flipped by Qonvert.
+  const bool bottomUp = image.pitch < 0;
+  uint8_t* pBits = bottomUp ? image.row(image.height - 1) : image.bits;
+  const uint32_t stride = static_cast<uint32_t>(bottomUp ? -image.pitch : image.pitch);
+
+  TFormatFlags srcFlags = { 0 };
+  srcFlags.nStride = stride;
+  srcFlags.nMaskRed   = FI_RGBA_RED_MASK;
+  srcFlags.nMaskGreen = FI_RGBA_GREEN_MASK;
+  srcFlags.nMaskBlue  = FI_RGBA_BLUE_MASK;
+  srcFlags.nMaskAlpha = image.bytesPerPixel == 3 ? 0 : FI_RGBA_ALPHA_MASK;
+
+  TFormatFlags destFlags = { 0 };
+  destFlags.nFlipY = bottomUp;
+
+  TQonvertImage  src = TQonvertImage_Create(pBits, image.width, image.height, image.bytesPerPixel == 3 ? Q_FORMAT_RGB_8I : Q_FORMAT_RGBA_8I);
+  src.pFormatFlags = &srcFlags;
+  src.nDataSize = stride * image.height;
+
+  // The size of the block compressed image is known by the format traits, so
+  // Qonvert isn't asked for the buffer size.
+  TQonvertImage  dest = TQonvertImage_Create(nullptr, image.width, image.height, outputFormat);
+  dest.pFormatFlags = &destFlags;
+  dest.nDataSize = outSize;
+  dest.pData = pOut;
+  return Qonvert(&src, &dest) == Q_SUCCESS;
+}
+
+/** Decompress the image by Qonvert.
+
+  @param pData   the compressed image data.
+  @param size    the byte size of pData.
+  @param format  Q_FORMAT_??? of pData.
+  @param image   the image to store the pixels. its bytesPerPixel should be 4,
+                 and its pitch should be positive.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool DecodeByQonvert(const uint8_t* pData, uint32_t size, uint32_t format, const Image::Bitmap& image) {
+  const TextureFormat::Traits& traits = *TextureFormat::find(format);
+  TFormatFlags srcFlags = { 0 };
+  if (!traits.isCompressed) {
+    // The rows of the uncompressed KTX image are aligned to 4 bytes.
+    srcFlags.nStride = (image.width * traits.bytesPerBlock + 3) & ~3U;
+  }
+  TQonvertImage  src = TQonvertImage_Create(const_cast<uint8_t*>(pData), image.width, image.height, format);
+  src.pFormatFlags = &srcFlags;
+  src.nDataSize = size;
+
+  TFormatFlags destFlags = { 0 };
+  destFlags.nStride = static_cast<uint32_t>(image.pitch);
+  destFlags.nMaskRed   = FI_RGBA_RED_MASK;
+  destFlags.nMaskGreen = FI_RGBA_GREEN_MASK;
+  destFlags.nMaskBlue  = FI_RGBA_BLUE_MASK;
+  destFlags.nMaskAlpha = FI_RGBA_ALPHA_MASK;
+  TQonvertImage  dest = TQonvertImage_Create(image.bits, image.width, image.height, Q_FORMAT_RGBA_8I);
+  dest.pFormatFlags = &destFlags;
+  dest.nDataSize = image.pitch * image.height;
+  return Qonvert(&src, &dest) == Q_SUCCESS;
+}
+
+/** The encoder by Qonvert.
+*/
+class QonvertEncoder : public IBlockEncoder {
+public:
+  virtual const char* name() const { return "qonvert"; }
+  virtual uint32_t get_capabilities(uint32_t format) const {
+    const TextureFormat::Traits* pTraits = TextureFormat::find(format);
+    if (!pTraits) {
+      return 0;
+    }
+    return pTraits->isCompressed ? Capability_Encode | Capability_Decode : Capability_Decode;
+  }
+  virtual bool encode(const Image::Bitmap& image, uint32_t outputFormat, const Image::Bitmap*, uint8_t* pOut, uint32_t outSize) const {
+    return EncodeByQonvert(image, outputFormat, pOut, outSize);
+  }
+  virtual bool decode(const uint8_t* pData, uint32_t size, uint32_t format, const Image::Bitmap& image) const {
+    return DecodeByQonvert(pData, size, format, image);
+  }
+};
+
+const QonvertEncoder qonvertEncoder;
+#endif // ATCCONV_USE_QONVERT
+
+/** The encoder by BlockCodec.
+*/
+class NativeEncoder : public IBlockEncoder {
+public:
+  NativeEncoder(const char* n, BlockCodec::Kernel k, BlockCodec::Effort e) : encoderName(n), kernel(k), effort(e) {}
+  virtual const char* name() const { return encoderName; }
+  virtual uint32_t get_capabilities(uint32_t format) const {
+    const TextureFormat::Traits* pTraits = TextureFormat::find(format);
+    if (!pTraits) {
+      return 0;
+    }
+    return pTraits->isCompressed ? Capability_Encode | Capability_Decode : Capability_Decode;
+  }
+  virtual bool encode(const Image::Bitmap& image, uint32_t outputFormat, const Image::Bitmap* pImportance, uint8_t* pOut, uint32_t outSize) const {
+    return BlockCodec::encode_image(image, outputFormat, kernel, effort, pImportance, pOut, outSize);
+  }
+  virtual bool decode(const uint8_t* pData, uint32_t size, uint32_t format, const Image::Bitmap& image) const {
+    return Decoder::decode_image(pData, size, format, image, Decoder::Order_BGRA, kernel, 1);
+  }
+
+private:
+  const char* encoderName;
+  BlockCodec::Kernel kernel;
+  BlockCodec::Effort effort;
+};
+
+const NativeEncoder scalarEncoder("scalar", BlockCodec::Kernel_Scalar, BlockCodec::Effort_Full);
+#if ATCCONV_HAS_SSE2
+const NativeEncoder sse2Encoder("sse2", BlockCodec::Kernel_SSE2, BlockCodec::Effort_Full);
+#endif // ATCCONV_HAS_SSE2
+const NativeEncoder previewEncoder("preview", BlockCodec::Kernel_Scalar, BlockCodec::Effort_Preview);
+
+/// The encoders that are built in. the first is the default.
+const IBlockEncoder* const encoderList[] = {
+#if ATCCONV_USE_QONVERT
+  &qonvertEncoder,
+#endif // ATCCONV_USE_QONVERT
+#if ATCCONV_HAS_SSE2
+  &sse2Encoder,
+#endif // ATCCONV_HAS_SSE2
+  &scalarEncoder,
+  &previewEncoder,
+};
+
+} // unnamed namespace
+
+/** Get the number of the encoders that are built in.
+*/
+size_t get_count()
+{
+  return sizeof(encoderList) / sizeof(encoderList[0]);
+}
+
+/** Get the encoder.
+
+  @param index  the index of the encoder. it should be less than get_count().
+*/
+const IBlockEncoder& get(size_t index)
+{
+  return *encoderList[index];
+}
+
+/** Find the encoder by the name.
+
+  "native" is the fastest native encoder.
+
+  @param name  the name of the encoder.
+
+  @return the pointer to the encoder. if it isn't built in, nullptr.
+*/
+const IBlockEncoder* find(const char* name)
+{
+  if (strcmp(name, "native") == 0) {
+#if ATCCONV_HAS_SSE2
+    return &sse2Encoder;
+#else
+    return &scalarEncoder;
+#endif // ATCCONV_HAS_SSE2
+  }
+  for (const IBlockEncoder* p : encoderList) {
+    if (strcmp(p->name(), name) == 0) {
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+/** Get the encoder that is used if it isn't selected.
+
+  @return qonvert if it is built in, otherwise the fastest native encoder.
+*/
+const IBlockEncoder& get_default()
+{
+  return *encoderList[0];
+}
+
+/** Get the encoder that defines the format.
+
+  It is the scalar native decoder, and it is used to measure the error of
+  the other encoders.
+*/
+const IBlockEncoder& get_reference()
+{
+  return scalarEncoder;
+}
+
+/** Compress the image by the encoder.
+
+  @param encoder      the encoder of the blocks.
+  @param image        the source image. its size should be the multiple of
+                      the block.
+  @param outputFormat Q_FORMAT_??? of the compressed image.
+  @param pImportance  the importance of each block. it may be nullptr.
+  @param pOut         the buffer to store the compressed image.
+  @param outSize      the byte size of pOut.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool encode(const IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, const Image::Bitmap* pImportance, uint8_t* pOut, uint32_t outSize)
+{
+  if (!(encoder.get_capabilities(outputFormat) & Capability_Encode)) {
+    return false;
+  }
+  return encoder.encode(image, outputFormat, pImportance, pOut, outSize);
+}
+
+/** Decompress the image by the encoder.
+
+  @param encoder the encoder of the blocks.
+  @param pData   the compressed image data.
+  @param size    the byte size of pData.
+  @param format  Q_FORMAT_??? of pData.
+  @param image   the image to store the pixels. its bytesPerPixel should be 4,
+                 and its pitch should be positive.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool decode(const IBlockEncoder& encoder, const uint8_t* pData, uint32_t size, uint32_t format, const Image::Bitmap& image)
+{
+  if (!(encoder.get_capabilities(format) & Capability_Decode)) {
+    return false;
+  }
+  return encoder.decode(pData, size, format, image);
+}
+
+} // namespace Encoder
@@ -0,0 +1,92 @@
+/**
+  @file encoder.h
+
+  Compress and decompress the block of the texture by the selected encoder.
+*/
+#ifndef ENCODER_H_INCLUDED
+#define ENCODER_H_INCLUDED
+#include "image.h"
+#include <cstdint>
+#include <cstddef>
+
+/// If it is 1, Qonvert of Adreno Texture Converter is built in.
+#ifndef ATCCONV_USE_QONVERT
+#ifdef _WIN32
+#define ATCCONV_USE_QONVERT 1
+#else
+#define ATCCONV_USE_QONVERT 0
+#endif
+#endif
+
+namespace Encoder {
+
+/** The capabilities of the encoder for each format.
+*/
+enum Capability {
+  Capability_Encode = 1, ///< the image can be compressed to the format.
+  Capability_Decode = 2, ///< the image of the format can be decompressed.
+};
+
+/** The interface of the encoder.
+
+  The encoder has no state, so an instance can be used by any number of
+  threads at the same time.
+*/
+class IBlockEncoder {
+public:
+  virtual ~IBlockEncoder() {}
+
+  /// the name used in the command line.
+  virtual const char* name() const = 0;
+
+  /** Get the capabilities.
+
+    @param format  Q_FORMAT_???.
+
+    @return the combination of Capability. 0 if the format isn't supported.
+  */
+  virtual uint32_t get_capabilities(uint32_t format) const = 0;
+
+  /** Compress the rectangle of 4x4 blocks.
+
+    @param image        the source image. its size should be the multiple of
+                        the block, and it may be the view of the part of the
+                        larger image.
+    @param outputFormat Q_FORMAT_??? of the compressed image.
+    @param pImportance  the importance of each block from 0 to 255. each
+                        pixel of it is a block of image. if it is nullptr,
+                        all blocks are 255. the encoder may ignore it.
+    @param pOut         the buffer to store the blocks in the row-major order.
+    @param outSize      the byte size of pOut.
+
+    @retval true  success.
+    @retval false failure.
+  */
+  virtual bool encode(const Image::Bitmap& image, uint32_t outputFormat, const Image::Bitmap* pImportance, uint8_t* pOut, uint32_t outSize) const = 0;
+
+  /** Decompress the image.
+
+    @param pData   the image data.
+    @param size    the byte size of pData.
+    @param format  Q_FORMAT_??? of pData.
+    @param image   the image to store the pixels. its bytesPerPixel should be
+                   4, and its pitch should be positive.
+
+    @retval true  success.
+    @retval false failure.
+  */
+  virtual bool decode(const uint8_t* pData, uint32_t size, uint32_t format, const Image::Bitmap& image) const = 0;
+};
+
+size_t get_count();
+const IBlockEncoder& get(size_t index);
+const IBlockEncoder* find(const char* name);
+const IBlockEncoder& get_default();
+const IBlockEncoder& get_reference();
+
+bool encode(const IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, const Image::Bitmap* pImportance, uint8_t* pOut, uint32_t outSize);
+bool decode(const IBlockEncoder& encoder, const uint8_t* pData, uint32_t size, uint32_t format, const Image::Bitmap& image);
+
+} // namespace Encoder
+
+#endif // ENCODER_H_INCLUDED
@@ -0,0 +1,447 @@
+/**
+  @file etc1.cpp
+
+  The block encoder and decoder of ETC1.
+
+  The block is 64bit big endian. It has 2 sub blocks of 2x4 or 4x2 pixels, and
+  each sub block has the base color and the table of the modifier. The pixel
+  is the base color plus the modifier selected by 2bit index.
+*/
+#include "blockcodec.h"
+#include "simd.h"
+#include <algorithm>
+#include <climits>
+
+namespace BlockCodec {
+
+namespace /* unnamed */ {
+
+/// The modifier tables. the index 0 is +a, 1 is +b, 2 is -a and 3 is -b.
+const int modifierTable[8][2] = {
+  { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+inline int GetModifier(int table, int index) {
+  const int m = modifierTable[table][index & 1];
+  return index & 2 ? -m : m;
+}
+
+inline int Clamp255(int n) { return n < 0 ? 0 : n > 255 ? 255 : n; }
+inline int Expand4(int n) { return n * 17; }
+inline int Expand5(int n) { return (n << 3) | (n >> 2); }
+
+/** Check the pixel belongs to the second sub block.
+
+  @param x     the x coordinate of the pixel in the block.
+  @param y     the y coordinate of the pixel in the block.
+  @param flip  false if the sub blocks are 2x4, true if they are 4x2.
+*/
+inline bool IsSecondSubBlock(int x, int y, bool flip) {
+  return flip ? y >= 2 : x >= 2;
+}
+
+/** The encoded sub block.
+*/
+struct SubBlock {
+  int color[3]; ///< the quantized base color.
+  int base[3]; ///< the expanded base color.
+  int table;
+  uint32_t indices; ///< 2bit index per pixel of the sub block, in the order of pixelList.
+  int error;
+};
+
+/** Find the best table and the indices of the sub block.
+
+  @param pRGBA      the pixels of the block.
+  @param pixelList  the 8 indices of the pixels in the sub block.
+  @param sb         the sub block whose base is set.
+*/
+void FitSubBlock(const uint8_t* pRGBA, const int* pixelList, SubBlock& sb) {
+  sb.error = INT_MAX;
+  for (int t = 0; t < 8; ++t) {
+    uint32_t indices = 0;
+    int error = 0;
+    for (int i = 0; i < 8; ++i) {
+      const uint8_t* p = pRGBA + pixelList[i] * 4;
+      int bestError = INT_MAX;
+      int bestIndex = 0;
+      for (int m = 0; m < 4; ++m) {
+        const int d = GetModifier(t, m);
+        int e = 0;
+        for (int c = 0; c < 3; ++c) {
+          const int diff = Clamp255(sb.base[c] + d) - p[c];
+          e += diff * diff;
+        }
+        if (e < bestError) {
+          bestError = e;
+          bestIndex = m;
+        }
+      }
+      indices |= bestIndex << (i * 2);
+      error += bestError;
+      if (error >= sb.error) {
+        break;
+      }
+    }
+    if (error < sb.error) {
+      sb.error = error;
+      sb.table = t;
+      sb.indices = indices;
+    }
+  }
+}
+
+#if ATCCONV_HAS_SSE2
+/** FitSubBlock() by SSE2.
+
+  The squared errors of 4 pixels are calculated at once. R and G are paired in
+  16bit lanes, and B is paired with 0 for _mm_madd_epi16().
+*/
+void FitSubBlockSSE2(const uint8_t* pRGBA, const int* pixelList, SubBlock& sb) {
+  __m128i rg[2];
+  __m128i b[2];
+  for (int g = 0; g < 2; ++g) {
+    int16_t rgLanes[8];
+    int16_t bLanes[8];
+    for (int i = 0; i < 4; ++i) {
+      const uint8_t* p = pRGBA + pixelList[g * 4 + i] * 4;
+      rgLanes[i * 2] = p[0];
+      rgLanes[i * 2 + 1] = p[1];
+      bLanes[i * 2] = p[2];
+      bLanes[i * 2 + 1] = 0;
+    }
+    rg[g] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgLanes));
+    b[g] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bLanes));
+  }
+  sb.error = INT_MAX;
+  for (int t = 0; t < 8; ++t) {
+    __m128i bestError[2] = { _mm_set1_epi32(INT_MAX), _mm_set1_epi32(INT_MAX) };
+    __m128i bestIndex[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+    for (int m = 0; m < 4; ++m) {
+      const int d = GetModifier(t, m);
+      const __m128i candRG = _mm_set1_epi32((Clamp255(sb.base[1] + d) << 16) | Clamp255(sb.base[0] + d));
+      const __m128i candB = _mm_set1_epi32(Clamp255(sb.base[2] + d));
+      const __m128i index = _mm_set1_epi32(m);
+      for (int g = 0; g < 2; ++g) {
+        const __m128i dRG = _mm_sub_epi16(rg[g], candRG);
+        const __m128i dB = _mm_sub_epi16(b[g], candB);
+        const __m128i e = _mm_add_epi32(_mm_madd_epi16(dRG, dRG), _mm_madd_epi16(dB, dB));
+        const __m128i less = _mm_cmplt_epi32(e, bestError[g]);
+        bestError[g] = _mm_or_si128(_mm_and_si128(less, e), _mm_andnot_si128(less, bestError[g]));
+        bestIndex[g] = _mm_or_si128(_mm_and_si128(less, index), _mm_andnot_si128(less, bestIndex[g]));
+      }
+    }
+    int32_t errors[8];
+    int32_t indexList[8];
+    for (int g = 0; g < 2; ++g) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(errors + g * 4), bestError[g]);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(indexList + g * 4), bestIndex[g]);
+    }
+    uint32_t indices = 0;
+    int error = 0;
+    for (int i = 0; i < 8; ++i) {
+      indices |= indexList[i] << (i * 2);
+      error += errors[i];
+    }
+    if (error < sb.error) {
+      sb.error = error;
+      sb.table = t;
+      sb.indices = indices;
+    }
+  }
+}
+#endif // ATCCONV_HAS_SSE2
+
+/** Get the average color of the sub block.
+*/
+void GetAverage(const uint8_t* pRGBA, const int* pixelList, int* pAverage) {
+  for (int c = 0; c < 3; ++c) {
+    int sum = 0;
+    for (int i = 0; i < 8; ++i) {
+      sum += pRGBA[pixelList[i] * 4 + c];
+    }
+    pAverage[c] = (sum + 4) / 8;
+  }
+}
+
+/** Get the expanded base colors of the sub blocks.
+
+  @param pIn   8 bytes of the block.
+  @param base  the array to store RGB of 2 sub blocks.
+*/
+void GetBaseColors(const uint8_t* pIn, int (*base)[3]) {
+  const bool diff = (pIn[3] & 2) != 0;
+  for (int c = 0; c < 3; ++c) {
+    if (diff) {
+      const int c1 = pIn[c] >> 3;
+      const int delta = static_cast<int>(static_cast<int8_t>(pIn[c] << 5)) >> 5;
+      base[0][c] = Expand5(c1);
+      base[1][c] = Expand5((c1 + delta) & 31);
+    } else {
+      base[0][c] = Expand4(pIn[c] >> 4);
+      base[1][c] = Expand4(pIn[c] & 15);
+    }
+  }
+}
+
+#if ATCCONV_HAS_SSE2
+/** Decompress ETC1 block by SSE2.
+
+  The 4 colors of each sub block are made by the saturated add and sub of the
+  modifiers at once. Each row selects the colors of 4 pixels by the masks of
+  their index bits, so the pixels are never handled one by one.
+*/
+void DecodeETC1BlockSSE2(const uint8_t* pIn, uint8_t* pRGBA) {
+  const bool flip = (pIn[3] & 1) != 0;
+  const int table[2] = { pIn[3] >> 5, (pIn[3] >> 2) & 7 };
+  int base[2][3];
+  GetBaseColors(pIn, base);
+  __m128i colors[2];
+  for (int s = 0; s < 2; ++s) {
+    const uint32_t color = base[s][0] | (base[s][1] << 8) | (base[s][2] << 16) | 0xff000000;
+    // The modifier of RGB in each byte. the lanes are the index 0 to 3.
+    const int a = modifierTable[table[s]][0] * 0x10101;
+    const int b = modifierTable[table[s]][1] * 0x10101;
+    colors[s] = _mm_subs_epu8(_mm_adds_epu8(_mm_set1_epi32(static_cast<int>(color)), _mm_setr_epi32(a, b, 0, 0)), _mm_setr_epi32(0, 0, a, b));
+  }
+  // The palettes of the upper and the lower rows. each lane has the color
+  // of the sub block of the pixel.
+  __m128i palette[2][4];
+  palette[0][0] = _mm_shuffle_epi32(colors[0], 0x00);
+  palette[0][1] = _mm_shuffle_epi32(colors[0], 0x55);
+  palette[0][2] = _mm_shuffle_epi32(colors[0], 0xaa);
+  palette[0][3] = _mm_shuffle_epi32(colors[0], 0xff);
+  palette[1][0] = _mm_shuffle_epi32(colors[1], 0x00);
+  palette[1][1] = _mm_shuffle_epi32(colors[1], 0x55);
+  palette[1][2] = _mm_shuffle_epi32(colors[1], 0xaa);
+  palette[1][3] = _mm_shuffle_epi32(colors[1], 0xff);
+  if (!flip) {
+    for (int i = 0; i < 4; ++i) {
+      palette[0][i] = palette[1][i] = _mm_unpacklo_epi64(palette[0][i], palette[1][i]);
+    }
+  }
+  const __m128i msb = _mm_set1_epi32((pIn[4] << 8) | pIn[5]);
+  const __m128i lsb = _mm_set1_epi32((pIn[6] << 8) | pIn[7]);
+  // The bit of the pixel is x * 4 + y.
+  __m128i bits = _mm_setr_epi32(1 << 0, 1 << 4, 1 << 8, 1 << 12);
+  for (int y = 0; y < 4; ++y) {
+    const __m128i* p = palette[y / 2];
+    const __m128i isMsb = _mm_cmpeq_epi32(_mm_and_si128(msb, bits), bits);
+    const __m128i isLsb = _mm_cmpeq_epi32(_mm_and_si128(lsb, bits), bits);
+    const __m128i lo = _mm_or_si128(_mm_and_si128(isLsb, p[1]), _mm_andnot_si128(isLsb, p[0]));
+    const __m128i hi = _mm_or_si128(_mm_and_si128(isLsb, p[3]), _mm_andnot_si128(isLsb, p[2]));
+    const __m128i v = _mm_or_si128(_mm_and_si128(isMsb, hi), _mm_andnot_si128(isMsb, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pRGBA + y * 16), v);
+    bits = _mm_slli_epi32(bits, 1);
+  }
+}
+#endif // ATCCONV_HAS_SSE2
+
+} // unnamed namespace
+
+/** Compress 4x4 pixels to ETC1.
+
+  All combinations of the flip and the individual/differential mode are
+  tried with the average colors of the sub blocks, and the one that has the
+  least squared error is selected. The search stops as soon as the error
+  reaches errorTarget.
+
+  @param pRGBA        16 pixels of the block.
+  @param kernel       the implementation of the search.
+  @param errorTarget  the squared error of RGB that is good enough. if it is
+                      0, all combinations are tried.
+  @param pOut         the buffer to store 8 bytes of the block.
+*/
+void encode_etc1_block(const uint8_t* pRGBA, Kernel kernel, int errorTarget, uint8_t* pOut)
+{
+  void (*fit)(const uint8_t*, const int*, SubBlock&) = FitSubBlock;
+#if ATCCONV_HAS_SSE2
+  if (kernel == Kernel_SSE2) {
+    fit = FitSubBlockSSE2;
+  }
+#endif // ATCCONV_HAS_SSE2
+  int bestError = INT_MAX;
+  SubBlock best[2];
+  bool bestFlip = false;
+  bool bestDiff = false;
+  for (int flip = 0; flip < 2 && bestError > errorTarget; ++flip) {
+    int pixelList[2][8];
+    int count[2] = {};
+    for (int i = 0; i < 16; ++i) {
+      const int x = i % 4;
+      const int y = i / 4;
+      const int s = IsSecondSubBlock(x, y, flip != 0);
+      pixelList[s][count[s]++] = i;
+    }
+    int average[2][3];
+    GetAverage(pRGBA, pixelList[0], average[0]);
+    GetAverage(pRGBA, pixelList[1], average[1]);
+    for (int diff = 0; diff < 2 && bestError > errorTarget; ++diff) {
+      SubBlock sb[2];
+      for (int c = 0; c < 3; ++c) {
+        if (diff) {
+          const int c1 = (average[0][c] * 31 + 127) / 255;
+          const int c2 = (average[1][c] * 31 + 127) / 255;
+          sb[0].color[c] = c1;
+          sb[1].color[c] = c1 + std::min(std::max(c2 - c1, -4), 3);
+          sb[0].base[c] = Expand5(sb[0].color[c]);
+          sb[1].base[c] = Expand5(sb[1].color[c]);
+        } else {
+          for (int s = 0; s < 2; ++s) {
+            sb[s].color[c] = (average[s][c] * 15 + 127) / 255;
+            sb[s].base[c] = Expand4(sb[s].color[c]);
+          }
+        }
+      }
+      fit(pRGBA, pixelList[0], sb[0]);
+      fit(pRGBA, pixelList[1], sb[1]);
+      const int error = sb[0].error + sb[1].error;
+      if (error < bestError) {
+        bestError = error;
+        best[0] = sb[0];
+        best[1] = sb[1];
+        bestFlip = flip != 0;
+        bestDiff = diff != 0;
+      }
+    }
+  }
+
+  for (int c = 0; c < 3; ++c) {
+    if (bestDiff) {
+      pOut[c] = static_cast<uint8_t>((best[0].color[c] << 3) | ((best[1].color[c] - best[0].color[c]) & 7));
+    } else {
+      pOut[c] = static_cast<uint8_t>((best[0].color[c] << 4) | best[1].color[c]);
+    }
+  }
+  pOut[3] = static_cast<uint8_t>((best[0].table << 5) | (best[1].table << 2) | (bestDiff << 1) | bestFlip);
+  uint32_t msb = 0;
+  uint32_t lsb = 0;
+  int count[2] = {};
+  for (int i = 0; i < 16; ++i) {
+    const int x = i % 4;
+    const int y = i / 4;
+    const int s = IsSecondSubBlock(x, y, bestFlip);
+    const uint32_t index = (best[s].indices >> (count[s]++ * 2)) & 3;
+    const int bit = x * 4 + y;
+    msb |= (index >> 1) << bit;
+    lsb |= (index & 1) << bit;
+  }
+  pOut[4] = static_cast<uint8_t>(msb >> 8);
+  pOut[5] = static_cast<uint8_t>(msb);
+  pOut[6] = static_cast<uint8_t>(lsb >> 8);
+  pOut[7] = static_cast<uint8_t>(lsb);
+}
+
+/** Compress 4x4 pixels to ETC1 without the search.
+
+  The sub blocks are always 2x4 pixels. The base color is the center of the
+  bounding box of the sub block, and both sub blocks use the single table that
+  covers the larger extent. The modifier is selected by the average offset of
+  RGB from the base color.
+
+  @param pRGBA  16 pixels of the block.
+  @param pOut   the buffer to store 8 bytes of the block.
+*/
+void encode_etc1_block_preview(const uint8_t* pRGBA, uint8_t* pOut)
+{
+  int lo[2][3] = { { 255, 255, 255 }, { 255, 255, 255 } };
+  int hi[2][3] = {};
+  for (int i = 0; i < 16; ++i) {
+    const int s = IsSecondSubBlock(i % 4, i / 4, false);
+    for (int c = 0; c < 3; ++c) {
+      lo[s][c] = std::min(lo[s][c], static_cast<int>(pRGBA[i * 4 + c]));
+      hi[s][c] = std::max(hi[s][c], static_cast<int>(pRGBA[i * 4 + c]));
+    }
+  }
+  int color[2][3];
+  bool diff = true;
+  int extent = 0;
+  for (int c = 0; c < 3; ++c) {
+    for (int s = 0; s < 2; ++s) {
+      color[s][c] = ((lo[s][c] + hi[s][c] + 1) / 2 * 31 + 127) / 255;
+      extent = std::max(extent, (hi[s][c] - lo[s][c] + 1) / 2);
+    }
+    const int delta = color[1][c] - color[0][c];
+    diff &= delta >= -4 && delta <= 3;
+  }
+  int base[2][3];
+  for (int c = 0; c < 3; ++c) {
+    for (int s = 0; s < 2; ++s) {
+      if (diff) {
+        base[s][c] = Expand5(color[s][c]);
+      } else {
+        color[s][c] = ((lo[s][c] + hi[s][c] + 1) / 2 * 15 + 127) / 255;
+        base[s][c] = Expand4(color[s][c]);
+      }
+    }
+  }
+  int table = 0;
+  while (table < 7 && modifierTable[table][1] < extent) {
+    ++table;
+  }
+  // The threshold between +a and +b for the sum of 3 channels.
+  const int threshold = (modifierTable[table][0] + modifierTable[table][1]) * 3 / 2;
+
+  for (int c = 0; c < 3; ++c) {
+    if (diff) {
+      pOut[c] = static_cast<uint8_t>((color[0][c] << 3) | ((color[1][c] - color[0][c]) & 7));
+    } else {
+      pOut[c] = static_cast<uint8_t>((color[0][c] << 4) | color[1][c]);
+    }
+  }
+  pOut[3] = static_cast<uint8_t>((table << 5) | (table << 2) | (diff << 1));
+  uint32_t msb = 0;
+  uint32_t lsb = 0;
+  for (int i = 0; i < 16; ++i) {
+    const int x = i % 4;
+    const int y = i / 4;
+    const int s = IsSecondSubBlock(x, y, false);
+    const uint8_t* p = pRGBA + i * 4;
+    const int offset = p[0] - base[s][0] + p[1] - base[s][1] + p[2] - base[s][2];
+    const uint32_t index = offset >= 0 ? (offset > threshold ? 1 : 0) : (-offset > threshold ? 3 : 2);
+    const int bit = x * 4 + y;
+    msb |= (index >> 1) << bit;
+    lsb |= (index & 1) << bit;
+  }
+  pOut[4] = static_cast<uint8_t>(msb >> 8);
+  pOut[5] = static_cast<uint8_t>(msb);
+  pOut[6] = static_cast<uint8_t>(lsb >> 8);
+  pOut[7] = static_cast<uint8_t>(lsb);
+}
+
+/** Decompress ETC1 block.
+
+  @param pIn     8 bytes of the block.
+  @param kernel  the implementation of the decoder.
+  @param pRGBA   the buffer to store 16 pixels. the alpha is 255.
+*/
+void decode_etc1_block(const uint8_t* pIn, Kernel kernel, uint8_t* pRGBA)
+{
+#if ATCCONV_HAS_SSE2
+  if (kernel == Kernel_SSE2) {
+    DecodeETC1BlockSSE2(pIn, pRGBA);
+    return;
+  }
+#endif // ATCCONV_HAS_SSE2
+  const bool flip = (pIn[3] & 1) != 0;
+  const int table[2] = { pIn[3] >> 5, (pIn[3] >> 2) & 7 };
+  int base[2][3];
+  GetBaseColors(pIn, base);
+  const uint32_t msb = (pIn[4] << 8) | pIn[5];
+  const uint32_t lsb = (pIn[6] << 8) | pIn[7];
+  for (int i = 0; i < 16; ++i) {
+    const int x = i % 4;
+    const int y = i / 4;
+    const int s = IsSecondSubBlock(x, y, flip);
+    const int bit = x * 4 + y;
+    const int index = (((msb >> bit) & 1) << 1) | ((lsb >> bit) & 1);
+    const int d = GetModifier(table[s], index);
+    uint8_t* p = pRGBA + i * 4;
+    for (int c = 0; c < 3; ++c) {
+      p[c] = static_cast<uint8_t>(Clamp255(base[s][c] + d));
+    }
+    p[3] = 255;
+  }
+}
+
+} // namespace BlockCodec
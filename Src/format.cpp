@@ -0,0 +1,23 @@
+/**
+  @file format.cpp
+*/
+#include "format.h"
+#include <cstring>
+
+namespace TextureFormat {
+
+/** Find the traits by the command line name.
+
+  @return the pointer to the traits. if name is unknown, nullptr.
+*/
+const Traits* find_by_name(const char* name)
+{
+  for (const Traits& e : traitsList) {
+    if (strcmp(e.name, name) == 0) {
+      return &e;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace TextureFormat
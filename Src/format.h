@@ -0,0 +1,87 @@
+/**
+  @file format.h
+
+  The compile-time properties of the pixel formats handled by the converter.
+*/
+#ifndef FORMAT_H_INCLUDED
+#define FORMAT_H_INCLUDED
+#include "ktx.h"
+#include <TextureConverter.h>
+#include <cstdint>
+#include <cstddef>
+
+namespace TextureFormat {
+
+/** OpenGL base internal formats.
+*/
+enum BaseFormat {
+  BaseFormat_RGB = 0x1907,
+  BaseFormat_RGBA = 0x1908,
+};
+
+/** The properties of the format.
+
+  The uncompressed format is regarded as the block format of 1x1 pixel.
+*/
+struct Traits {
+  uint32_t qformat; ///< Q_FORMAT_???.
+  const char* name; ///< the name used in the command line.
+  uint32_t glInternalFormat;
+  uint32_t glBaseInternalFormat;
+  uint32_t blockWidth;
+  uint32_t blockHeight;
+  uint32_t bytesPerBlock;
+  bool hasAlpha;
+  bool isCompressed;
+};
+
+/// The list of the supported formats.
+static constexpr Traits traitsList[] = {
+  { Q_FORMAT_RGB_8I, "rgb8", 0x8051, BaseFormat_RGB, 1, 1, 3, false, false },
+  { Q_FORMAT_RGBA_8I, "rgba8", 0x8058, BaseFormat_RGBA, 1, 1, 4, true, false },
+  { Q_FORMAT_ETC1_RGB8, "etc1", KTX::Format_ETC1, BaseFormat_RGB, 4, 4, 8, false, true },
+  { Q_FORMAT_ATC_RGBA_EXPLICIT_ALPHA, "atce", KTX::Format_ATC_E, BaseFormat_RGBA, 4, 4, 16, true, true },
+  { Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA, "atci", KTX::Format_ATC_I, BaseFormat_RGBA, 4, 4, 16, true, true },
+};
+static constexpr size_t traitsCount = sizeof(traitsList) / sizeof(traitsList[0]);
+
+/** Find the traits of Q_FORMAT_???.
+
+  @return the pointer to the traits. if qformat isn't supported, nullptr.
+*/
+constexpr const Traits* find(uint32_t qformat, size_t i = 0) {
+  return i >= traitsCount ? nullptr : traitsList[i].qformat == qformat ? &traitsList[i] : find(qformat, i + 1);
+}
+
+/** Find the traits of the OpenGL internal format.
+
+  @return the pointer to the traits. if glInternalFormat isn't supported, nullptr.
+*/
+constexpr const Traits* find_by_gl_format(uint32_t glInternalFormat, size_t i = 0) {
+  return i >= traitsCount ? nullptr : traitsList[i].glInternalFormat == glInternalFormat ? &traitsList[i] : find_by_gl_format(glInternalFormat, i + 1);
+}
+
+const Traits* find_by_name(const char* name);
+
+/** Get the byte size of the image.
+*/
+constexpr uint32_t get_image_size(const Traits& t, uint32_t w, uint32_t h) {
+  return ((w + t.blockWidth - 1) / t.blockWidth) * ((h + t.blockHeight - 1) / t.blockHeight) * t.bytesPerBlock;
+}
+
+/** Get imageSize of the mip level of KTX.
+
+  The row of the uncompressed format is padded to 4 bytes.
+*/
+constexpr uint32_t get_level_size(const Traits& t, uint32_t w, uint32_t h) {
+  return t.isCompressed ? get_image_size(t, w, h) : ((w * t.bytesPerBlock + 3) & ~3U) * h;
+}
+
+static_assert(get_image_size(*find(Q_FORMAT_ETC1_RGB8), 5, 3) == 2 * 1 * 8, "ETC1 is 8 bytes per 4x4 block");
+static_assert(get_image_size(*find(Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA), 1, 1) == 16, "ATC RGBA is 16 bytes per 4x4 block");
+static_assert(find(Q_FORMAT_RGB_8I)->bytesPerBlock == 3, "RGB8 is 3 bytes per pixel");
+static_assert(get_level_size(*find(Q_FORMAT_RGB_8I), 3, 2) == 12 * 2, "the row of RGB8 is padded to 4 bytes");
+
+} // namespace TextureFormat
+
+#endif // FORMAT_H_INCLUDED
@@ -0,0 +1,157 @@
+/**
+  @file image.cpp
+*/
+#include "image.h"
+#include <cstring>
+#include <algorithm>
+
+namespace Image {
+
+/** Create the view of the tightly packed top-down pixels.
+*/
+Bitmap make_bitmap(void* p, uint32_t w, uint32_t h, uint32_t bytesPerPixel)
+{
+  Bitmap bmp;
+  bmp.bits = static_cast<uint8_t*>(p);
+  bmp.width = w;
+  bmp.height = h;
+  bmp.pitch = static_cast<int32_t>(w * bytesPerPixel);
+  bmp.bytesPerPixel = bytesPerPixel;
+  return bmp;
+}
+
+/** Get the byte size of the tightly packed pixels.
+*/
+size_t get_size(uint32_t w, uint32_t h, uint32_t bytesPerPixel)
+{
+  return static_cast<size_t>(w) * h * bytesPerPixel;
+}
+
+/** Shrink the image to the next mip level with the 2x2 box filter.
+
+  @param src  the source image.
+  @param dst  the destination image. its size should be
+              max(src.width / 2, 1) x max(src.height / 2, 1), and it has the
+              same bytesPerPixel as src.
+
+  The last column and row of the odd sized source are clamped.
+*/
+void downsample(const Bitmap& src, const Bitmap& dst)
+{
+  const uint32_t bpp = src.bytesPerPixel;
+  const uint32_t xstep = src.width > 1 ? bpp : 0;
+  for (uint32_t y = 0; y < dst.height; ++y) {
+    const uint8_t* s0 = src.row(y * 2 < src.height ? y * 2 : src.height - 1);
+    const uint8_t* s1 = src.row(y * 2 + 1 < src.height ? y * 2 + 1 : src.height - 1);
+    uint8_t* d = dst.row(y);
+    for (uint32_t x = 0; x < dst.width; ++x) {
+      for (uint32_t c = 0; c < bpp; ++c) {
+        d[c] = static_cast<uint8_t>((s0[c] + s0[c + xstep] + s1[c] + s1[c + xstep] + 2) / 4);
+      }
+      s0 += bpp * 2;
+      s1 += bpp * 2;
+      d += bpp;
+    }
+  }
+}
+
+/** Copy the color channels.
+
+  @param src  the source image.
+  @param dst  the destination image of 3 bytes per pixel. its size should be
+              same as src.
+*/
+void copy_color(const Bitmap& src, const Bitmap& dst)
+{
+  for (uint32_t y = 0; y < dst.height; ++y) {
+    const uint8_t* s = src.row(y);
+    uint8_t* d = dst.row(y);
+    for (uint32_t x = 0; x < dst.width; ++x) {
+      d[0] = s[0];
+      d[1] = s[1];
+      d[2] = s[2];
+      s += src.bytesPerPixel;
+      d += 3;
+    }
+  }
+}
+
+/** Make the greyscale image from the alpha channel.
+
+  @param src  the source image. if it has no alpha channel, the alpha is
+              assumed to be 255.
+  @param dst  the destination image of 3 bytes per pixel. its size should be
+              same as src.
+*/
+void extract_alpha(const Bitmap& src, const Bitmap& dst)
+{
+  for (uint32_t y = 0; y < dst.height; ++y) {
+    const uint8_t* s = src.row(y);
+    uint8_t* d = dst.row(y);
+    for (uint32_t x = 0; x < dst.width; ++x) {
+      const uint8_t a = src.bytesPerPixel == 4 ? s[3] : 255;
+      d[0] = a;
+      d[1] = a;
+      d[2] = a;
+      s += src.bytesPerPixel;
+      d += 3;
+    }
+  }
+}
+
+/** Copy the rectangle of the image.
+
+  The pixels outside of the source are clamped to its edges, so the
+  rectangle can be read over the right and the bottom edges.
+
+  @param src  the source image.
+  @param x    the left of the rectangle in src.
+  @param y    the top of the rectangle in src.
+  @param dst  the destination image. its size is the size of the rectangle,
+              and it has the same bytesPerPixel as src.
+*/
+void fetch_clamped(const Bitmap& src, uint32_t x, uint32_t y, const Bitmap& dst)
+{
+  const uint32_t bpp = src.bytesPerPixel;
+  for (uint32_t j = 0; j < dst.height; ++j) {
+    const uint8_t* s = src.row(y + j < src.height ? y + j : src.height - 1);
+    uint8_t* d = dst.row(j);
+    for (uint32_t i = 0; i < dst.width; ++i) {
+      const uint32_t sx = x + i < src.width ? x + i : src.width - 1;
+      memcpy(d + i * bpp, s + sx * bpp, bpp);
+    }
+  }
+}
+
+/** Make the importance of each block from the mask image.
+
+  The mask is stretched to the blocks, and each block takes the highest
+  luminance of the mask pixels that it covers. So the thin line in the mask
+  is kept in the small mipmap level.
+
+  @param mask  the mask image. its size is independent of dst.
+  @param dst   the destination image of 1 byte per pixel. each pixel is a
+               block of the image that the mask is applied to.
+*/
+void make_importance_map(const Bitmap& mask, const Bitmap& dst)
+{
+  for (uint32_t y = 0; y < dst.height; ++y) {
+    const uint32_t y0 = static_cast<uint32_t>(static_cast<uint64_t>(y) * mask.height / dst.height);
+    const uint32_t y1 = std::max(y0 + 1, static_cast<uint32_t>((static_cast<uint64_t>(y + 1) * mask.height + dst.height - 1) / dst.height));
+    uint8_t* d = dst.row(y);
+    for (uint32_t x = 0; x < dst.width; ++x) {
+      const uint32_t x0 = static_cast<uint32_t>(static_cast<uint64_t>(x) * mask.width / dst.width);
+      const uint32_t x1 = std::max(x0 + 1, static_cast<uint32_t>((static_cast<uint64_t>(x + 1) * mask.width + dst.width - 1) / dst.width));
+      uint32_t importance = 0;
+      for (uint32_t my = y0; my < y1; ++my) {
+        const uint8_t* s = mask.row(my) + x0 * mask.bytesPerPixel;
+        for (uint32_t mx = x0; mx < x1; ++mx, s += mask.bytesPerPixel) {
+          importance = std::max(importance, (s[2] * 77U + s[1] * 150U + s[0] * 29U) >> 8);
+        }
+      }
+      d[x] = static_cast<uint8_t>(importance);
+    }
+  }
+}
+
+} // namespace Image
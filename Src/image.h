@@ -0,0 +1,39 @@
+/**
+  @file image.h
+
+  The uncompressed image that is passed through the conversion pipeline.
+*/
+#ifndef IMAGE_H_INCLUDED
+#define IMAGE_H_INCLUDED
+#include <cstdint>
+#include <cstddef>
+
+namespace Image {
+
+/** The view of 8bit per channel pixels.
+
+  The rows are ordered from top to bottom. If the pixels are stored from bottom
+  to top as FreeImage does, bits points to the last row in the memory and pitch
+  is negative. The view doesn't own the pixels.
+*/
+struct Bitmap {
+  uint8_t* bits; ///< the top row.
+  uint32_t width;
+  uint32_t height;
+  int32_t pitch; ///< the byte offset from a row to the row below.
+  uint32_t bytesPerPixel;
+
+  uint8_t* row(uint32_t y) const { return bits + static_cast<ptrdiff_t>(y) * pitch; }
+};
+
+Bitmap make_bitmap(void* p, uint32_t w, uint32_t h, uint32_t bytesPerPixel);
+size_t get_size(uint32_t w, uint32_t h, uint32_t bytesPerPixel);
+void downsample(const Bitmap& src, const Bitmap& dst);
+void copy_color(const Bitmap& src, const Bitmap& dst);
+void extract_alpha(const Bitmap& src, const Bitmap& dst);
+void fetch_clamped(const Bitmap& src, uint32_t x, uint32_t y, const Bitmap& dst);
+void make_importance_map(const Bitmap& mask, const Bitmap& dst);
+
+} // namespace Image
+
+#endif // IMAGE_H_INCLUDED
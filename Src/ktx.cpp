@@ -2,9 +2,16 @@
   @file ktx.cpp
 */
 #include "ktx.h"
+#include "process.h"
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
 
 namespace KTX {
 
@@ -13,8 +20,13 @@ static const uint8_t fileIdentifier[12] = {
   0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
 };
 
-/// Initialize KTX header for the compressed format.
-void initialize(Header* ktx, uint32_t w, uint32_t h, uint16_t format)
+/** Initialize KTX header for the compressed format.
+
+  @param format      the compressed internal format(e.g. Format_ETC1).
+  @param baseFormat  the base internal format(GL_RGB or GL_RGBA) that the
+                     compressed format is decoded to.
+*/
+void initialize(Header* ktx, uint32_t w, uint32_t h, uint16_t format, uint16_t baseFormat)
 {
   for (int i = 0; i < sizeof(fileIdentifier); ++i) {
     ktx->identifier[i] = fileIdentifier[i];
@@ -24,7 +36,7 @@ void initialize(Header* ktx, uint32_t w, uint32_t h, uint16_t format)
   ktx->glTypeSize = 0;
   ktx->glFormat = 0;
   ktx->glInternalFormat = format;
-  ktx->glBaseInternalFormat = format;
+  ktx->glBaseInternalFormat = baseFormat;
   ktx->pixelWidth = w;
   ktx->pixelHeight = h;
   ktx->pixelDepth = 0;
@@ -36,7 +48,7 @@ void initialize(Header* ktx, uint32_t w, uint32_t h, uint16_t format)
 
 /** Check the header is valid.
 */
-bool is_ktx_header(const Header& h)
+bool is_header(const Header& h)
 {
   for (int i = 0; i < sizeof(fileIdentifier); ++i) {
     if (h.identifier[i] != fileIdentifier[i]) {
@@ -59,17 +71,75 @@ Endian get_endian(const Header& h)
   return Endian_Unknown;
 }
 
+namespace /* unnamed */ {
+
+/** Reverse the byte order of the value.
+*/
+inline uint32_t byte_swap(uint32_t value)
+{
+#ifdef _MSC_VER
+  return _byteswap_ulong(value);
+#else
+  return __builtin_bswap32(value);
+#endif
+}
+
+/** Get the endianness of the host.
+
+  It is folded to the constant by the compiler.
+*/
+inline Endian get_host_endian()
+{
+  const uint32_t one = 1;
+  uint8_t lowest;
+  memcpy(&lowest, &one, 1);
+  return lowest ? Endian_Little : Endian_Big;
+}
+
+} // unnamed namespace
+
+/** Get the name of the file that is written before it replaces filename.
+
+  The name has the process ID, so the processes that write the same file at
+  the same time(e.g. the full quality conversions of --preview) don't write
+  to the same temporary file. The last renamed file wins.
+*/
+std::string get_temporary_name(const std::string& filename)
+{
+  return filename + "." + std::to_string(GetThisProcessId()) + ".tmp";
+}
+
+/** Replace the file by the file that is completely written.
+
+  The reader of filename sees the old file or the new file, but never the
+  partial file. rename() of Windows fails if filename exists, so it is
+  removed first.
+
+  @retval true  success.
+  @retval false failure. tempname is removed.
+*/
+bool replace_file(const std::string& tempname, const std::string& filename)
+{
+#ifdef _WIN32
+  std::remove(filename.c_str());
+#endif
+  if (std::rename(tempname.c_str(), filename.c_str()) != 0) {
+    std::cout << "can't replace'" << filename << "'";
+    std::remove(tempname.c_str());
+    return false;
+  }
+  return true;
+}
+
 /** get value with endian.
 
   @ref get_endian()
 */
 uint32_t get_value(const uint32_t* pBuf, Endian e)
 {
-  const uint8_t* p = reinterpret_cast<const uint8_t*>(pBuf);
-  if (e == Endian_Little) {
-    return p[3] * 0x1000000 + p[2] * 0x10000 + p[1] * 0x100 + p[0];
-  }
-  return p[0] * 0x1000000 + p[1] * 0x10000 + p[2] * 0x100 + p[3];
+  uint32_t value;
+  memcpy(&value, pBuf, sizeof(value));
+  return e == get_host_endian() ? value : byte_swap(value);
 }
 
 /** set value with endian.
@@ -78,36 +148,164 @@ uint32_t get_value(const uint32_t* pBuf, Endian e)
 */
 void set_value(uint32_t* pBuf, uint32_t value, Endian e)
 {
-  uint8_t* p = reinterpret_cast<uint8_t*>(pBuf);
-  if (e == Endian_Little) {
-    p[0] = (value >>  0) & 0xff;
-    p[1] = (value >>  8) & 0xff;
-    p[2] = (value >> 16) & 0xff;
-    p[3] = (value >> 24) & 0xff;
-  } else {
-    p[0] = (value >> 24) & 0xff;
-    p[1] = (value >> 16) & 0xff;
-    p[2] = (value >>  8) & 0xff;
-    p[3] = (value >>  0) & 0xff;
+  if (e != get_host_endian()) {
+    value = byte_swap(value);
   }
+  memcpy(pBuf, &value, sizeof(value));
+}
+
+/** Add the text value to the key/value data.
+
+  @param file  the KTX file to add the pair.
+  @param key   the key. it should be UTF-8 string without NUL.
+  @param text  the text value. the terminating NUL is added.
+*/
+void add_key_value(File& file, const std::string& key, const std::string& text)
+{
+  KeyValue kv;
+  kv.key = key;
+  kv.value.assign(text.c_str(), text.size() + 1);
+  file.keyValues.push_back(kv);
+}
+
+/** Find the key/value pair by the key.
+
+  @param file  the KTX file that has the key/value data.
+  @param key   the key to find.
+
+  @return the pointer to the first pair that has the key. if the key isn't
+          found, nullptr.
+*/
+const KeyValue* find_key_value(const File& file, const std::string& key)
+{
+  for (auto& e : file.keyValues) {
+    if (e.key == key) {
+      return &e;
+    }
+  }
+  return nullptr;
+}
+
+/** Parse the key/value data.
+
+  The data is walked in one pass, and it is only borrowed, so the caller can
+  pass the buffer that is read with the header.
+
+  @param p          the key/value data.
+  @param size       the value of bytesOfKeyValueData.
+  @param e          the endianness of the file.
+  @param keyValues  the list to append the parsed pairs.
+
+  @retval true  success.
+  @retval false the data is broken. keyValues has the pairs before the broken one.
+*/
+bool parse_key_values(const uint8_t* p, uint32_t size, Endian e, std::vector<KeyValue>& keyValues)
+{
+  const uint8_t* const end = p + size;
+  while (p != end) {
+    if (static_cast<size_t>(end - p) < sizeof(uint32_t)) {
+      return false;
+    }
+    const uint32_t keyAndValueByteSize = get_value(reinterpret_cast<const uint32_t*>(p), e);
+    p += sizeof(uint32_t);
+    const uint32_t paddedSize = (keyAndValueByteSize + 3) & ~3U;
+    if (paddedSize < keyAndValueByteSize || paddedSize > static_cast<size_t>(end - p)) {
+      return false;
+    }
+    const uint8_t* pNul = static_cast<const uint8_t*>(memchr(p, '\0', keyAndValueByteSize));
+    if (!pNul) {
+      return false;
+    }
+    keyValues.push_back(KeyValue());
+    keyValues.back().key.assign(reinterpret_cast<const char*>(p), pNul - p);
+    keyValues.back().value.assign(reinterpret_cast<const char*>(pNul + 1), p + keyAndValueByteSize - (pNul + 1));
+    p += paddedSize;
+  }
+  return true;
+}
+
+/** Get the byte size of the key/value data.
+
+  @return the value of bytesOfKeyValueData.
+*/
+uint32_t get_key_value_data_size(const File& file)
+{
+  uint32_t size = 0;
+  for (auto& e : file.keyValues) {
+    const uint32_t keyAndValueByteSize = static_cast<uint32_t>(e.key.size() + 1 + e.value.size());
+    size += sizeof(uint32_t) + ((keyAndValueByteSize + 3) & ~3);
+  }
+  return size;
+}
+
+/** Write the key/value data.
+
+  The pairs are written in the order of the key, so the output doesn't depend
+  on the order of add_key_value(). The pairs that have the same key keep
+  their order.
+*/
+static void write_key_values(std::ostream& ofs, const File& file, Endian endianness)
+{
+  static const char padding[4] = { 0 };
+  std::vector<const KeyValue*> sorted;
+  sorted.reserve(file.keyValues.size());
+  for (auto& e : file.keyValues) {
+    sorted.push_back(&e);
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), [](const KeyValue* lhs, const KeyValue* rhs) { return lhs->key < rhs->key; });
+  for (auto pKeyValue : sorted) {
+    const KeyValue& e = *pKeyValue;
+    const uint32_t size = static_cast<uint32_t>(e.key.size() + 1 + e.value.size());
+    uint32_t keyAndValueByteSize;
+    set_value(&keyAndValueByteSize, size, endianness);
+    ofs.write(reinterpret_cast<char*>(&keyAndValueByteSize), sizeof(keyAndValueByteSize));
+    ofs.write(e.key.c_str(), e.key.size() + 1);
+    ofs.write(e.value.data(), e.value.size());
+    ofs.write(padding, ((size + 3) & ~3) - size);
+  }
+}
+
+/** Write the header and the key/value data.
+
+  @param ofs            the output stream.
+  @param file           the KTX file that has the header and the key/value data.
+  @param numberOfFaces  the number of faces written to the header.
+
+  @return the byte offset of the first image data from the top of the file.
+*/
+uint32_t write_header(std::ostream& ofs, const File& file, uint32_t numberOfFaces)
+{
+  Header  header = file.header;
+  const Endian endianness = get_endian(header);
+  set_value(&header.numberOfFaces, numberOfFaces, endianness);
+  set_value(&header.bytesOfKeyValueData, get_key_value_data_size(file), endianness);
+  ofs.write(reinterpret_cast<char*>(&header), sizeof(Header));
+  write_key_values(ofs, file, endianness);
+  return static_cast<uint32_t>(sizeof(Header)) + get_key_value_data_size(file);
 }
 
 /** read texture file.
+
+  The sizes in the file are checked against the file size before the buffers
+  are allocated, so the broken file doesn't allocate the huge memory.
 */
 bool read_texture(const std::string& filename, File& file)
 {
   std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
-  if (ifs.bad()) {
+  if (!ifs) {
     std::cout << "can't open'" << filename << "'";
     return false;
   }
+  ifs.seekg(0, std::ios::end);
+  const uint64_t fileSize = static_cast<uint64_t>(ifs.tellg());
+  ifs.seekg(0, std::ios::beg);
 
   ifs.read(reinterpret_cast<char*>(&file.header), sizeof(Header));
-  if (ifs.bad()) {
+  if (!ifs) {
     std::cout << "can't read '" << filename << "'";
     return false;
   }
-  if (!is_ktx_header(file.header)) {
+  if (!is_header(file.header)) {
     std::cout << "it isn't KTX file '" << filename << "'";
     return false;
   }
@@ -124,26 +322,42 @@ bool read_texture(const std::string& filename, File& file)
     return false;
   }
   
-  const uint32_t off = get_value(&file.header.bytesOfKeyValueData, endianness);
-  ifs.seekg(off, std::ios::cur);
-  if (ifs.bad()) {
-    std::cout << "can't read '" << filename << "'";
+  const uint32_t keyValueSize = get_value(&file.header.bytesOfKeyValueData, endianness);
+  if (keyValueSize > fileSize - sizeof(Header)) {
+    std::cout << "broken key/value data '" << filename << "'";
+    return false;
+  }
+  std::vector<uint8_t> keyValues(keyValueSize);
+  if (keyValueSize) {
+    ifs.read(reinterpret_cast<char*>(keyValues.data()), keyValueSize);
+    if (!ifs) {
+      std::cout << "can't read '" << filename << "'";
+      return false;
+    }
+  }
+  file.keyValues.clear();
+  if (!parse_key_values(keyValues.data(), keyValueSize, endianness, file.keyValues)) {
+    std::cout << "broken key/value data '" << filename << "'";
     return false;
   }
 
   std::vector<uint8_t>  data;
   for (int mipLevel = 0; mipLevel < (mipCount ? mipCount : 1); ++mipLevel) {
-    uint32_t imageSize;
+    uint32_t imageSize = 0;
     ifs.read(reinterpret_cast<char*>(&imageSize), sizeof(uint32_t));
-    if (ifs.bad()) {
+    if (!ifs) {
       std::cout << "can't read(miplevel=" << mipLevel << "):'" << filename << "'";
       return false;
     }
     imageSize = get_value(&imageSize, endianness);
-    const uint32_t imageSizeWithPadding = (imageSize + 3) & ~3;
-    data.resize(imageSizeWithPadding * faceCount);
-    ifs.read(reinterpret_cast<char*>(&data[0]), data.size());
-    if (ifs.bad()) {
+    const uint64_t imageSizeWithPadding = (static_cast<uint64_t>(imageSize) + 3) & ~3ULL;
+    if (imageSizeWithPadding * faceCount > fileSize - static_cast<uint64_t>(ifs.tellg())) {
+      std::cout << "can't read(miplevel=" << mipLevel << "):'" << filename << "'";
+      return false;
+    }
+    data.resize(static_cast<size_t>(imageSizeWithPadding * faceCount));
+    ifs.read(reinterpret_cast<char*>(data.data()), data.size());
+    if (!ifs) {
       std::cout << "can't read(miplevel=" << mipLevel << "):'" << filename << "'";
       return false;
     }
@@ -155,75 +369,67 @@ bool read_texture(const std::string& filename, File& file)
 }
 
 /** Write texture file.
+
+  The mip level data is written directly from ktxfile, so that the whole file
+  image isn't copied into the intermediate buffer. The file is written to the
+  temporary file first, and it replaces filename when it is complete.
 */
 bool write_texture(const std::string& filename, const File& ktxfile)
 {
-  Header  header = ktxfile.header;
-  header.numberOfFaces = 1;
-  header.bytesOfKeyValueData = 0;
-  uint32_t dataSize = 0;
-  for (auto& e : ktxfile.data) {
-    dataSize += static_cast<uint32_t>(e.buf.size() + sizeof(uint32_t));
+  const std::string tempname = get_temporary_name(filename);
+  std::ofstream ofs(tempname.c_str(), std::ios::out | std::ios::binary);
+  if (ofs.bad()) {
+    std::cout << "can't open'" << filename << "'";
+    return false;
   }
-
-  std::vector<uint8_t> buffer;
-  buffer.reserve(sizeof(Header) + dataSize);
-
-  buffer.insert(buffer.end(), reinterpret_cast<uint8_t*>(&header), reinterpret_cast<uint8_t*>(&header) + sizeof(Header));
-  
-  const Endian endianness = get_endian(header);
-  const int mipCount = get_value(&header.numberOfMipmapLevels, endianness);
+  write_header(ofs, ktxfile, 1);
+  const Endian endianness = get_endian(ktxfile.header);
+  const int mipCount = get_value(&ktxfile.header.numberOfMipmapLevels, endianness);
   for (int mipLevel = 0; mipLevel < (mipCount ? mipCount : 1); ++mipLevel) {
     uint32_t imageSize;
     set_value(&imageSize, ktxfile.data[mipLevel].imageSize, endianness);
-    buffer.insert(buffer.end(), reinterpret_cast<uint8_t*>(&imageSize), reinterpret_cast<uint8_t*>(&imageSize) + sizeof(imageSize));
-    buffer.insert(buffer.end(), ktxfile.data[mipLevel].buf.begin(), ktxfile.data[mipLevel].buf.end());
+    ofs.write(reinterpret_cast<char*>(&imageSize), sizeof(imageSize));
+    ofs.write(reinterpret_cast<const char*>(ktxfile.data[mipLevel].bytes()), ktxfile.data[mipLevel].size());
   }
-
-  std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
-  if (ofs.bad()) {
-    std::cout << "can't open'" << filename << "'";
+  ofs.close();
+  if (ofs.fail()) {
+    std::cout << "can't write'" << filename << "'";
+    std::remove(tempname.c_str());
     return false;
   }
-  ofs.write(reinterpret_cast<char*>(&buffer[0]), buffer.size());
-  return true;
+  return replace_file(tempname, filename);
 }
 
 /** Write cubemap texture file.
+
+  It replaces filename when it is complete as write_texture().
 */
 bool write_cubemap(const std::string& filename, const std::vector<File>& ktxfiles)
 {
-  Header  header = ktxfiles[0].header;
-  header.numberOfFaces = 6;
-  header.bytesOfKeyValueData = 0;
-  uint32_t dataSizePerFace = 0;
-  for (auto& e : ktxfiles[0].data) {
-    dataSizePerFace += static_cast<uint32_t>(e.buf.size() + sizeof(uint32_t));
+  const std::string tempname = get_temporary_name(filename);
+  std::ofstream ofs(tempname.c_str(), std::ios::out | std::ios::binary);
+  if (ofs.bad()) {
+    std::cout << "can't open'" << filename << "'";
+    return false;
   }
-
-  std::vector<uint8_t> buffer;
-  buffer.reserve(sizeof(Header) + dataSizePerFace * 6);
-
-  buffer.insert(buffer.end(), reinterpret_cast<uint8_t*>(&header), reinterpret_cast<uint8_t*>(&header) + sizeof(Header));
-  
-  const Endian endianness = get_endian(header);
-  const int mipCount = get_value(&header.numberOfMipmapLevels, endianness);
+  write_header(ofs, ktxfiles[0], 6);
+  const Endian endianness = get_endian(ktxfiles[0].header);
+  const int mipCount = get_value(&ktxfiles[0].header.numberOfMipmapLevels, endianness);
   for (int mipLevel = 0; mipLevel < (mipCount ? mipCount : 1); ++mipLevel) {
     uint32_t imageSize;
     set_value(&imageSize, ktxfiles[0].data[mipLevel].imageSize, endianness);
-    buffer.insert(buffer.end(), reinterpret_cast<uint8_t*>(&imageSize), reinterpret_cast<uint8_t*>(&imageSize) + sizeof(imageSize));
+    ofs.write(reinterpret_cast<char*>(&imageSize), sizeof(imageSize));
     for (auto& e : ktxfiles) {
-      buffer.insert(buffer.end(), e.data[mipLevel].buf.begin(), e.data[mipLevel].buf.end());
+      ofs.write(reinterpret_cast<const char*>(e.data[mipLevel].bytes()), e.data[mipLevel].size());
     }
   }
-
-  std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
-  if (ofs.bad()) {
-    std::cout << "can't open'" << filename << "'";
+  ofs.close();
+  if (ofs.fail()) {
+    std::cout << "can't write'" << filename << "'";
+    std::remove(tempname.c_str());
     return false;
   }
-  ofs.write(reinterpret_cast<char*>(&buffer[0]), buffer.size());
-  return true;
+  return replace_file(tempname, filename);
 }
 
 } // namespace KTX
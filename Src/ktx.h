@@ -13,6 +13,8 @@
 #define KTX_H_INCLUDED
 #include <cstdint>
 #include <vector>
+#include <string>
+#include <iosfwd>
 
 namespace KTX {
 
@@ -51,6 +53,13 @@ enum Format {
   Format_ATC_I = 0x87ee,
 };
 
+/** the key and value pair in the key/value data.
+*/
+struct KeyValue {
+  std::string key;
+  std::string value; ///< the value bytes. the text value includes the terminating NUL.
+};
+
 /** the KTX file.
 */
 struct File {
@@ -58,18 +67,31 @@ struct File {
   struct Data {
     uint32_t imageSize;
     std::vector<uint8_t> buf;
-    Data() {}
+    const uint8_t* pBorrowed; ///< the image data owned by other object(e.g. Arena). if it isn't nullptr, it is used instead of buf.
+    Data() : imageSize(0), pBorrowed(nullptr) {}
+    const uint8_t* bytes() const { return pBorrowed ? pBorrowed : buf.data(); }
+    size_t size() const { return pBorrowed ? imageSize : buf.size(); }
   };
   Header header;
+  std::vector<KeyValue> keyValues;
   std::vector<Data> data;
 };
 
-void initialize(Header* ktx, uint32_t w, uint32_t h, uint16_t format);
+void initialize(Header* ktx, uint32_t w, uint32_t h, uint16_t format, uint16_t baseFormat);
 bool is_header(const Header& h);
+Endian get_endian(const Header& h);
 uint32_t get_value(const uint32_t* pBuf, Endian e);
 void set_value(uint32_t* pBuf, uint32_t value, Endian e);
+void add_key_value(File& file, const std::string& key, const std::string& text);
+const KeyValue* find_key_value(const File& file, const std::string& key);
+bool parse_key_values(const uint8_t* p, uint32_t size, Endian e, std::vector<KeyValue>& keyValues);
+uint32_t get_key_value_data_size(const File& file);
+uint32_t write_header(std::ostream& ofs, const File& file, uint32_t numberOfFaces);
+std::string get_temporary_name(const std::string& filename);
+bool replace_file(const std::string& tempname, const std::string& filename);
 bool read_texture(const std::string& filename, File& file);
 bool write_texture(const std::string& filename, const File& file);
+bool write_cubemap(const std::string& filename, const std::vector<File>& files);
 
 } // namespace KTX
 
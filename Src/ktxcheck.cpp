@@ -0,0 +1,247 @@
+/**
+  @file ktxcheck.cpp
+*/
+#include "ktxcheck.h"
+#include "convert.h"
+#include "format.h"
+#include "parallel.h"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace KTX {
+
+namespace /* unnamed */ {
+
+/** Set the error to the result.
+
+  @return always false.
+*/
+bool set_error(CheckResult& result, const std::string& error)
+{
+  result.isValid = false;
+  result.error = error;
+  return false;
+}
+
+/** Get the hexadecimal string of the value.
+*/
+std::string to_hex(uint32_t value)
+{
+  std::ostringstream ss;
+  ss << "0x" << std::hex << value;
+  return ss.str();
+}
+
+} // unnamed namespace
+
+/** Validate the KTX file.
+
+  The image data isn't read. The header, the key/value data and the
+  imageSize of each level are checked against the file size and the block
+  size of the format.
+
+  @param filename  the KTX file path.
+  @param result    the result of the validation.
+
+  @retval true  the file is valid.
+  @retval false the file is invalid. result.error has the reason.
+*/
+bool check_file(const std::string& filename, CheckResult& result)
+{
+  result = CheckResult();
+  result.filename = filename;
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs) {
+    return set_error(result, "can't open");
+  }
+  ifs.seekg(0, std::ios::end);
+  result.fileSize = static_cast<uint64_t>(ifs.tellg());
+  ifs.seekg(0, std::ios::beg);
+  if (result.fileSize < sizeof(Header)) {
+    return set_error(result, "truncated header");
+  }
+
+  Header header;
+  ifs.read(reinterpret_cast<char*>(&header), sizeof(Header));
+  if (!ifs || !is_header(header)) {
+    return set_error(result, "wrong identifier");
+  }
+  const Endian e = get_endian(header);
+  result.endianness = e;
+  if (e == Endian_Unknown) {
+    return set_error(result, "wrong endianness");
+  }
+  result.glInternalFormat = get_value(&header.glInternalFormat, e);
+  result.width = get_value(&header.pixelWidth, e);
+  result.height = get_value(&header.pixelHeight, e);
+  result.faceCount = get_value(&header.numberOfFaces, e);
+  result.levelCount = get_value(&header.numberOfMipmapLevels, e);
+  const uint32_t glType = get_value(&header.glType, e);
+  const uint32_t depth = get_value(&header.pixelDepth, e);
+  const uint32_t arrayCount = get_value(&header.numberOfArrayElements, e);
+  const uint32_t keyValueSize = get_value(&header.bytesOfKeyValueData, e);
+
+  const TextureFormat::Traits* pTraits = TextureFormat::find_by_gl_format(result.glInternalFormat);
+  if (!pTraits || pTraits->isCompressed != (glType == 0)) {
+    return set_error(result, "unsupported glInternalFormat " + to_hex(result.glInternalFormat));
+  }
+  if (result.width == 0 || depth != 0) {
+    return set_error(result, "unsupported dimension");
+  }
+  if (result.faceCount != 1 && result.faceCount != 6) {
+    return set_error(result, "wrong numberOfFaces(" + std::to_string(result.faceCount) + ")");
+  }
+  const uint32_t height = result.height ? result.height : 1;
+  if (result.levelCount > 32 || (result.levelCount > 1 && (std::max(result.width, height) >> (result.levelCount - 1)) == 0)) {
+    return set_error(result, "too many numberOfMipmapLevels(" + std::to_string(result.levelCount) + ")");
+  }
+  if (keyValueSize % 4 != 0) {
+    return set_error(result, "bytesOfKeyValueData isn't multiple of 4");
+  }
+  if (keyValueSize > result.fileSize - sizeof(Header)) {
+    return set_error(result, "truncated key/value data");
+  }
+  std::vector<uint8_t> keyValues(keyValueSize);
+  if (keyValueSize) {
+    ifs.read(reinterpret_cast<char*>(keyValues.data()), keyValueSize);
+    if (!ifs) {
+      return set_error(result, "can't read key/value data");
+    }
+  }
+  std::vector<KeyValue> pairs;
+  const bool isKeyValueValid = parse_key_values(keyValues.data(), keyValueSize, e, pairs);
+  result.keyValueCount = static_cast<uint32_t>(pairs.size());
+  if (!isKeyValueValid) {
+    return set_error(result, "key/value pair " + std::to_string(pairs.size()) + " is broken");
+  }
+
+  // The imageSize of the non-array cubemap is the size of one face, and each
+  // face is padded. Otherwise, it is the size of all the faces and elements.
+  const bool isCubemap = result.faceCount == 6 && arrayCount == 0;
+  uint64_t offset = sizeof(Header) + keyValueSize;
+  const uint32_t levelCount = result.levelCount ? result.levelCount : 1;
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const uint32_t w = std::max(result.width >> level, 1U);
+    const uint32_t h = std::max(height >> level, 1U);
+    uint64_t imageSize = TextureFormat::get_level_size(*pTraits, w, h);
+    uint64_t dataSize = ((imageSize + 3) & ~3ULL) * result.faceCount;
+    if (!isCubemap) {
+      imageSize *= result.faceCount * std::max(arrayCount, 1U);
+      dataSize = (imageSize + 3) & ~3ULL;
+    }
+    const std::string levelName = "level " + std::to_string(level);
+    if (offset + sizeof(uint32_t) > result.fileSize) {
+      return set_error(result, "truncated at " + levelName);
+    }
+    uint32_t value;
+    ifs.seekg(offset, std::ios::beg);
+    ifs.read(reinterpret_cast<char*>(&value), sizeof(value));
+    if (!ifs) {
+      return set_error(result, "can't read " + levelName);
+    }
+    value = get_value(&value, e);
+    if (value != imageSize) {
+      return set_error(result, levelName + " has imageSize " + std::to_string(value) + ", expected " + std::to_string(imageSize));
+    }
+    offset += sizeof(uint32_t) + dataSize;
+    if (offset > result.fileSize) {
+      return set_error(result, "truncated at " + levelName);
+    }
+  }
+  if (offset != result.fileSize) {
+    return set_error(result, std::to_string(result.fileSize - offset) + " extra bytes after the last level");
+  }
+  result.isValid = true;
+  return true;
+}
+
+} // namespace KTX
+
+/** Print the row of the result table.
+*/
+void PrintCheckResult(const KTX::CheckResult& r)
+{
+  const TextureFormat::Traits* pTraits = TextureFormat::find_by_gl_format(r.glInternalFormat);
+  std::ostringstream size;
+  size << r.width << "x" << r.height;
+  std::cout << std::left <<
+    std::setw(7) << (r.isValid ? "ok" : "error") <<
+    std::setw(6) << (pTraits ? pTraits->name : "-") <<
+    std::setw(12) << size.str() <<
+    std::setw(7) << (r.endianness == KTX::Endian_Big ? "big" : "little") <<
+    std::right <<
+    std::setw(4) << r.faceCount <<
+    std::setw(4) << r.levelCount <<
+    std::setw(4) << r.keyValueCount <<
+    std::setw(12) << r.fileSize << "  " <<
+    r.filename;
+  if (!r.isValid) {
+    std::cout << ": " << r.error;
+  }
+  std::cout << std::endl;
+}
+
+/** Check the KTX files.
+
+  usage: ktxcheck [-j count] [-l listfile] [file...]
+
+  @param argc      the number of arguments after the subcommand.
+  @param argv      the arguments after the subcommand.
+  @param printAll  if true, all files are printed. otherwise, only the
+                   invalid files are printed.
+
+  @return the exit code. 0 if all files are valid, otherwise 1.
+*/
+int RunKtxCheck(int argc, char** argv, bool printAll)
+{
+  std::vector<std::string> filenames;
+  uint32_t threadCount = 0;
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      threadCount = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      if (!ReadFileList(argv[++i], filenames)) {
+        std::cout << "Error: can't read '" << argv[i] << "'." << std::endl;
+        return 1;
+      }
+    } else {
+      filenames.push_back(argv[i]);
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<KTX::CheckResult> results(filenames.size());
+  Parallel::for_each(static_cast<uint32_t>(filenames.size()), Parallel::get_thread_count(threadCount), [&](uint32_t i) {
+    KTX::check_file(filenames[i], results[i]);
+  });
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  size_t errorCount = 0;
+  uint64_t totalSize = 0;
+  bool hasHeader = false;
+  for (const auto& e : results) {
+    totalSize += e.fileSize;
+    if (!e.isValid) {
+      ++errorCount;
+    }
+    if (printAll || !e.isValid) {
+      if (!hasHeader) {
+        std::cout << std::left << std::setw(7) << "result" << std::setw(6) << "fmt" << std::setw(12) << "size" << std::setw(7) << "endian" <<
+          std::right << std::setw(4) << "fc" << std::setw(4) << "lv" << std::setw(4) << "kv" << std::setw(12) << "bytes" << "  file" << std::endl;
+        hasHeader = true;
+      }
+      PrintCheckResult(e);
+    }
+  }
+  std::cout << results.size() << " files, " << totalSize << " bytes, " <<
+    (results.size() - errorCount) << " ok, " << errorCount << " error(s) in " <<
+    std::fixed << std::setprecision(3) << seconds << " sec." << std::endl;
+  return errorCount ? 1 : 0;
+}
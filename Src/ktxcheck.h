@@ -0,0 +1,38 @@
+/**
+  @file ktxcheck.h
+
+  Validate KTX files.
+*/
+#ifndef KTXCHECK_H_INCLUDED
+#define KTXCHECK_H_INCLUDED
+#include "ktx.h"
+#include <cstdint>
+#include <string>
+
+namespace KTX {
+
+/** The result of check_file().
+*/
+struct CheckResult {
+  std::string filename;
+  bool isValid;
+  std::string error; ///< the reason if isValid is false.
+  uint64_t fileSize;
+  Endian endianness;
+  uint32_t glInternalFormat;
+  uint32_t width;
+  uint32_t height;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t keyValueCount;
+
+  CheckResult() : isValid(false), fileSize(0), endianness(Endian_Unknown), glInternalFormat(0), width(0), height(0), faceCount(0), levelCount(0), keyValueCount(0) {}
+};
+
+bool check_file(const std::string& filename, CheckResult& result);
+
+} // namespace KTX
+
+int RunKtxCheck(int argc, char** argv, bool printAll);
+
+#endif // KTXCHECK_H_INCLUDED
@@ -1,11 +1,24 @@
 /**
   @file main.cpp
 */
-#include "ktx.h"
+#include "convert.h"
+#include "cmdline.h"
+#include "arena.h"
+#include "format.h"
+#include "ktxcheck.h"
+#include "repack.h"
+#include "dettest.h"
+#include "edgetest.h"
+#include "distributed.h"
+#include "compare.h"
+#include "decbench.h"
+#include "process.h"
+#include "watch.h"
 #include <TextureConverter.h>
 #include <FreeImage.h>
 #include <stdio.h>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <algorithm>
 
@@ -20,7 +33,26 @@ void PrintUsage() {
 	"ATCConv ver." ATCCONV_TO_STR(ATCCONV_VERSION) "\n"
 	"Convert PNG(24/32bit) image to KTX(ATC/ETC1 compressed format) image.\n"
 	"\n"
-	"usage: atcconv.exe [-f format] [-m count] [-v] [infile] [outfile]\n"
+	"usage: atcconv.exe [-f format] [-a layout] [-t mode] [-m count] [-b rows]\n"
+	"                   [-n filter] [-s scale] [-w] [-filter name] [-p]\n"
+	"                   [-j count] [-encoder name] [--preview] [-mask file]\n"
+	"                   [--srgb] [-v] [infile] [outfile]\n"
+	"       atcconv.exe --compare[=name,...] [-f format] [-j count] [-r count]\n"
+	"                           [--srgb] [-l listfile] [file...]\n"
+	"       atcconv.exe --watch dir [-workers count] [-debounce ms]\n"
+	"                               [-focus listfile] [options...]\n"
+	"       atcconv.exe ktxcheck [-j count] [-l listfile] [file...]\n"
+	"       atcconv.exe ktxinfo [-j count] [-l listfile] [file...]\n"
+	"       atcconv.exe repack [-f format] [-m count] [-filter name] [-j count]\n"
+	"                          [-c] [-encoder name] infile... outfile\n"
+	"       atcconv.exe decbench [-j count] [-r count] [-l listfile] [file...]\n"
+	"       atcconv.exe dettest [-o outfile] [-l listfile] [options...] [file...]\n"
+	"       atcconv.exe edgetest [-encoder name] [-filter name]\n"
+	"       atcconv.exe coordinator [-host address] [-port number] [-shard count]\n"
+	"                               [-retry count] [-f format] [-m count]\n"
+	"                               [-o statsfile] [-l manifest] [file...]\n"
+	"       atcconv.exe worker [-host address] [-port number] [-prefetch count]\n"
+	"                          [options...]\n"
 	"\n"
 	"  infile   : input PNG(24/32bit) file path.\n"
 	"\n"
@@ -33,230 +65,230 @@ void PrintUsage() {
 	"             atce: ATC with explicit alpha.\n"
 	"             etc1: ETC1.\n"
 	"\n"
+	"  -a layout: encode the alpha as the other ETC1 image.\n"
+	"             separate: write the alpha to the other file. its name is\n"
+	"                       outfile that has '_alpha' before the extention.\n"
+	"             stacked : stack the alpha below the color in one double\n"
+	"                       height image.\n"
+	"             the output format is always 'etc1' with this option.\n"
+	"\n"
+	"  -t mode  : process the color of the transparent pixels before the\n"
+	"             compression.\n"
+	"             premultiply: multiply the color by the alpha.\n"
+	"             bleed      : fill the color from the neighbor pixels to\n"
+	"                          prevent the halo in the mipmaps.\n"
+	"\n"
 	"  -m count : the mipmap count.\n"
 	"             if count is less than 2, a result has single image(no mipmap).\n"
 	"             if count is greater than 16, count is considered as 16.\n"
 	"\n"
+	"  -b rows  : encode the image band by band. rows is the number of 4x4\n"
+	"             block rows in a band. the working memory is bounded by the\n"
+	"             band size for the large image. the format is selected by\n"
+	"             the BPP of the input image, and '-a' and '-t bleed' are not\n"
+	"             available.\n"
+	"\n"
+	"  -n filter: convert the height map to the normal map. the height is the\n"
+	"             luminance of infile.\n"
+	"             sobel  : use 3x3 Sobel operator.\n"
+	"             prewitt: use 3x3 Prewitt operator.\n"
+	"             X and Y of the normal are stored in the alpha and the green\n"
+	"             for 'atci' and 'atce', or in the red and the green for\n"
+	"             'etc1'. the default format is 'atci'. '-a', '-t' and '-b'\n"
+	"             are not available.\n"
+	"\n"
+	"  -s scale : the height of the white pixel for '-n' in the unit of the\n"
+	"             pixel width. the default is 1.\n"
+	"\n"
+	"  -w       : wrap around the edges of the height map for '-n'.\n"
+	"\n"
+	"  -filter name: the filter to make the mipmaps.\n"
+	"             mean    : 2x2 box filter.\n"
+	"             nearest : the nearest pixel.\n"
+	"             bilinear: the triangle filter.\n"
+	"             bicubic : Catmull-Rom spline. it is the default, same as\n"
+	"                       FreeImage_Rescale().\n"
+	"             kaiser  : Kaiser windowed sinc filter.\n"
+	"             '-b' always uses 'mean'.\n"
+	"\n"
+	"  -p       : resize the image to the nearest power of two size by the\n"
+	"             filter of '-filter'. 'mean' is treated as 'bilinear'.\n"
+	"             '-b' and '-n' are not available.\n"
+	"\n"
+	"  -j count : the number of threads for '-n', '-filter' and the\n"
+	"             compression. the large levels are split into the bands of\n"
+	"             the block rows. if not passed, the number of the hardware\n"
+	"             threads.\n"
+	"\n"
+	"  -encoder name: the encoder.\n"
+	"             qonvert: Adreno Texture Converter. it is the default if it\n"
+	"                      is built in.\n"
+	"             sse2   : the encoder of ATCConv with SSE2.\n"
+	"             scalar : same as sse2 without SIMD.\n"
+	"             native : the fastest one of sse2 and scalar.\n"
+	"             preview: the end points from the bounding box without the\n"
+	"                      search. it is fast but low quality.\n"
+	"             '--encoder=name' is also accepted.\n"
+	"\n"
+	"  --preview: encode the image quickly by 'preview' encoder with 2 mipmaps\n"
+	"             at most, and start the full quality conversion in the\n"
+	"             background. it replaces outfile when it is done.\n"
+	"             '-encoder' is not available.\n"
+	"\n"
+	"  -mask file: the PNG image of the importance by the luminance. it is\n"
+	"             stretched to each level. the block under 64 is encoded\n"
+	"             quickly, and the search of the others stops at the error\n"
+	"             that shrinks to 0 at 255. '--mask=file' is also accepted.\n"
+	"             '-b', '-n' and '-a stacked' are not available.\n"
+	"\n"
+	"  --srgb   : the color is sRGB. the mipmaps and '-p' are filtered in the\n"
+	"             linear space, and \"ATCConv.colorSpace\" is added to the\n"
+	"             key/value data. '-b', '-n' and '-a stacked' are not\n"
+	"             available.\n"
+	"\n"
 	"  -v       : flip virtucal.\n"
 	"\n"
-	"  If not passed -f option, the output format is selected by the BPP of the\n"
-	"  input image. 'etc1' will be selected in the 24bit image, otherwize 'atci'.\n"
+	"  --compare: encode the PNG files by the encoders(all if not passed), and\n"
+	"             print the time and PSNR of each encoder. the block rows are\n"
+	"             split into '-j' threads, and the fastest of '-r' runs(the\n"
+	"             default is 3) is printed. with '--srgb', PSNR is measured by\n"
+	"             the linear color.\n"
+	"\n"
+	"  --watch  : convert the PNG files in dir again whenever they are saved,\n"
+	"             until Ctrl+C is pressed. the file is converted when it isn't\n"
+	"             written for '-debounce' ms(the default is 100) by one of\n"
+	"             '-workers' threads(the default is 2) that are kept during\n"
+	"             the watch. the files in the focus list(a path or a name\n"
+	"             in dir per line, nearest first) are converted first, and\n"
+	"             the later saved file precedes in the others. the options\n"
+	"             are same as the conversion without infile, outfile and\n"
+	"             '--preview'. the subdirectories aren't watched.\n"
+	"\n"
+	"  ktxcheck : validate KTX files. the header, the key/value data and the\n"
+	"             size of each level are checked. the invalid files and the\n"
+	"             summary are printed, and the exit code is 1 if there are\n"
+	"             the invalid files. '-l' reads the file paths from listfile\n"
+	"             line by line.\n"
+	"  ktxinfo  : same as ktxcheck, but all files are printed.\n"
+	"\n"
+	"  repack   : repack the KTX file without the PNG file. the levels that\n"
+	"             keep the format are copied as is, and only the other levels\n"
+	"             are decoded and encoded again.\n"
+	"             -f: the output format. if not passed, the format is kept.\n"
+	"             -m: the mipmap count. if not passed, the count is kept. the\n"
+	"                 added levels are made from the smallest level of infile.\n"
+	"             -encoder: the encoder to decode and encode the levels.\n"
+	"             -c: merge 6 infiles(+X, -X, +Y, -Y, +Z, -Z) into a cubemap.\n"
+	"\n"
+	"  decbench : decode all levels and faces of the KTX files to RGBA by each\n"
+	"             kernel(scalar, sse2), and print the speed in GPixel/s of\n"
+	"             each file and each format. the block rows are split into\n"
+	"             '-j' threads, and the fastest of '-r' runs(the default is\n"
+	"             3) is printed. the exit code is 1 if a kernel makes the\n"
+	"             different pixels from scalar.\n"
+	"\n"
+	"  dettest  : convert the PNG files by 1, 2 and count threads, and compare\n"
+	"             the hashes of the outputs. the options and the threaded\n"
+	"             paths(-filter, -p, -a, -n) added to them are tested with 16\n"
+	"             mipmaps. the options are same as the conversion, and the\n"
+	"             path that can't be used with them is skipped. the output is\n"
+	"             written to outfile(the default is 'atcconv_dettest.ktx')\n"
+	"             and removed. the exit code is 1 if the outputs are\n"
+	"             different.\n"
+	"\n"
+	"  edgetest : encode the images of 1x1, 2x1, 1x2, 3x5, 5x7 and 301x203 at\n"
+	"             24 and 32bit, bottom-up and flipped, and compare the blocks\n"
+	"             and the mipmaps with the images padded by the copy. the\n"
+	"             nearest power of two sizes of -p are also tested. the exit\n"
+	"             code is 1 if any results are different.\n"
+	"\n"
+	"  coordinator: distribute the files to the workers. each line of the\n"
+	"             manifest is 'infile' or 'infile<TAB>outfile'. the files are\n"
+	"             split into the shards of '-shard' files(the default is 16),\n"
+	"             and the idle worker steals the half of the busiest shard.\n"
+	"             the files are dispatched from the most costly one, that is\n"
+	"             estimated from the PNG header by '-f' and '-m' of the\n"
+	"             workers.\n"
+	"             the failed file is retried '-retry' times(the default is 2).\n"
+	"             the result of each file is written to statsfile as TSV.\n"
+	"             the default address is 127.0.0.1:20480.\n"
+	"  worker   : connect to the coordinator, and convert the files by the\n"
+	"             options(same as the conversion) until all files are done.\n"
+	"             the files are read, decoded, encoded and written on the\n"
+	"             separate threads, and '-prefetch' files(the default is 2)\n"
+	"             are read ahead of the encoding.\n"
+	"\n"
+	"  If not passed -f option, the output format is selected by the alpha of the\n"
+	"  input image. 'etc1' will be selected if the image is opaque, 'atce' if the\n"
+	"  alpha is 0 or 255 only, otherwize 'atci'.\n"
 	"  If infile does not have the alpha in 'atci' or 'atce', it is assumed to\n"
 	"  be 1.0. If infile has the alpha in 'etc1', ignored.\n"
 	<< std::endl;
 }
 
-/** Get bytes per pixel from the format.
-
-  @param format Q_FORMAT_???
-
-  @return byte per pixel.
-*/
-uint32_t GetBytePerPixel(uint32_t format) {
-  switch (format) {
-  case Q_FORMAT_RGB_8I: return 3;
-  default:
-  case Q_FORMAT_RGBA_8I: return 4;
-  }
-}
-
-/** Get the OpenGL format from Q_FORMAT_???.
-
-  @param  qformat  Q_FORMAT_???. It is the TextureConverter format type.
-
-  @return The corresponding OpenGL format of the qformat.
-*/
-uint32_t GetOpenGLTextureFormat(uint32_t qformat) {
-  switch (qformat) {
-  case Q_FORMAT_ETC1_RGB8: return KTX::Format_ETC1;
-  case Q_FORMAT_ATC_RGBA_EXPLICIT_ALPHA: return KTX::Format_ATC_E;
-  default:
-  case Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA: return KTX::Format_ATC_I;
-  }
-}
-
-/** Create TQonvertImage structure.
-
-  @param data    the pointer to the raw image data.
-  @param w       the pixel width of the image.
-  @param h       the pixel height of the image.
-  @param foramt  Q_FORMAT_???
-
-  @return TQonvertImage object created with the parameter.
-*/
-TQonvertImage TQonvertImage_Create( void* data, uint32_t w, uint32_t h, uint32_t format) {
-  TQonvertImage n;
-  n.nWidth = w;
-  n.nHeight = h;
-  n.nFormat = format;
-  n.pFormatFlags = nullptr;
-  n.nDataSize = data ? w * h * GetBytePerPixel(format) : 0;
-  n.pData = reinterpret_cast<unsigned char*>(data);
-  n.compressionOptions = nullptr;
-  return n;
-}
-
-struct ArgToFormat {
-  const char* argname;
-  uint32_t format;
-};
-static const ArgToFormat argToFormatList[] = {
-  { "atce", Q_FORMAT_ATC_RGBA_EXPLICIT_ALPHA },
-  { "atci", Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA },
-  { "etc1", Q_FORMAT_ETC1_RGB8 },
-};
-static const uint32_t Q_FORMAT_UNKNOWN = 0xffffffffU;
-
 /** The entry point.
 */
 int main(int argc, char** argv) {
-  std::string infilename;
-  std::string outfilename;
-  uint32_t outputFormat = Q_FORMAT_UNKNOWN;
-  uint32_t maxLevel = 1;
-  bool flipY = false;
-  for (int i = 1; i < argc; ++i) {
-    if (argv[i][0] == '-') {
-      if ((argv[i][1] == 'f' || argv[i][1] == 'F') && argv[i][2] == '\0' && (argc >= i + 1)) {
-        static const ArgToFormat* const end = argToFormatList + sizeof(argToFormatList) / sizeof(argToFormatList[0]);
-        for (const ArgToFormat* itr = argToFormatList; itr != end; ++itr) {
-          if (strcmp(itr->argname, argv[i + 1]) == 0) {
-            outputFormat = itr->format;
-            break;
-          }
-        }
-        if (outputFormat == Q_FORMAT_UNKNOWN) {
-          std::cout << "Error: '" << argv[i + 1] << "' is unknown format." << std::endl;
-          return 1;
-        }
-        ++i;
-      } else if ((argv[i][1] == 'm' || argv[i][1] == 'M') && argv[i][2] == '\0' && (argc >= i + 1)) {
-		maxLevel = std::max(1, std::min(16, std::atoi(argv[i + 1])));
-		++i;
-	  } else if ((argv[i][1] == 'v' || argv[i][1] == 'V') && argv[i][2] == '\0') {
-		flipY = true;
-	  }
-      continue;
-    }
-	if (infilename.empty()) {
-	  infilename = argv[i];
-	} else if (outfilename.empty()) {
-	  outfilename = argv[i];
-	  break;
-	}
+  if (argc >= 2 && (strcmp(argv[1], "ktxcheck") == 0 || strcmp(argv[1], "ktxinfo") == 0)) {
+    return RunKtxCheck(argc - 2, argv + 2, strcmp(argv[1], "ktxinfo") == 0);
+  }
+  if (argc >= 2 && strcmp(argv[1], "repack") == 0) {
+    return RunRepack(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "decbench") == 0) {
+    return RunDecodeBenchmark(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "dettest") == 0) {
+    return RunDeterminismTest(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "edgetest") == 0) {
+    return RunEdgeTest(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "coordinator") == 0) {
+    return RunCoordinator(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "worker") == 0) {
+    return RunWorker(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strncmp(argv[1], "--compare", 9) == 0 && (argv[1][9] == '\0' || argv[1][9] == '=')) {
+    return RunCompare(argv[1][9] == '=' ? argv[1] + 10 : "", argc - 2, argv + 2);
+  }
+  if (argc >= 3 && strcmp(argv[1], "--watch") == 0) {
+    return RunWatch(argv[2], argc - 3, argv + 3);
   }
-  if (infilename.empty()) {
+  ConvertOptions options;
+  if (!ParseConvertOptions(argc - 1, argv + 1, options)) {
+    return 1;
+  }
+  if (options.infilename.empty()) {
 	PrintUsage();
 	return 0;
   }
-  if (outfilename.empty()) {
-	outfilename = infilename;
-	auto dotPos = outfilename.find_last_of('.');
-	if (dotPos != std::string::npos) {
-	  outfilename.erase(dotPos, std::string::npos);
-	}
-	outfilename += ".ktx";
+  if (options.outfilename.empty()) {
+	options.outfilename = GetOutputFileName(options.infilename);
   }
 
 #ifdef FREE_IMAGE_STATIC_LIBRARY
   FreeImage_Initialise(FALSE);
 #endif // FREE_ISTATIC_LIBRARY 
 
-  FIBITMAP* dib = FreeImage_Load(FIF_PNG, infilename.c_str(), PNG_DEFAULT);
-  if (!dib) {
-	std::cout << "Can't read '" << infilename << "'." << std::endl;
-	return 1;
-  }
-
-  uint32_t bitPerPixel = FreeImage_GetBPP(dib);
-  const FREE_IMAGE_COLOR_TYPE colorType = FreeImage_GetColorType(dib);
-  if ((bitPerPixel != 24 && bitPerPixel != 32) || (colorType != FIC_RGB && colorType != FIC_RGBALPHA)) {
-    FIBITMAP* dib2;
-    if (FreeImage_IsTransparent(dib)) {
-      dib2 = FreeImage_ConvertTo32Bits(dib);
-      bitPerPixel = 32;
-    } else {
-      dib2 = FreeImage_ConvertTo24Bits(dib);
-      bitPerPixel = 24;
-    }
-    FreeImage_Unload(dib);
-    if (!dib2) {
-      std::cout << "Can't convert '" << infilename << "'." << std::endl;
-      return 1;
-    }
-    dib = dib2;
-  }
-
-  uint32_t width = FreeImage_GetWidth(dib);
-  uint32_t height = FreeImage_GetHeight(dib);
-  if (outputFormat == Q_FORMAT_UNKNOWN) {
-    outputFormat = bitPerPixel == 24 ? Q_FORMAT_ETC1_RGB8 : Q_FORMAT_ATC_RGBA_INTERPOLATED_ALPHA;
-  }
-
-  TFormatFlags srcFlags = { 0 };
-  srcFlags.nMaskRed   = FreeImage_GetRedMask(dib);
-  srcFlags.nMaskGreen = FreeImage_GetGreenMask(dib);
-  srcFlags.nMaskBlue  = FreeImage_GetBlueMask(dib);
-  srcFlags.nMaskAlpha = bitPerPixel == 24 ? 0 : 0xff000000U;
-
-  TFormatFlags destFlags = { 0 };
-  destFlags.nFlipY = !flipY; // NOTE: dib has a virtucal reversed image.
-
-  KTX::File ktx;
-  KTX::initialize(&ktx.header, width, height, GetOpenGLTextureFormat(outputFormat));
-  for (uint32_t level = 0; ;) {
-	TQonvertImage  src = TQonvertImage_Create(FreeImage_GetBits(dib), width, height, bitPerPixel == 24 ? Q_FORMAT_RGB_8I : Q_FORMAT_RGBA_8I);
-	src.pFormatFlags = &srcFlags;
-
-	TQonvertImage  dest = TQonvertImage_Create(nullptr, width, height, outputFormat);
-	dest.pFormatFlags = &destFlags;
-	{
-	  // At First, dest.pData is nullptr.
-	  // Qonvert return the required buffer size in dest.nDataSize.
-	  const int result = Qonvert(&src, &dest);
-	  if (result != Q_SUCCESS) {
-		std::cout << "Can't convert '" << infilename << "'." << std::endl;
-		FreeImage_Unload(dib);
-		return 2;
-	  }
-	}
-	// Allocate the destination buffer using the size information returnd from Qonvert.
-	std::vector<uint8_t> buf;
-	buf.resize(dest.nDataSize);
-	dest.pData = &buf[0];
-	{
-	  // This time, Qonvert can really convert the image.
-	  const int result = Qonvert(&src, &dest);
-	  if (result != Q_SUCCESS) {
-		std::cout << "Can't convert '" << infilename << "'." << std::endl;
-		FreeImage_Unload(dib);
-		return 2;
+  Arena arena;
+  const ConvertResult result = ConvertFile(options, arena);
+  if (result == ConvertResult_Success && options.preview) {
+	// The same command without '--preview' replaces the preview by the full quality image.
+	std::vector<std::string> args;
+	for (int i = 0; i < argc; ++i) {
+	  if (strcmp(argv[i], "--preview") != 0) {
+		args.push_back(argv[i]);
 	  }
 	}
-	ktx.data.push_back(KTX::File::Data());
-	ktx.data.back().imageSize = dest.nDataSize;
-	ktx.data.back().buf.swap(buf);
-	if ((++level >= maxLevel) || (width == 1 && height == 1)) {
-	  ktx.header.numberOfMipmapLevels = level;
-	  break;
-	}
-	width = std::max(width / 2, 1U);
-	height = std::max(height / 2, 1U);
-	FIBITMAP* dib2 = FreeImage_Rescale(dib, width, height);
-	FreeImage_Unload(dib);
-	if (!dib2) {
-	  std::cout << "Can't convert '" << infilename << "'." << std::endl;
-	  return 2;
+	if (!SpawnDetachedProcess(args)) {
+	  std::cout << "Error: can't start the full quality conversion." << std::endl;
 	}
-	dib = dib2;
-  }
-  FreeImage_Unload(dib);
-
-  if (!KTX::write_texture(outfilename, ktx)) {
-	return 3;
   }
 
 #ifdef FREE_IMAGE_STATIC_LIBRARY
   FreeImage_Deinitialise();
 #endif // FREE_ISTATIC_LIBRARY 
+  return result;
 }
@@ -0,0 +1,368 @@
+/**
+  @file normalmap.cpp
+*/
+#include "normalmap.h"
+#include "arena.h"
+#include "convert.h"
+#include "format.h"
+#include "parallel.h"
+#include "simd.h"
+#include <cmath>
+#include <algorithm>
+
+namespace Image {
+
+namespace /* unnamed */ {
+
+/** Get the index of the neighbor pixel.
+
+  @param i     the index of the pixel.
+  @param d     -1 for the previous pixel, 1 for the next pixel.
+  @param size  the number of pixels in the row or the column.
+  @param wrap  if true, the pixel at the edge refers the opposite edge.
+*/
+inline uint32_t neighbor(uint32_t i, int32_t d, uint32_t size, bool wrap)
+{
+  if (d < 0 && i == 0) {
+    return wrap ? size - 1 : 0;
+  }
+  if (d > 0 && i + 1 >= size) {
+    return wrap ? 0 : size - 1;
+  }
+  return i + d;
+}
+
+/** Convert the component of the unit vector to 8bit.
+
+  The result is rounded to the nearest, same as the SIMD version.
+*/
+inline uint8_t encode_component(float n)
+{
+  return static_cast<uint8_t>(static_cast<int32_t>(n * 127.5f + 128.0f));
+}
+
+/** Convert 8bit to the component of the unit vector.
+*/
+inline float decode_component(uint8_t c)
+{
+  return (static_cast<float>(c) - 127.5f) / 127.5f;
+}
+
+/** Store the normal of the gradient.
+
+  The normal follows OpenGL convention, so Y is up in the image.
+
+  @param dx  the horizontal gradient of the filter.
+  @param dy  the vertical gradient of the filter. the positive value goes down.
+  @param k   the scale from the gradient to the slope.
+  @param d   the destination pixel in BGRA.
+*/
+inline void store_normal(int32_t dx, int32_t dy, float k, uint8_t* d)
+{
+  const float nx = static_cast<float>(-dx) * k;
+  const float ny = static_cast<float>(dy) * k;
+  const float len = std::sqrt(nx * nx + ny * ny + 1.0f);
+  d[0] = encode_component(1.0f / len);
+  d[1] = encode_component(ny / len);
+  d[2] = encode_component(nx / len);
+  d[3] = 255;
+}
+
+/** Convert the row to the height.
+
+  The height is the luminance. It is same as the input if the image is greyscale.
+*/
+void height_row(const uint8_t* s, uint32_t count, uint32_t bpp, uint8_t* d)
+{
+  for (uint32_t x = 0; x < count; ++x, s += bpp) {
+    d[x] = static_cast<uint8_t>((s[2] * 77 + s[1] * 150 + s[0] * 29 + 128) >> 8);
+  }
+}
+
+/** Make the normals of the row.
+
+  @param a       the height of the upper row.
+  @param b       the height of the row.
+  @param c       the height of the lower row.
+  @param count   the number of pixels in the row.
+  @param center  the weight of the center of the filter. the corners are 1.
+  @param k       the scale from the gradient to the slope.
+  @param wrap    if true, the pixels at the edge refer the opposite edge.
+  @param d       the destination row in BGRA.
+*/
+void normal_row(const uint8_t* a, const uint8_t* b, const uint8_t* c, uint32_t count, int32_t center, float k, bool wrap, uint8_t* d)
+{
+  const auto gradient = [&](uint32_t x) {
+    const uint32_t l = neighbor(x, -1, count, wrap);
+    const uint32_t r = neighbor(x, 1, count, wrap);
+    const int32_t dx = (a[r] - a[l]) + center * (b[r] - b[l]) + (c[r] - c[l]);
+    const int32_t dy = (c[l] + center * c[x] + c[r]) - (a[l] + center * a[x] + a[r]);
+    store_normal(dx, dy, k, d + x * 4);
+  };
+  if (count == 0) {
+    return;
+  }
+  gradient(0);
+  uint32_t x = 1;
+#if ATCCONV_HAS_SSE2
+  // The inner pixels don't refer the edges, so 8 pixels are processed at once.
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i center16 = _mm_set1_epi16(static_cast<int16_t>(center));
+  const __m128i alpha16 = _mm_set1_epi16(255);
+  const __m128 kv = _mm_set1_ps(k);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 scale = _mm_set1_ps(127.5f);
+  const __m128 offset = _mm_set1_ps(128.0f);
+  const auto load8 = [&](const uint8_t* p) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+  };
+  const auto encode = [&](__m128 n, __m128 len) {
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_div_ps(n, len), scale), offset));
+  };
+  for (; x + 9 <= count; x += 8) {
+    const __m128i al = load8(a + x - 1), am = load8(a + x), ar = load8(a + x + 1);
+    const __m128i bl = load8(b + x - 1), br = load8(b + x + 1);
+    const __m128i cl = load8(c + x - 1), cm = load8(c + x), cr = load8(c + x + 1);
+    const __m128i dx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(ar, al), _mm_mullo_epi16(center16, _mm_sub_epi16(br, bl))), _mm_sub_epi16(cr, cl));
+    const __m128i dy = _mm_sub_epi16(
+      _mm_add_epi16(_mm_add_epi16(cl, _mm_mullo_epi16(center16, cm)), cr),
+      _mm_add_epi16(_mm_add_epi16(al, _mm_mullo_epi16(center16, am)), ar));
+    __m128i nz32[2], ny32[2], nx32[2];
+    for (int i = 0; i < 2; ++i) {
+      const __m128i dx32 = _mm_srai_epi32(i == 0 ? _mm_unpacklo_epi16(dx, dx) : _mm_unpackhi_epi16(dx, dx), 16);
+      const __m128i dy32 = _mm_srai_epi32(i == 0 ? _mm_unpacklo_epi16(dy, dy) : _mm_unpackhi_epi16(dy, dy), 16);
+      const __m128 nx = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(zero, dx32)), kv);
+      const __m128 ny = _mm_mul_ps(_mm_cvtepi32_ps(dy32), kv);
+      const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), one));
+      nz32[i] = encode(one, len);
+      ny32[i] = encode(ny, len);
+      nx32[i] = encode(nx, len);
+    }
+    const __m128i nz16 = _mm_packs_epi32(nz32[0], nz32[1]);
+    const __m128i ny16 = _mm_packs_epi32(ny32[0], ny32[1]);
+    const __m128i nx16 = _mm_packs_epi32(nx32[0], nx32[1]);
+    const __m128i zyLo = _mm_unpacklo_epi16(nz16, ny16);
+    const __m128i xaLo = _mm_unpacklo_epi16(nx16, alpha16);
+    const __m128i zyHi = _mm_unpackhi_epi16(nz16, ny16);
+    const __m128i xaHi = _mm_unpackhi_epi16(nx16, alpha16);
+    __m128i* pd = reinterpret_cast<__m128i*>(d + x * 4);
+    _mm_storeu_si128(pd, _mm_packus_epi16(_mm_unpacklo_epi32(zyLo, xaLo), _mm_unpackhi_epi32(zyLo, xaLo)));
+    _mm_storeu_si128(pd + 1, _mm_packus_epi16(_mm_unpacklo_epi32(zyHi, xaHi), _mm_unpackhi_epi32(zyHi, xaHi)));
+  }
+#endif // ATCCONV_HAS_SSE2
+  for (; x < count; ++x) {
+    gradient(x);
+  }
+}
+
+} // unnamed namespace
+
+/** Get the byte size of the work memory for make_normal_map().
+
+  @param w  the pixel width of the image.
+  @param h  the pixel height of the image.
+*/
+size_t get_normal_map_work_size(uint32_t w, uint32_t h)
+{
+  return static_cast<size_t>(w) * h;
+}
+
+/** Make the normal map from the height map.
+
+  @param src          the height map. the height is the luminance.
+  @param dst          the destination image of 4 bytes per pixel. its size
+                      should be same as src. X, Y and Z are stored in the
+                      red, the green and the blue.
+  @param options      the parameters of the normal map.
+  @param pWork        the work memory of get_normal_map_work_size() bytes.
+  @param threadCount  the maximum number of threads.
+*/
+void make_normal_map(const Bitmap& src, const Bitmap& dst, const NormalMapOptions& options, uint8_t* pWork, uint32_t threadCount)
+{
+  const uint32_t w = src.width;
+  const uint32_t h = src.height;
+  Parallel::for_range(h, threadCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t y = begin; y < end; ++y) {
+      height_row(src.row(y), w, src.bytesPerPixel, pWork + static_cast<size_t>(y) * w);
+    }
+  });
+
+  // The filter sums the differences of 3 rows over 2 pixels.
+  const int32_t center = options.filter == NormalFilter_Sobel ? 2 : 1;
+  const float k = options.scale / static_cast<float>((2 + center) * 2 * 255);
+  Parallel::for_range(h, threadCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t y = begin; y < end; ++y) {
+      const uint8_t* a = pWork + static_cast<size_t>(neighbor(y, -1, h, options.wrap)) * w;
+      const uint8_t* b = pWork + static_cast<size_t>(y) * w;
+      const uint8_t* c = pWork + static_cast<size_t>(neighbor(y, 1, h, options.wrap)) * w;
+      normal_row(a, b, c, w, center, k, options.wrap, dst.row(y));
+    }
+  });
+}
+
+/** Make the normals unit length.
+
+  The downsampled normals are shorter than 1. If the normals are canceled
+  out, the result is the flat normal.
+
+  @param image        the normal map that is made by make_normal_map().
+  @param threadCount  the maximum number of threads.
+*/
+void renormalize(const Bitmap& image, uint32_t threadCount)
+{
+  Parallel::for_range(image.height, threadCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t y = begin; y < end; ++y) {
+      uint8_t* p = image.row(y);
+      for (uint32_t x = 0; x < image.width; ++x, p += 4) {
+        const float nx = decode_component(p[2]);
+        const float ny = decode_component(p[1]);
+        const float nz = decode_component(p[0]);
+        const float len2 = nx * nx + ny * ny + nz * nz;
+        if (len2 < 1.0e-6f) {
+          p[0] = encode_component(1.0f);
+          p[1] = encode_component(0.0f);
+          p[2] = encode_component(0.0f);
+          continue;
+        }
+        const float len = std::sqrt(len2);
+        p[0] = encode_component(nz / len);
+        p[1] = encode_component(ny / len);
+        p[2] = encode_component(nx / len);
+      }
+    }
+  });
+}
+
+/** Store X and Y of the normal to the channels for the compression.
+
+  @param src     the normal map that is made by make_normal_map().
+  @param dst     the destination image. it has 3 bytes per pixel for
+                 NormalLayout_RG, or 4 bytes per pixel for NormalLayout_AG.
+                 its size should be same as src.
+  @param layout  the channels to store.
+*/
+void pack_normal(const Bitmap& src, const Bitmap& dst, NormalLayout layout)
+{
+  for (uint32_t y = 0; y < dst.height; ++y) {
+    const uint8_t* s = src.row(y);
+    uint8_t* d = dst.row(y);
+    for (uint32_t x = 0; x < dst.width; ++x, s += 4) {
+      if (layout == NormalLayout_RG) {
+        d[0] = 0;
+        d[1] = s[1];
+        d[2] = s[2];
+        d += 3;
+      } else {
+        d[0] = 0;
+        d[1] = s[1];
+        d[2] = 0;
+        d[3] = s[2];
+        d += 4;
+      }
+    }
+  }
+}
+
+} // namespace Image
+
+/** Get the arena size that is used by EncodeNormalMipChain().
+
+  @param w             the pixel width of the height map.
+  @param h             the pixel height of the height map.
+  @param outputFormat  Q_FORMAT_??? of the compressed image.
+  @param layout        the channels to store the normal.
+  @param maxLevel      the maximum number of mip levels.
+  @param filter        the filter to make the mipmaps.
+*/
+size_t GetNormalMipChainArenaSize(uint32_t w, uint32_t h, uint32_t outputFormat, Image::NormalLayout layout, uint32_t maxLevel, Image::Filter filter)
+{
+  const uint32_t packedBpp = layout == Image::NormalLayout_RG ? 3 : 4;
+  size_t size = Arena::aligned_size(Image::get_normal_map_work_size(w, h));
+  size += Arena::aligned_size(Image::get_size(w, h, 4));
+  size += Arena::aligned_size(Image::get_size(w, h, packedBpp));
+  size += GetMipChainArenaSize(Image::make_bitmap(nullptr, w, h, 4), outputFormat, maxLevel, filter, false);
+  return size;
+}
+
+/** Make the normal map from the height map, and compress it and its mipmaps.
+
+  Each level is downsampled from the normals of the upper level and
+  renormalized, then packed to the layout and compressed.
+
+  @param encoder       the encoder of the blocks.
+  @param image         the height map.
+  @param outputFormat  Q_FORMAT_??? of the compressed image.
+  @param layout        the channels to store the normal.
+  @param options       the parameters of the normal map.
+  @param maxLevel      the maximum number of mip levels.
+  @param filter        the filter to make the mipmaps.
+  @param threadCount   the maximum number of threads.
+  @param arena         the arena for the working memory. it should have the
+                       space of GetNormalMipChainArenaSize() at least.
+  @param ktx           the KTX file to store the compressed images. its data
+                       refer to the memory in the arena.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeNormalMipChain(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, Image::NormalLayout layout, const Image::NormalMapOptions& options, uint32_t maxLevel, Image::Filter filter, uint32_t threadCount, Arena& arena, KTX::File& ktx)
+{
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t levelCount = GetMipLevelCount(image.width, image.height, maxLevel);
+  KTX::initialize(&ktx.header, image.width, image.height, traits.glInternalFormat, traits.glBaseInternalFormat);
+  ktx.header.numberOfMipmapLevels = levelCount;
+  ktx.data.resize(levelCount);
+
+  const uint32_t w = image.width;
+  const uint32_t h = image.height;
+  const uint32_t packedBpp = layout == Image::NormalLayout_RG ? 3 : 4;
+  uint8_t* pWork = arena.allocate_array<uint8_t>(Image::get_normal_map_work_size(w, h));
+  const Image::Bitmap normal = Image::make_bitmap(arena.allocate(Image::get_size(w, h, 4)), w, h, 4);
+  uint8_t* pPacked = arena.allocate_array<uint8_t>(Image::get_size(w, h, packedBpp));
+  if (!pWork || !normal.bits || !pPacked) {
+    return false;
+  }
+  uint8_t* pMipWork = nullptr;
+  if (levelCount > 1) {
+    const size_t mipWorkSize = Image::get_mip_work_size(w, h, 4, filter, false);
+    pMipWork = arena.allocate_array<uint8_t>(mipWorkSize);
+    if (mipWorkSize && !pMipWork) {
+      return false;
+    }
+  }
+  Image::make_normal_map(image, normal, options, pWork, threadCount);
+
+  Image::Bitmap scratch[2];
+  Image::Bitmap current = normal;
+  for (uint32_t level = 0; ; ) {
+    const Image::Bitmap packed = Image::make_bitmap(pPacked, current.width, current.height, packedBpp);
+    Image::pack_normal(current, packed, layout);
+    const uint32_t imageSize = TextureFormat::get_image_size(traits, current.width, current.height);
+    uint8_t* pOut = arena.allocate_array<uint8_t>(imageSize);
+    if (!pOut || !EncodeImage(encoder, packed, outputFormat, pOut, imageSize)) {
+      return false;
+    }
+    ktx.data[level].imageSize = imageSize;
+    ktx.data[level].pBorrowed = pOut;
+    if (++level >= levelCount) {
+      break;
+    }
+    const uint32_t width = std::max(current.width / 2, 1U);
+    const uint32_t height = std::max(current.height / 2, 1U);
+    Image::Bitmap& next = scratch[level & 1];
+    if (level <= 2) {
+      void* p = arena.allocate(Image::get_size(width, height, 4));
+      if (!p) {
+        return false;
+      }
+      next = Image::make_bitmap(p, width, height, 4);
+    } else {
+      // The buffer of 2 levels above is large enough for this level.
+      next = Image::make_bitmap(next.bits, width, height, 4);
+    }
+    Image::make_mip(current, next, filter, false, pMipWork, threadCount);
+    Image::renormalize(next, threadCount);
+    current = next;
+  }
+  return true;
+}
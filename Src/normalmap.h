@@ -0,0 +1,61 @@
+/**
+  @file normalmap.h
+
+  Make the normal map from the height map.
+*/
+#ifndef NORMALMAP_H_INCLUDED
+#define NORMALMAP_H_INCLUDED
+#include "encoder.h"
+#include "image.h"
+#include "ktx.h"
+#include "resample.h"
+#include <cstdint>
+
+class Arena;
+
+namespace Image {
+
+/** The gradient filter to make the normal map.
+
+  They correspond to Q_FLAG_NORMALMAP_SOBEL and Q_FLAG_NORMALMAP_PREWITTGRADIENT
+  of TextureConverter.h.
+*/
+enum NormalFilter {
+  NormalFilter_None, ///< the image isn't a height map.
+  NormalFilter_Sobel, ///< 3x3 Sobel operator.
+  NormalFilter_Prewitt, ///< 3x3 Prewitt operator.
+};
+
+/** The channels to store the normal before the compression.
+
+  Z isn't stored. It is restored by sqrt(1 - X * X - Y * Y) in the shader.
+*/
+enum NormalLayout {
+  NormalLayout_RG, ///< X in the red, Y in the green. for the format without the alpha.
+  NormalLayout_AG, ///< X in the alpha, Y in the green. for the format with the alpha.
+};
+
+/** The parameters of the normal map.
+
+  They correspond to nNormalMapFlag, nNormalMapScale and nNormalMapWrap of
+  TFormatFlags.
+*/
+struct NormalMapOptions {
+  NormalFilter filter;
+  float scale; ///< the height of the white pixel in the unit of the pixel width.
+  bool wrap; ///< if true, the pixels at the edge refer the opposite edge. otherwise clamped.
+
+  NormalMapOptions() : filter(NormalFilter_None), scale(1.0f), wrap(false) {}
+};
+
+size_t get_normal_map_work_size(uint32_t w, uint32_t h);
+void make_normal_map(const Bitmap& src, const Bitmap& dst, const NormalMapOptions& options, uint8_t* pWork, uint32_t threadCount);
+void renormalize(const Bitmap& image, uint32_t threadCount);
+void pack_normal(const Bitmap& src, const Bitmap& dst, NormalLayout layout);
+
+} // namespace Image
+
+size_t GetNormalMipChainArenaSize(uint32_t w, uint32_t h, uint32_t outputFormat, Image::NormalLayout layout, uint32_t maxLevel, Image::Filter filter);
+bool EncodeNormalMipChain(const Encoder::IBlockEncoder& encoder, const Image::Bitmap& image, uint32_t outputFormat, Image::NormalLayout layout, const Image::NormalMapOptions& options, uint32_t maxLevel, Image::Filter filter, uint32_t threadCount, Arena& arena, KTX::File& ktx);
+
+#endif // NORMALMAP_H_INCLUDED
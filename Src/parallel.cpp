@@ -0,0 +1,91 @@
+/**
+  @file parallel.cpp
+*/
+#include "parallel.h"
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+namespace Parallel {
+
+/** Get the number of threads to use.
+
+  @param requested  the number of threads that is passed by the user. if it
+                    is 0, the number of the hardware threads is used.
+
+  @return the number of threads. it is 1 at least.
+*/
+uint32_t get_thread_count(uint32_t requested)
+{
+  if (requested) {
+    return requested;
+  }
+  return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+/** Call the function for each part of the range concurrently.
+
+  The range [0, count) is divided into the contiguous parts of almost same
+  size, and the function is called with the part [begin, end) on each thread.
+  The last part runs on the calling thread.
+  The partition depends on threadCount, so func should write only the items
+  in its part and shouldn't read the items written by the other parts. Then
+  the result is same for any thread count.
+
+  @param count        the size of the range.
+  @param threadCount  the maximum number of threads.
+  @param func         the function that is called with begin and end.
+*/
+void for_range(uint32_t count, uint32_t threadCount, const std::function<void(uint32_t, uint32_t)>& func)
+{
+  const uint32_t n = std::min(std::max(threadCount, 1U), count);
+  if (n <= 1) {
+    if (count) {
+      func(0, count);
+    }
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(n - 1);
+  uint32_t begin = 0;
+  for (uint32_t i = 0; i < n - 1; ++i) {
+    const uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (i + 1) / n);
+    threads.emplace_back(func, begin, end);
+    begin = end;
+  }
+  func(begin, count);
+  for (auto& e : threads) {
+    e.join();
+  }
+}
+
+/** Call the function for each index concurrently.
+
+  The threads take the next index one by one, so the items that take the
+  different time are balanced. e.g. the files of the various sizes.
+
+  @param count        the number of the indices.
+  @param threadCount  the maximum number of threads.
+  @param func         the function that is called with the index.
+*/
+void for_each(uint32_t count, uint32_t threadCount, const std::function<void(uint32_t)>& func)
+{
+  std::atomic<uint32_t> next(0);
+  const auto worker = [&]() {
+    for (uint32_t i = next++; i < count; i = next++) {
+      func(i);
+    }
+  };
+  const uint32_t n = std::min(std::max(threadCount, 1U), count);
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < n; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& e : threads) {
+    e.join();
+  }
+}
+
+} // namespace Parallel
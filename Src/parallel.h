@@ -0,0 +1,19 @@
+/**
+  @file parallel.h
+
+  Split the loop over the rows into the threads.
+*/
+#ifndef PARALLEL_H_INCLUDED
+#define PARALLEL_H_INCLUDED
+#include <cstdint>
+#include <functional>
+
+namespace Parallel {
+
+uint32_t get_thread_count(uint32_t requested);
+void for_range(uint32_t count, uint32_t threadCount, const std::function<void(uint32_t, uint32_t)>& func);
+void for_each(uint32_t count, uint32_t threadCount, const std::function<void(uint32_t)>& func);
+
+} // namespace Parallel
+
+#endif // PARALLEL_H_INCLUDED
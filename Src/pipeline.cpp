@@ -0,0 +1,207 @@
+/**
+  @file pipeline.cpp
+*/
+#include "pipeline.h"
+#include "arena.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace Pipeline {
+
+namespace /* unnamed */ {
+
+typedef std::chrono::steady_clock Clock;
+
+/** The queue between the stages.
+
+  push() waits while the queue is full, so the faster stage doesn't run too
+  far ahead of the slower one.
+*/
+template<typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t n) : capacity(n), isClosed(false) {}
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  /** Add the item to the back. It waits while the queue is full.
+  */
+  void push(T item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this]() { return items.size() < capacity; });
+    items.push_back(std::move(item));
+    notEmpty.notify_one();
+  }
+
+  /** Take the item from the front. It waits while the queue is empty.
+
+    @retval true  item has the front item.
+    @retval false the queue is empty and closed.
+  */
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this]() { return !items.empty() || isClosed; });
+    if (items.empty()) {
+      return false;
+    }
+    item = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  /** Wake up the consumer. No item is pushed after this.
+  */
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    isClosed = true;
+    notEmpty.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+  std::deque<T> items;
+  size_t capacity;
+  bool isClosed;
+};
+
+/** The file in the pipeline.
+*/
+struct Job {
+  Input input;
+  ConvertSource source;
+  ConvertOutput output;
+  Arena* pArena; ///< the arena that output refers to. it is returned to the pool after the writing.
+  ConvertResult code;
+  uint64_t inBytes;
+  Clock::duration elapsed; ///< the sum of the time of the stages.
+
+  Job() : pArena(nullptr), code(ConvertResult_Success), inBytes(0), elapsed() {}
+};
+
+typedef std::unique_ptr<Job> JobPtr;
+
+/** The number of the arenas. One is encoded while the other is written.
+*/
+static const uint32_t arenaCount = 2;
+
+} // unnamed namespace
+
+/** Convert the files by the pipeline.
+
+  The files are read on the read thread, decoded on the decode thread,
+  encoded on the calling thread, and written on the write thread. The file
+  I/O is the blocking I/O on its own thread, so it overlaps the encoding
+  whatever the platform supports.
+
+  The number of the files in the pipeline is limited to prefetchCount + 2,
+  that is, prefetchCount files are read or decoded ahead while a file is
+  encoded and the previous file is written. next() isn't called until the
+  room is made by the result of the previous file. The encoded textures
+  refer to one of the two arenas, and the arena is reused after the file is
+  written.
+
+  The failed stage is reported by the result, and the rest of its stages
+  are skipped.
+
+  @param next           the function to get the next file.
+  @param onResult       the function to receive the result.
+  @param prefetchCount  the number of the files that are read ahead of the
+                        encoding. it is 1 at least.
+*/
+void run(const NextFunc& next, const ResultFunc& onResult, uint32_t prefetchCount)
+{
+  prefetchCount = std::max(prefetchCount, 1U);
+  BoundedQueue<JobPtr> readQueue(prefetchCount);
+  BoundedQueue<JobPtr> decodeQueue(prefetchCount);
+  BoundedQueue<JobPtr> writeQueue(1);
+
+  // The tickets limit the number of the files that are taken by next().
+  BoundedQueue<int> tickets(prefetchCount + 2);
+  for (uint32_t i = 0; i < prefetchCount + 2; ++i) {
+    tickets.push(0);
+  }
+  Arena arenas[arenaCount];
+  BoundedQueue<Arena*> arenaPool(arenaCount);
+  for (Arena& e : arenas) {
+    arenaPool.push(&e);
+  }
+
+  std::thread reader([&]() {
+    int ticket;
+    while (tickets.pop(ticket)) {
+      JobPtr job(new Job);
+      if (!next(job->input)) {
+        break;
+      }
+      const auto start = Clock::now();
+      job->code = ReadSource(job->input.options, job->source);
+      job->inBytes = job->source.size;
+      job->elapsed += Clock::now() - start;
+      readQueue.push(std::move(job));
+    }
+    readQueue.close();
+  });
+
+  std::thread decoder([&]() {
+    JobPtr job;
+    while (readQueue.pop(job)) {
+      if (job->code == ConvertResult_Success) {
+        const auto start = Clock::now();
+        job->code = DecodeSource(job->input.options, job->source);
+        job->elapsed += Clock::now() - start;
+      }
+      decodeQueue.push(std::move(job));
+    }
+    decodeQueue.close();
+  });
+
+  std::thread writer([&]() {
+    JobPtr job;
+    while (writeQueue.pop(job)) {
+      if (job->code == ConvertResult_Success) {
+        const auto start = Clock::now();
+        job->code = WriteOutput(job->input.options, job->output);
+        job->elapsed += Clock::now() - start;
+      }
+      Result result;
+      result.input = std::move(job->input);
+      result.code = job->code;
+      result.inBytes = job->inBytes;
+      result.usec = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(job->elapsed).count());
+      Arena* pArena = job->pArena;
+      job.reset();
+      if (pArena) {
+        arenaPool.push(pArena);
+      }
+      onResult(result);
+      tickets.push(0);
+    }
+  });
+
+  JobPtr job;
+  while (decodeQueue.pop(job)) {
+    if (job->code == ConvertResult_Success) {
+      arenaPool.pop(job->pArena);
+      const auto start = Clock::now();
+      job->code = EncodeSource(job->input.options, job->source, *job->pArena, job->output);
+      job->elapsed += Clock::now() - start;
+    }
+    writeQueue.push(std::move(job));
+  }
+  writeQueue.close();
+
+  writer.join();
+  decoder.join();
+  reader.join();
+}
+
+} // namespace Pipeline
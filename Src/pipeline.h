@@ -0,0 +1,54 @@
+/**
+  @file pipeline.h
+
+  Convert the stream of the files by the pipeline of the stages.
+
+  ReadSource(), DecodeSource(), EncodeSource() and WriteOutput() of each
+  file run on the separate threads, and they are connected by the bounded
+  queues. While a file is encoded, the next files are read and decoded, and
+  the previous file is written, so the encoder doesn't wait for the disk.
+*/
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+#include "convert.h"
+#include <cstdint>
+#include <functional>
+
+namespace Pipeline {
+
+/** The file to convert.
+*/
+struct Input {
+  uint32_t id; ///< the id that is passed to the result.
+  ConvertOptions options;
+};
+
+/** The result of the file.
+*/
+struct Result {
+  Input input;
+  ConvertResult code;
+  uint64_t inBytes; ///< the byte size of the input file.
+  uint64_t usec; ///< the sum of the time of each stage.
+};
+
+/** Get the next file.
+
+  It is called on the read thread, and may wait for the file.
+
+  @retval true  the input is stored.
+  @retval false there is no more file.
+*/
+typedef std::function<bool(Input&)> NextFunc;
+
+/** Receive the result of the file.
+
+  It is called on the write thread in the order of the inputs.
+*/
+typedef std::function<void(const Result&)> ResultFunc;
+
+void run(const NextFunc& next, const ResultFunc& onResult, uint32_t prefetchCount);
+
+} // namespace Pipeline
+
+#endif // PIPELINE_H_INCLUDED
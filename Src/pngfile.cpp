@@ -0,0 +1,343 @@
+/**
+  @file pngfile.cpp
+*/
+#include "pngfile.h"
+#if ATCCONV_USE_FREEIMAGE
+#include <FreeImage.h>
+#else
+#include <png.h>
+#endif
+#include <fstream>
+#include <iterator>
+#include <cstring>
+
+namespace Image {
+
+namespace /* unnamed */ {
+
+/** Get 32bit big endian value.
+*/
+uint32_t GetBigEndian32(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+#if !ATCCONV_USE_FREEIMAGE
+/** Jump to setjmp() without the message, same as the simplified API of libpng.
+*/
+void OnPngError(png_structp png, png_const_charp) {
+  png_longjmp(png, 1);
+}
+
+/** Ignore the warning.
+*/
+void OnPngWarning(png_structp, png_const_charp) {
+}
+#endif // !ATCCONV_USE_FREEIMAGE
+
+} // unnamed namespace
+
+/** Read the size and the alpha of the PNG file.
+
+  Only the chunk headers before the image data are read, so it is much
+  faster than load(). It is used to estimate the cost of the conversion.
+
+  @param filename  the PNG file.
+  @param pHeader   the pointer to store the properties.
+
+  @retval true  success.
+  @retval false the file can't be read, or it isn't PNG.
+*/
+bool read_png_header(const std::string& filename, PngHeader* pHeader)
+{
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  uint8_t buf[13];
+  if (!ifs.read(reinterpret_cast<char*>(buf), 8) || memcmp(buf, signature, 8) != 0) {
+    return false;
+  }
+  bool hasHeader = false;
+  // The chunk is the length, the type, the data and CRC.
+  while (ifs.read(reinterpret_cast<char*>(buf), 8)) {
+    const uint32_t length = GetBigEndian32(buf);
+    if (memcmp(buf + 4, "IHDR", 4) == 0) {
+      if (length != 13 || !ifs.read(reinterpret_cast<char*>(buf), 13)) {
+        return false;
+      }
+      pHeader->width = GetBigEndian32(buf);
+      pHeader->height = GetBigEndian32(buf + 4);
+      // The color type 4 is the gray with the alpha, and 6 is RGBA.
+      pHeader->hasAlpha = (buf[9] & 4) != 0;
+      hasHeader = true;
+      ifs.seekg(4, std::ios::cur);
+    } else if (memcmp(buf + 4, "tRNS", 4) == 0) {
+      pHeader->hasAlpha = true;
+      break;
+    } else if (memcmp(buf + 4, "IDAT", 4) == 0 || memcmp(buf + 4, "IEND", 4) == 0) {
+      break;
+    } else {
+      ifs.seekg(static_cast<std::streamoff>(length) + 4, std::ios::cur);
+    }
+  }
+  return hasHeader;
+}
+
+/** Load the PNG file.
+
+  The whole file is read, and is decoded by load(pData, size).
+
+  @retval true  success.
+  @retval false the file can't be read or decoded.
+*/
+bool PngFile::load(const std::string& filename)
+{
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  if (!ifs || data.empty()) {
+    unload();
+    return false;
+  }
+  return load(data.data(), data.size());
+}
+
+PngFile::PngFile() : width(0), height(0), bytesPerPixel(0), pitch(0), bits(nullptr)
+#if ATCCONV_USE_FREEIMAGE
+  , dib(nullptr)
+#endif
+{
+}
+
+PngFile::~PngFile()
+{
+  unload();
+}
+
+#if ATCCONV_USE_FREEIMAGE
+
+/** Load the PNG file from the memory.
+
+  The image that isn't 24bit RGB or 32bit RGBA is converted to 32bit if it
+  has the transparency, otherwise 24bit.
+
+  @param pData  the content of the PNG file.
+  @param size   the byte size of pData.
+
+  @retval true  success.
+  @retval false the data can't be decoded or converted.
+*/
+bool PngFile::load(const uint8_t* pData, size_t size)
+{
+  unload();
+  FIMEMORY* pMemory = FreeImage_OpenMemory(const_cast<BYTE*>(pData), static_cast<DWORD>(size));
+  if (!pMemory) {
+    return false;
+  }
+  FIBITMAP* p = FreeImage_LoadFromMemory(FIF_PNG, pMemory, PNG_DEFAULT);
+  FreeImage_CloseMemory(pMemory);
+  if (!p) {
+    return false;
+  }
+  uint32_t bitPerPixel = FreeImage_GetBPP(p);
+  const FREE_IMAGE_COLOR_TYPE colorType = FreeImage_GetColorType(p);
+  if ((bitPerPixel != 24 && bitPerPixel != 32) || (colorType != FIC_RGB && colorType != FIC_RGBALPHA)) {
+    FIBITMAP* p2;
+    if (FreeImage_IsTransparent(p)) {
+      p2 = FreeImage_ConvertTo32Bits(p);
+      bitPerPixel = 32;
+    } else {
+      p2 = FreeImage_ConvertTo24Bits(p);
+      bitPerPixel = 24;
+    }
+    FreeImage_Unload(p);
+    if (!p2) {
+      return false;
+    }
+    p = p2;
+  }
+  dib = p;
+  width = FreeImage_GetWidth(p);
+  height = FreeImage_GetHeight(p);
+  bytesPerPixel = bitPerPixel / 8;
+  pitch = FreeImage_GetPitch(p);
+  bits = FreeImage_GetBits(p);
+  return true;
+}
+
+/** Release the pixels.
+*/
+void PngFile::unload()
+{
+  if (dib) {
+    FreeImage_Unload(static_cast<FIBITMAP*>(dib));
+    dib = nullptr;
+  }
+  bits = nullptr;
+}
+
+#else
+
+/** Load the PNG file from the memory.
+
+  The pixels are converted to 8bit BGRA if the image has the alpha channel
+  or the transparent color, otherwise 8bit BGR. The rows are stored from
+  bottom to top by the negative stride of libpng.
+
+  @param pData  the content of the PNG file.
+  @param size   the byte size of pData.
+
+  @retval true  success.
+  @retval false the data can't be decoded or converted.
+*/
+bool PngFile::load(const uint8_t* pData, size_t size)
+{
+  unload();
+  png_image image = {};
+  image.version = PNG_IMAGE_VERSION;
+  if (!png_image_begin_read_from_memory(&image, pData, size)) {
+    return false;
+  }
+  const bool hasAlpha = (image.format & PNG_FORMAT_FLAG_ALPHA) != 0;
+  image.format = hasAlpha ? PNG_FORMAT_BGRA : PNG_FORMAT_BGR;
+  width = image.width;
+  height = image.height;
+  bytesPerPixel = hasAlpha ? 4 : 3;
+  pitch = (width * bytesPerPixel + 3) & ~3U;
+  buffer.resize(static_cast<size_t>(pitch) * height);
+  if (!png_image_finish_read(&image, nullptr, buffer.data(), -static_cast<png_int_32>(pitch), nullptr)) {
+    png_image_free(&image);
+    buffer.clear();
+    return false;
+  }
+  bits = buffer.data();
+  return true;
+}
+
+/** Release the pixels.
+*/
+void PngFile::unload()
+{
+  std::vector<uint8_t>().swap(buffer);
+  bits = nullptr;
+}
+
+PngRowSource::PngRowSource() : fp(nullptr), png(nullptr), info(nullptr), imageWidth(0), imageHeight(0), bytesPerPixel(0), nextRow(0), hasError(false)
+{
+}
+
+PngRowSource::~PngRowSource()
+{
+  close();
+}
+
+/** Open the PNG file, and read its header.
+
+  The pixels are converted to 8bit BGRA if the image has the alpha channel
+  or the transparent color, otherwise 8bit BGR.
+
+  @retval true  success.
+  @retval false the file can't be read, or it can't be decoded row by row.
+*/
+bool PngRowSource::open(const std::string& filename)
+{
+  close();
+  fp = fopen(filename.c_str(), "rb");
+  if (!fp) {
+    return false;
+  }
+  png_structp p = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, OnPngError, OnPngWarning);
+  png_infop i = p ? png_create_info_struct(p) : nullptr;
+  png = p;
+  info = i;
+  if (!i) {
+    close();
+    return false;
+  }
+  if (setjmp(png_jmpbuf(p))) {
+    close();
+    return false;
+  }
+  png_init_io(p, fp);
+  png_read_info(p, i);
+  const png_byte colorType = png_get_color_type(p, i);
+  const bool hasAlpha = (colorType & PNG_COLOR_MASK_ALPHA) || png_get_valid(p, i, PNG_INFO_tRNS);
+  // The simplified API of PngFile converts the 16bit and the gamma encoded
+  // image by the gamma, so they are decoded by PngFile to get same pixels.
+  if (png_get_interlace_type(p, i) != PNG_INTERLACE_NONE || png_get_bit_depth(p, i) > 8 || png_get_valid(p, i, PNG_INFO_gAMA)) {
+    close();
+    return false;
+  }
+  png_set_expand(p);
+  png_set_gray_to_rgb(p);
+  png_set_bgr(p);
+  png_read_update_info(p, i);
+  imageWidth = png_get_image_width(p, i);
+  imageHeight = png_get_image_height(p, i);
+  bytesPerPixel = hasAlpha ? 4 : 3;
+  nextRow = 0;
+  hasError = false;
+  return png_get_rowbytes(p, i) == imageWidth * bytesPerPixel;
+}
+
+/** Close the file.
+*/
+void PngRowSource::close()
+{
+  if (png) {
+    png_structp p = static_cast<png_structp>(png);
+    png_infop i = static_cast<png_infop>(info);
+    png_destroy_read_struct(&p, i ? &i : nullptr, nullptr);
+    png = nullptr;
+    info = nullptr;
+  }
+  if (fp) {
+    fclose(fp);
+    fp = nullptr;
+  }
+}
+
+/** Decode the next rows.
+
+  If the file is broken, it fails and has_error() returns true.
+*/
+bool PngRowSource::read_rows(uint8_t* p, int32_t pitch, uint32_t count)
+{
+  if (!png || nextRow + count > imageHeight) {
+    return false;
+  }
+  png_structp s = static_cast<png_structp>(png);
+  if (setjmp(png_jmpbuf(s))) {
+    hasError = true;
+    return false;
+  }
+  // p isn't modified after setjmp(), so that it isn't clobbered by longjmp().
+  for (uint32_t i = 0; i < count; ++i, ++nextRow) {
+    png_read_row(s, p + static_cast<ptrdiff_t>(i) * pitch, nullptr);
+  }
+  return true;
+}
+
+#endif // ATCCONV_USE_FREEIMAGE
+
+/** Get the view of the pixels.
+
+  @param flipY  if false, the view is from the top row of the image. if true,
+                the view is flipped vertically. it walks the rows in the
+                memory order.
+
+  @return the view. it is valid until the file is unloaded.
+*/
+Bitmap PngFile::get_bitmap(bool flipY) const
+{
+  Bitmap image;
+  image.width = width;
+  image.height = height;
+  image.bytesPerPixel = bytesPerPixel;
+  image.pitch = static_cast<int32_t>(pitch);
+  image.bits = bits;
+  if (!flipY) {
+    image.bits = image.row(height - 1);
+    image.pitch = -image.pitch;
+  }
+  return image;
+}
+
+} // namespace Image
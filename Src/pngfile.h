@@ -0,0 +1,105 @@
+/**
+  @file pngfile.h
+
+  Load the PNG file by FreeImage or libpng.
+*/
+#ifndef PNGFILE_H_INCLUDED
+#define PNGFILE_H_INCLUDED
+#include "image.h"
+#include "stream.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/// If it is 1, FreeImage is used to load the PNG file. otherwise, libpng is used.
+#ifndef ATCCONV_USE_FREEIMAGE
+#ifdef _WIN32
+#define ATCCONV_USE_FREEIMAGE 1
+#else
+#define ATCCONV_USE_FREEIMAGE 0
+#endif
+#endif
+
+namespace Image {
+
+/** The properties of the PNG file that are read without the pixels.
+*/
+struct PngHeader {
+  uint32_t width;
+  uint32_t height;
+  bool hasAlpha; ///< the color type has the alpha, or the file has the transparent color.
+};
+
+bool read_png_header(const std::string& filename, PngHeader* pHeader);
+
+/** The pixels of the PNG file.
+
+  The pixels are stored as FreeImage does whichever library is used. The
+  rows are from bottom to top in the memory, each row is aligned to 4 bytes,
+  and the pixel is BGR(24bit) or BGRA(32bit).
+*/
+class PngFile {
+public:
+  PngFile();
+  ~PngFile();
+  PngFile(const PngFile&) = delete;
+  PngFile& operator=(const PngFile&) = delete;
+
+  bool load(const std::string& filename);
+  bool load(const uint8_t* pData, size_t size);
+  void unload();
+  Bitmap get_bitmap(bool flipY) const;
+
+private:
+  uint32_t width;
+  uint32_t height;
+  uint32_t bytesPerPixel;
+  uint32_t pitch;
+  uint8_t* bits; ///< the bottom row.
+#if ATCCONV_USE_FREEIMAGE
+  void* dib; ///< FIBITMAP.
+#else
+  std::vector<uint8_t> buffer;
+#endif
+};
+
+#if !ATCCONV_USE_FREEIMAGE
+
+/** The rows of the PNG file that are decoded on demand by libpng.
+
+  Only the current row is decoded, so the memory doesn't depend on the
+  image size. The pixels are same as PngFile, but the rows are from top to
+  bottom. open() fails for the interlaced, the 16bit and the gamma encoded
+  image, that should be decoded by PngFile as a whole.
+*/
+class PngRowSource : public RowSource {
+public:
+  PngRowSource();
+  virtual ~PngRowSource();
+  PngRowSource(const PngRowSource&) = delete;
+  PngRowSource& operator=(const PngRowSource&) = delete;
+
+  bool open(const std::string& filename);
+  void close();
+  virtual uint32_t width() const { return imageWidth; }
+  virtual uint32_t height() const { return imageHeight; }
+  virtual uint32_t bytes_per_pixel() const { return bytesPerPixel; }
+  virtual bool read_rows(uint8_t* p, int32_t pitch, uint32_t count);
+  bool has_error() const { return hasError; }
+
+private:
+  FILE* fp;
+  void* png; ///< png_structp.
+  void* info; ///< png_infop.
+  uint32_t imageWidth;
+  uint32_t imageHeight;
+  uint32_t bytesPerPixel;
+  uint32_t nextRow;
+  bool hasError; ///< if true, the file is broken.
+};
+
+#endif // !ATCCONV_USE_FREEIMAGE
+
+} // namespace Image
+
+#endif // PNGFILE_H_INCLUDED
@@ -0,0 +1,268 @@
+/**
+  @file preprocess.cpp
+*/
+#include "preprocess.h"
+#include "simd.h"
+#include <cstring>
+
+namespace Image {
+
+namespace /* unnamed */ {
+
+/** Multiply the color of one pixel by its alpha.
+
+  The result is rounded to the nearest, same as the SIMD version.
+*/
+inline uint8_t mul_alpha(uint32_t c, uint32_t a)
+{
+  const uint32_t t = c * a + 128;
+  return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+/** Multiply the color of the row by the alpha.
+
+  @param p      the top of the row. the pixel is 32bit BGRA.
+  @param count  the number of pixels in the row.
+*/
+void premultiply_row(uint8_t* p, uint32_t count)
+{
+  uint32_t x = 0;
+#if ATCCONV_HAS_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+  const __m128i alphaOne = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  const __m128i round = _mm_set1_epi16(128);
+  for (; x + 4 <= count; x += 4) {
+    __m128i* pv = reinterpret_cast<__m128i*>(p + x * 4);
+    const __m128i v = _mm_loadu_si128(pv);
+    __m128i result[2];
+    for (int i = 0; i < 2; ++i) {
+      const __m128i c = i == 0 ? _mm_unpacklo_epi8(v, zero) : _mm_unpackhi_epi8(v, zero);
+      __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      // The alpha itself is multiplied by 255/255.
+      a = _mm_or_si128(_mm_andnot_si128(alphaLanes, a), alphaOne);
+      const __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), round);
+      result[i] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+    _mm_storeu_si128(pv, _mm_packus_epi16(result[0], result[1]));
+  }
+#endif // ATCCONV_HAS_SSE2
+  for (; x < count; ++x) {
+    uint8_t* q = p + x * 4;
+    q[0] = mul_alpha(q[0], q[3]);
+    q[1] = mul_alpha(q[1], q[3]);
+    q[2] = mul_alpha(q[2], q[3]);
+  }
+}
+
+/** Add the color of the valid pixel of the upper row to the sum.
+
+  @param sum    the sum of BGR and the number of the valid pixels.
+  @param s      the pixel of the upper row.
+  @param valid  the valid flag of the pixel.
+*/
+inline void add_upper(uint16_t* sum, const uint8_t* s, uint8_t valid)
+{
+  if (valid) {
+    sum[0] += s[0];
+    sum[1] += s[1];
+    sum[2] += s[2];
+    ++sum[3];
+  }
+}
+
+/** Sum up the valid neighbors in the upper row for each pixel.
+
+  The neighbors are the upper-left, the upper and the upper-right. They don't
+  depend on the current row, so the whole row is summed up before the fill.
+
+  @param sums       the sums of the row. each pixel has BGR and the number of
+                    the valid neighbors.
+  @param prev       the top of the upper row.
+  @param begin      the first pixel to sum up.
+  @param count      the number of pixels in the row.
+  @param prevValid  the valid flags of the upper row. each flag is 0 or 1.
+*/
+void sum_upper_row(uint16_t* sums, const uint8_t* prev, uint32_t begin, uint32_t count, const uint8_t* prevValid)
+{
+  uint32_t x = begin;
+  const auto sum_pixel = [&](uint32_t i) {
+    uint16_t* sum = sums + i * 4;
+    sum[0] = sum[1] = sum[2] = sum[3] = 0;
+    if (i > 0) {
+      add_upper(sum, prev + (i - 1) * 4, prevValid[i - 1]);
+    }
+    add_upper(sum, prev + i * 4, prevValid[i]);
+    if (i + 1 < count) {
+      add_upper(sum, prev + (i + 1) * 4, prevValid[i + 1]);
+    }
+  };
+#if ATCCONV_HAS_SSE2
+  if (x + 4 <= count) {
+    if (x == 0) {
+      sum_pixel(0);
+      x = 1;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaBytes = _mm_set1_epi32(0xff000000);
+    // 2 pixels from the 4 pixels of the upper row(x - 1 ... x + 2).
+    for (; x + 3 <= count; x += 2) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + (x - 1) * 4));
+      int32_t flags;
+      memcpy(&flags, prevValid + x - 1, 4);
+      __m128i f = _mm_cvtsi32_si128(flags);
+      f = _mm_unpacklo_epi8(f, f);
+      f = _mm_unpacklo_epi16(f, f);
+      // The color of the invalid pixel is 0, and the alpha is replaced by the
+      // valid flag to count the valid pixels.
+      const __m128i mask = _mm_cmpgt_epi8(f, zero);
+      const __m128i c = _mm_or_si128(_mm_andnot_si128(alphaBytes, _mm_and_si128(v, mask)), _mm_and_si128(f, alphaBytes));
+      const __m128i lo = _mm_unpacklo_epi8(c, zero);
+      const __m128i hi = _mm_unpackhi_epi8(c, zero);
+      const __m128i mid = _mm_or_si128(_mm_srli_si128(lo, 8), _mm_slli_si128(hi, 8));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x * 4), _mm_add_epi16(_mm_add_epi16(lo, mid), hi));
+    }
+  }
+#endif // ATCCONV_HAS_SSE2
+  for (; x < count; ++x) {
+    sum_pixel(x);
+  }
+}
+
+/** Fill the color of the transparent pixels in the row.
+
+  The pixel is valid if it isn't transparent or its color has been filled.
+  The transparent pixel takes the average color of the valid neighbors in the
+  left, the upper-left, the upper and the upper-right, then the pixels that
+  are still invalid take the color of the valid right neighbor.
+
+  The upper neighbors are summed up by sum_upper_row() from the first
+  transparent pixel to the end of the row, and only the left neighbor, that
+  may be filled just before, is added one by one.
+
+  @param p      the top of the row. the pixel is 32bit BGRA.
+  @param prev   the top of the upper row, or nullptr for the first row.
+  @param count  the number of pixels in the row.
+  @param valid  the valid flags of the row. it is updated by this function.
+  @param prevValid  the valid flags of the upper row.
+  @param sums   the work memory of 4 uint16_t per pixel for sum_upper_row().
+
+  @return true if the row has one valid pixel at least.
+*/
+bool bleed_row(uint8_t* p, const uint8_t* prev, uint32_t count, uint8_t* valid, const uint8_t* prevValid, uint16_t* sums)
+{
+  uint32_t x = 0;
+  for (; x < count && p[x * 4 + 3] != 0; ++x) {
+    valid[x] = 1;
+  }
+  if (x == count) {
+    return count > 0;
+  }
+  if (prev) {
+    sum_upper_row(sums, prev, x, count, prevValid);
+  }
+  bool hasValid = x > 0;
+  for (; x < count; ++x) {
+    uint8_t* q = p + x * 4;
+    if (q[3] != 0) {
+      valid[x] = 1;
+      hasValid = true;
+      continue;
+    }
+    uint32_t sum[3] = { 0, 0, 0 };
+    uint32_t n = 0;
+    if (prev) {
+      const uint16_t* upper = sums + x * 4;
+      sum[0] = upper[0];
+      sum[1] = upper[1];
+      sum[2] = upper[2];
+      n = upper[3];
+    }
+    if (x > 0 && valid[x - 1]) {
+      sum[0] += q[-4];
+      sum[1] += q[-3];
+      sum[2] += q[-2];
+      ++n;
+    }
+    if (n) {
+      // The division by 1 to 4 is the multiplication of the reciprocal. it is
+      // exact while the sum is less than 32768.
+      static const uint32_t reciprocal[5] = { 0, 65536, 32768, 21846, 16384 };
+      const uint32_t r = reciprocal[n];
+      q[0] = static_cast<uint8_t>(((sum[0] + n / 2) * r) >> 16);
+      q[1] = static_cast<uint8_t>(((sum[1] + n / 2) * r) >> 16);
+      q[2] = static_cast<uint8_t>(((sum[2] + n / 2) * r) >> 16);
+      valid[x] = 1;
+      hasValid = true;
+    } else {
+      valid[x] = 0;
+    }
+  }
+  if (hasValid) {
+    for (uint32_t x = count - 1; x > 0; --x) {
+      if (!valid[x - 1] && valid[x]) {
+        memcpy(p + (x - 1) * 4, p + x * 4, 3);
+        valid[x - 1] = 1;
+      }
+    }
+  }
+  return hasValid;
+}
+
+} // unnamed namespace
+
+/** Get the byte size of the work memory for preprocess().
+
+  @param width  the pixel width of the image.
+*/
+size_t get_preprocess_work_size(uint32_t width)
+{
+  // The sums of the upper neighbors and the valid flags of 2 rows.
+  return static_cast<size_t>(width) * (sizeof(uint16_t) * 4 + 2);
+}
+
+/** Process the transparent pixels in place.
+
+  The image is processed row by row in one pass from top to bottom. The rows
+  at the top that have no valid pixels are filled after the first valid row.
+
+  @param image  the image to process. only the 32bit image is processed.
+  @param mode   the processing mode.
+  @param pWork  the work memory of get_preprocess_work_size() bytes. it is
+                used by TransparentMode_Bleed.
+*/
+void preprocess(const Bitmap& image, TransparentMode mode, uint8_t* pWork)
+{
+  if (image.bytesPerPixel != 4 || mode == TransparentMode_None) {
+    return;
+  }
+  if (mode == TransparentMode_Premultiply) {
+    for (uint32_t y = 0; y < image.height; ++y) {
+      premultiply_row(image.row(y), image.width);
+    }
+    return;
+  }
+
+  uint16_t* sums = reinterpret_cast<uint16_t*>(pWork);
+  uint8_t* valid[2] = { pWork + image.width * sizeof(uint16_t) * 4, pWork + image.width * (sizeof(uint16_t) * 4 + 1) };
+  uint32_t invalidRows = 0;
+  for (uint32_t y = 0; y < image.height; ++y) {
+    uint8_t* p = image.row(y);
+    const bool hasPrev = y > 0 && invalidRows < y;
+    if (bleed_row(p, hasPrev ? image.row(y - 1) : nullptr, image.width, valid[y & 1], valid[(y + 1) & 1], sums)) {
+      // All pixels in the rows above are transparent, so they take the color
+      // of this row.
+      for (; invalidRows > 0; --invalidRows) {
+        const uint32_t dst = y - invalidRows;
+        uint8_t* d = image.row(dst);
+        for (uint32_t x = 0; x < image.width; ++x) {
+          memcpy(d + x * 4, p + x * 4, 3);
+        }
+      }
+    } else {
+      ++invalidRows;
+    }
+  }
+}
+
+} // namespace Image
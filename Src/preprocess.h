@@ -0,0 +1,25 @@
+/**
+  @file preprocess.h
+
+  Fix the color of the transparent pixels before the compression.
+*/
+#ifndef PREPROCESS_H_INCLUDED
+#define PREPROCESS_H_INCLUDED
+#include "image.h"
+
+namespace Image {
+
+/** The processing of the transparent pixels.
+*/
+enum TransparentMode {
+  TransparentMode_None, ///< keep the color as is.
+  TransparentMode_Premultiply, ///< multiply the color by the alpha.
+  TransparentMode_Bleed, ///< fill the color of the transparent pixels from the neighbors.
+};
+
+size_t get_preprocess_work_size(uint32_t width);
+void preprocess(const Bitmap& image, TransparentMode mode, uint8_t* pWork);
+
+} // namespace Image
+
+#endif // PREPROCESS_H_INCLUDED
@@ -0,0 +1,92 @@
+/**
+  @file process.cpp
+*/
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <unistd.h>
+#endif
+#include "process.h"
+
+#ifndef _WIN32
+extern char** environ;
+#endif
+
+/** Start the process that runs after this process exits.
+
+  The standard output is shared with this process. The process isn't waited,
+  so its exit code is lost.
+
+  @param args  the program path and the arguments. the program is searched in
+               PATH if it has no directory.
+
+  @retval true  the process is started.
+  @retval false failure.
+*/
+bool SpawnDetachedProcess(const std::vector<std::string>& args) {
+  if (args.empty()) {
+    return false;
+  }
+#ifdef _WIN32
+  // The arguments are quoted by the rule of CommandLineToArgvW().
+  std::string commandLine;
+  for (const auto& arg : args) {
+    if (!commandLine.empty()) {
+      commandLine += ' ';
+    }
+    if (!arg.empty() && arg.find_first_of(" \t\"") == std::string::npos) {
+      commandLine += arg;
+      continue;
+    }
+    commandLine += '"';
+    size_t backslashCount = 0;
+    for (char c : arg) {
+      if (c == '\\') {
+        ++backslashCount;
+        continue;
+      }
+      commandLine.append(c == '"' ? backslashCount * 2 + 1 : backslashCount, '\\');
+      commandLine += c;
+      backslashCount = 0;
+    }
+    commandLine.append(backslashCount * 2, '\\');
+    commandLine += '"';
+  }
+  char modulePath[MAX_PATH];
+  const DWORD length = GetModuleFileNameA(nullptr, modulePath, MAX_PATH);
+  STARTUPINFOA si = { sizeof(si) };
+  PROCESS_INFORMATION pi;
+  if (!CreateProcessA(length && length < MAX_PATH ? modulePath : nullptr, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi)) {
+    return false;
+  }
+  CloseHandle(pi.hThread);
+  CloseHandle(pi.hProcess);
+  return true;
+#else
+  std::vector<char*> argv;
+  for (const auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  // The child isn't waited, so it is reaped by init after this process exits.
+  pid_t pid;
+  return posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) == 0;
+#endif
+}
+
+/** Get the process ID of this process.
+
+  It is unique among the running processes, so it distinguishes the files
+  of the processes that run at the same time.
+*/
+uint32_t GetThisProcessId() {
+#ifdef _WIN32
+  return static_cast<uint32_t>(GetCurrentProcessId());
+#else
+  return static_cast<uint32_t>(getpid());
+#endif
+}
@@ -0,0 +1,15 @@
+/**
+  @file process.h
+
+  Start the other process of this program.
+*/
+#ifndef PROCESS_H_INCLUDED
+#define PROCESS_H_INCLUDED
+#include <cstdint>
+#include <string>
+#include <vector>
+
+bool SpawnDetachedProcess(const std::vector<std::string>& args);
+uint32_t GetThisProcessId();
+
+#endif // PROCESS_H_INCLUDED
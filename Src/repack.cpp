@@ -0,0 +1,368 @@
+/**
+  @file repack.cpp
+*/
+#include "repack.h"
+#include "arena.h"
+#include "format.h"
+#include "parallel.h"
+#include "encoder.h"
+#include <TextureConverter.h>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <utility>
+
+namespace /* unnamed */ {
+
+/** The shape of the texture that is repacked.
+*/
+struct RepackLayout {
+  const TextureFormat::Traits* pSrcTraits;
+  const TextureFormat::Traits* pDstTraits;
+  uint32_t width;
+  uint32_t height;
+  uint32_t srcLevelCount; ///< the number of levels in the input.
+  uint32_t levelCount; ///< the number of levels in the output.
+};
+
+/** Replace the value in "ATCConv.settings" of the key/value data.
+
+  The settings are the space separated 'name=value' written by the
+  conversion. If the name isn't in them, 'name=value' is appended. If the
+  key/value data has no settings, nothing is done.
+
+  @param keyValues  the key/value data of the repacked texture.
+  @param name       the name of the setting, e.g. "format".
+  @param value      the new value.
+*/
+void SetSettingsValue(std::vector<KTX::KeyValue>& keyValues, const std::string& name, const std::string& value) {
+  for (auto& kv : keyValues) {
+    if (kv.key != "ATCConv.settings") {
+      continue;
+    }
+    // The text value has the terminating NUL.
+    const std::string settings(kv.value.c_str());
+    std::string result;
+    bool isFound = false;
+    size_t pos = 0;
+    while (pos < settings.size()) {
+      size_t end = settings.find(' ', pos);
+      if (end == std::string::npos) {
+        end = settings.size();
+      }
+      std::string token = settings.substr(pos, end - pos);
+      if (token.compare(0, name.size() + 1, name + "=") == 0) {
+        token = name + "=" + value;
+        isFound = true;
+      }
+      if (!token.empty()) {
+        result += (result.empty() ? "" : " ") + token;
+      }
+      pos = end + 1;
+    }
+    if (!isFound) {
+      result += (result.empty() ? "" : " ") + name + "=" + value;
+    }
+    kv.value.assign(result.c_str(), result.size() + 1);
+  }
+}
+
+/** Get the shape of the repacked texture.
+
+  imageSize of each level of src is checked by the format, because the
+  levels of the same format are moved to the output as is.
+
+  @retval true  success.
+  @retval false the format of src isn't supported, or its level has the
+                wrong size.
+*/
+bool GetRepackLayout(const KTX::File& src, uint32_t outputFormat, uint32_t maxLevel, RepackLayout* pLayout) {
+  const KTX::Endian e = KTX::get_endian(src.header);
+  pLayout->pSrcTraits = TextureFormat::find_by_gl_format(KTX::get_value(&src.header.glInternalFormat, e));
+  pLayout->pDstTraits = outputFormat == Q_FORMAT_UNKNOWN ? pLayout->pSrcTraits : TextureFormat::find(outputFormat);
+  if (!pLayout->pSrcTraits || !pLayout->pDstTraits || src.data.empty()) {
+    return false;
+  }
+  pLayout->width = KTX::get_value(&src.header.pixelWidth, e);
+  pLayout->height = std::max(KTX::get_value(&src.header.pixelHeight, e), 1U);
+  pLayout->srcLevelCount = static_cast<uint32_t>(src.data.size());
+  pLayout->levelCount = maxLevel ? GetMipLevelCount(pLayout->width, pLayout->height, maxLevel) : pLayout->srcLevelCount;
+  for (uint32_t level = 0; level < pLayout->srcLevelCount; ++level) {
+    const KTX::File::Data& data = src.data[level];
+    const uint32_t w = std::max(pLayout->width >> level, 1U);
+    const uint32_t h = std::max(pLayout->height >> level, 1U);
+    if (data.imageSize != TextureFormat::get_level_size(*pLayout->pSrcTraits, w, h) || data.size() < data.imageSize) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // unnamed namespace
+
+/** Get the arena size that is used by RepackTexture().
+
+  @param src           the input texture.
+  @param outputFormat  Q_FORMAT_??? of the output. if Q_FORMAT_UNKNOWN, the
+                       format of src is kept.
+  @param maxLevel      the maximum number of mip levels. if 0, the number of
+                       levels of src is kept.
+  @param filter        the filter to make the added mip levels.
+
+  @return the byte size of the arena. it is 0 if all levels are reused.
+*/
+size_t GetRepackArenaSize(const KTX::File& src, uint32_t outputFormat, uint32_t maxLevel, Image::Filter filter) {
+  RepackLayout layout;
+  if (!GetRepackLayout(src, outputFormat, maxLevel, &layout)) {
+    return 0;
+  }
+  const bool isSameFormat = layout.pSrcTraits == layout.pDstTraits;
+  const bool hasNewLevel = layout.levelCount > layout.srcLevelCount;
+  size_t size = 0;
+  uint32_t w = layout.width;
+  uint32_t h = layout.height;
+  if (!isSameFormat || hasNewLevel) {
+    // The decoded image of any level fits in the top level buffer.
+    size += Arena::aligned_size(Image::get_size(w, h, 4));
+  }
+  for (uint32_t level = 0; level < layout.levelCount; ++level) {
+    if (level + 1 == layout.srcLevelCount && hasNewLevel) {
+      size += Arena::aligned_size(Image::get_mip_work_size(w, h, 4, filter, false));
+      size += Arena::aligned_size(Image::get_size(std::max(w / 2, 1U), std::max(h / 2, 1U), 4));
+    }
+    if (!isSameFormat || level >= layout.srcLevelCount) {
+      size += Arena::aligned_size(TextureFormat::get_image_size(*layout.pDstTraits, w, h));
+    }
+    w = std::max(w / 2, 1U);
+    h = std::max(h / 2, 1U);
+  }
+  return size;
+}
+
+/** Repack the texture.
+
+  The levels that have the same format are moved from src as is. The other
+  levels are decoded and encoded again, and the added levels are made from
+  the smallest level of src.
+
+  @param encoder       the encoder of the blocks.
+  @param src           the input texture. the reused levels are moved to dst.
+  @param outputFormat  Q_FORMAT_??? of the output. if Q_FORMAT_UNKNOWN, the
+                       format of src is kept.
+  @param maxLevel      the maximum number of mip levels. if 0, the number of
+                       levels of src is kept.
+  @param filter        the filter to make the added mip levels.
+  @param threadCount   the number of threads for the filter.
+  @param arena         the arena for the working memory and the encoded
+                       levels. it should have the space of
+                       GetRepackArenaSize() at least.
+  @param dst           the repacked texture. its encoded levels are borrowed
+                       from arena.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool RepackTexture(const Encoder::IBlockEncoder& encoder, KTX::File& src, uint32_t outputFormat, uint32_t maxLevel, Image::Filter filter, uint32_t threadCount, Arena& arena, KTX::File& dst) {
+  RepackLayout layout;
+  if (!GetRepackLayout(src, outputFormat, maxLevel, &layout)) {
+    return false;
+  }
+  const TextureFormat::Traits& srcTraits = *layout.pSrcTraits;
+  const TextureFormat::Traits& dstTraits = *layout.pDstTraits;
+  const bool isSameFormat = &srcTraits == &dstTraits;
+  const bool hasNewLevel = layout.levelCount > layout.srcLevelCount;
+  if (isSameFormat) {
+    // The header of the input is kept, so the endianness is also kept.
+    dst.header = src.header;
+    KTX::set_value(&dst.header.numberOfMipmapLevels, layout.levelCount, KTX::get_endian(src.header));
+    // The old converter wrote the compressed format here.
+    KTX::set_value(&dst.header.glBaseInternalFormat, dstTraits.glBaseInternalFormat, KTX::get_endian(src.header));
+  } else {
+    KTX::initialize(&dst.header, layout.width, layout.height, dstTraits.glInternalFormat, dstTraits.glBaseInternalFormat);
+    dst.header.numberOfMipmapLevels = layout.levelCount;
+  }
+  // The settings tell how the levels are encoded, so they follow the
+  // re-encoded format and the new number of levels.
+  dst.keyValues = src.keyValues;
+  if (!isSameFormat) {
+    SetSettingsValue(dst.keyValues, "format", dstTraits.name);
+    SetSettingsValue(dst.keyValues, "encoder", encoder.name());
+  }
+  if (layout.levelCount != layout.srcLevelCount) {
+    SetSettingsValue(dst.keyValues, "levels", std::to_string(layout.levelCount));
+  }
+  if (hasNewLevel) {
+    SetSettingsValue(dst.keyValues, "filter", Image::get_filter_name(filter));
+  }
+  dst.data.clear();
+  dst.data.resize(layout.levelCount);
+
+  uint8_t* pDecoded = nullptr;
+  if (!isSameFormat || hasNewLevel) {
+    pDecoded = arena.allocate_array<uint8_t>(Image::get_size(layout.width, layout.height, 4));
+    if (!pDecoded) {
+      return false;
+    }
+  }
+  const auto encode = [&](const Image::Bitmap& image, uint32_t level) {
+    const uint32_t size = TextureFormat::get_image_size(dstTraits, image.width, image.height);
+    uint8_t* pOut = arena.allocate_array<uint8_t>(size);
+    if (!pOut || !EncodeImage(encoder, image, dstTraits.qformat, pOut, size)) {
+      return false;
+    }
+    dst.data[level].imageSize = size;
+    dst.data[level].pBorrowed = pOut;
+    return true;
+  };
+
+  // The new levels are made first, because the smallest level of src may be
+  // moved to dst below.
+  if (hasNewLevel) {
+    const uint32_t lastLevel = layout.srcLevelCount - 1;
+    uint32_t w = std::max(layout.width >> lastLevel, 1U);
+    uint32_t h = std::max(layout.height >> lastLevel, 1U);
+    Image::Bitmap mip = Image::make_bitmap(pDecoded, w, h, 4);
+    const KTX::File::Data& last = src.data[lastLevel];
+    if (!Encoder::decode(encoder, last.bytes(), last.imageSize, srcTraits.qformat, mip)) {
+      return false;
+    }
+    uint8_t* pWork = arena.allocate_array<uint8_t>(Image::get_mip_work_size(w, h, 4, filter, false));
+    uint8_t* pBuffers[2] = { arena.allocate_array<uint8_t>(Image::get_size(std::max(w / 2, 1U), std::max(h / 2, 1U), 4)), pDecoded };
+    if (!pBuffers[0]) {
+      return false;
+    }
+    for (uint32_t level = layout.srcLevelCount; level < layout.levelCount; ++level) {
+      w = std::max(w / 2, 1U);
+      h = std::max(h / 2, 1U);
+      const Image::Bitmap next = Image::make_bitmap(pBuffers[(level - layout.srcLevelCount) & 1], w, h, 4);
+      Image::make_mip(mip, next, filter, false, pWork, threadCount);
+      if (!encode(next, level)) {
+        return false;
+      }
+      mip = next;
+    }
+  }
+
+  const uint32_t keptLevelCount = std::min(layout.levelCount, layout.srcLevelCount);
+  for (uint32_t level = 0; level < keptLevelCount; ++level) {
+    if (isSameFormat) {
+      dst.data[level] = std::move(src.data[level]);
+      continue;
+    }
+    const Image::Bitmap image = Image::make_bitmap(pDecoded, std::max(layout.width >> level, 1U), std::max(layout.height >> level, 1U), 4);
+    if (!Encoder::decode(encoder, src.data[level].bytes(), src.data[level].imageSize, srcTraits.qformat, image) || !encode(image, level)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Repack KTX files to a KTX file.
+
+  @param options  the repack parameters.
+  @param arena    the arena for the working memory. it is reset at the start
+                  of the repack.
+
+  @return ConvertResult_Success if the repack is succeeded, otherwise the
+          error code.
+*/
+ConvertResult RepackFile(const RepackOptions& options, Arena& arena) {
+  std::vector<KTX::File> srcFiles(options.infilenames.size());
+  size_t arenaSize = 0;
+  for (size_t i = 0; i < srcFiles.size(); ++i) {
+    if (!KTX::read_texture(options.infilenames[i], srcFiles[i])) {
+      std::cout << std::endl << "Can't read '" << options.infilenames[i] << "'." << std::endl;
+      return ConvertResult_ReadError;
+    }
+    arenaSize += GetRepackArenaSize(srcFiles[i], options.outputFormat, options.maxLevel, options.mipFilter);
+  }
+  arena.reset();
+  arena.reserve(arenaSize);
+
+  const uint32_t threadCount = Parallel::get_thread_count(options.threadCount);
+  std::vector<KTX::File> dstFiles(srcFiles.size());
+  for (size_t i = 0; i < srcFiles.size(); ++i) {
+    if (!RepackTexture(*options.encoder, srcFiles[i], options.outputFormat, options.maxLevel, options.mipFilter, threadCount, arena, dstFiles[i])) {
+      std::cout << "Can't repack '" << options.infilenames[i] << "'." << std::endl;
+      return ConvertResult_ConvertError;
+    }
+  }
+
+  if (!options.cubemap) {
+    return KTX::write_texture(options.outfilename, dstFiles[0]) ? ConvertResult_Success : ConvertResult_WriteError;
+  }
+  // The header and the key/value data of the first face are written.
+  const KTX::Header& front = dstFiles[0].header;
+  const KTX::Endian e = KTX::get_endian(front);
+  if (KTX::get_value(&front.pixelWidth, e) != KTX::get_value(&front.pixelHeight, e)) {
+    std::cout << "Error: the face of the cubemap should be square." << std::endl;
+    return ConvertResult_ConvertError;
+  }
+  for (const auto& face : dstFiles) {
+    const KTX::Endian faceEndian = KTX::get_endian(face.header);
+    if (faceEndian != e ||
+      KTX::get_value(&face.header.glInternalFormat, e) != KTX::get_value(&front.glInternalFormat, e) ||
+      KTX::get_value(&face.header.pixelWidth, e) != KTX::get_value(&front.pixelWidth, e) ||
+      KTX::get_value(&face.header.pixelHeight, e) != KTX::get_value(&front.pixelHeight, e) ||
+      face.data.size() != dstFiles[0].data.size()) {
+      std::cout << "Error: the faces of the cubemap should have the same format, size and mip levels." << std::endl;
+      return ConvertResult_ConvertError;
+    }
+  }
+  return KTX::write_cubemap(options.outfilename, dstFiles) ? ConvertResult_Success : ConvertResult_WriteError;
+}
+
+/** Repack KTX files.
+
+  usage: repack [-f format] [-m count] [-filter name] [-j count] [-c] [-encoder name] infile... outfile
+
+  @param argc  the number of arguments after the subcommand.
+  @param argv  the arguments after the subcommand.
+
+  @return the exit code.
+*/
+int RunRepack(int argc, char** argv) {
+  RepackOptions options;
+  std::vector<std::string> filenames;
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      const TextureFormat::Traits* pTraits = TextureFormat::find_by_name(argv[++i]);
+      if (!pTraits || !pTraits->isCompressed) {
+        std::cout << "Error: '" << argv[i] << "' is unknown format." << std::endl;
+        return 1;
+      }
+      options.outputFormat = pTraits->qformat;
+    } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      options.maxLevel = std::max(1, std::min(16, std::atoi(argv[++i])));
+    } else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+      if (!Image::get_filter_by_name(argv[++i], &options.mipFilter)) {
+        std::cout << "Error: '" << argv[i] << "' is unknown filter." << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      options.threadCount = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-c") == 0) {
+      options.cubemap = true;
+    } else if ((strcmp(argv[i], "-encoder") == 0 && i + 1 < argc) || strncmp(argv[i], "--encoder=", 10) == 0) {
+      const char* name = argv[i][1] == '-' ? argv[i] + 10 : argv[++i];
+      const Encoder::IBlockEncoder* pEncoder = Encoder::find(name);
+      if (!pEncoder) {
+        std::cout << "Error: '" << name << "' is unknown encoder or isn't built in." << std::endl;
+        return 1;
+      }
+      options.encoder = pEncoder;
+    } else {
+      filenames.push_back(argv[i]);
+    }
+  }
+  if (filenames.size() != (options.cubemap ? 7U : 2U)) {
+    std::cout << "Error: 'repack' needs " << (options.cubemap ? "6 infiles" : "an infile") << " and an outfile." << std::endl;
+    return 1;
+  }
+  options.outfilename = filenames.back();
+  filenames.pop_back();
+  options.infilenames.swap(filenames);
+  Arena arena;
+  return RepackFile(options, arena);
+}
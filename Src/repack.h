@@ -0,0 +1,35 @@
+/**
+  @file repack.h
+
+  Repack KTX files without the source PNG files.
+*/
+#ifndef REPACK_H_INCLUDED
+#define REPACK_H_INCLUDED
+#include "convert.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Arena;
+
+/** The repack parameters.
+*/
+struct RepackOptions {
+  std::vector<std::string> infilenames; ///< the input KTX files. 6 files in the order of +X, -X, +Y, -Y, +Z, -Z for the cubemap.
+  std::string outfilename;
+  uint32_t outputFormat; ///< Q_FORMAT_???. if Q_FORMAT_UNKNOWN, the format of the input is kept.
+  uint32_t maxLevel; ///< the maximum number of mip levels. if 0, the number of levels of the input is kept.
+  bool cubemap; ///< if true, the input files are merged into a cubemap.
+  Image::Filter mipFilter; ///< the filter to make the added mip levels.
+  uint32_t threadCount;
+  const Encoder::IBlockEncoder* encoder; ///< the encoder to decode and encode the levels that aren't kept.
+
+  RepackOptions() : outputFormat(Q_FORMAT_UNKNOWN), maxLevel(0), cubemap(false), mipFilter(Image::Filter_Bicubic), threadCount(0), encoder(&Encoder::get_default()) {}
+};
+
+size_t GetRepackArenaSize(const KTX::File& src, uint32_t outputFormat, uint32_t maxLevel, Image::Filter filter);
+bool RepackTexture(const Encoder::IBlockEncoder& encoder, KTX::File& src, uint32_t outputFormat, uint32_t maxLevel, Image::Filter filter, uint32_t threadCount, Arena& arena, KTX::File& dst);
+ConvertResult RepackFile(const RepackOptions& options, Arena& arena);
+int RunRepack(int argc, char** argv);
+
+#endif // REPACK_H_INCLUDED
@@ -0,0 +1,544 @@
+/**
+  @file resample.cpp
+*/
+#include "resample.h"
+#include "arena.h"
+#include "parallel.h"
+#include "simd.h"
+#include "srgb.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+namespace Image {
+
+namespace /* unnamed */ {
+
+/** The fixed point precision of the weights.
+*/
+const int32_t weightBits = 14;
+
+/** The filter function and its radius in the source pixels.
+*/
+struct Kernel {
+  double (*func)(double);
+  double radius;
+};
+
+double triangle(double x)
+{
+  x = std::fabs(x);
+  return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+double catmull_rom(double x)
+{
+  const double a = -0.5;
+  x = std::fabs(x);
+  if (x < 1.0) {
+    return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+  }
+  if (x < 2.0) {
+    return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+  }
+  return 0.0;
+}
+
+/** The modified Bessel function of the first kind of order 0.
+*/
+double bessel_i0(double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 64 && term > sum * 1.0e-12; ++k) {
+    const double t = x / (2.0 * k);
+    term *= t * t;
+    sum += term;
+  }
+  return sum;
+}
+
+double kaiser(double x)
+{
+  const double radius = 3.0;
+  const double alpha = 4.0;
+  if (std::fabs(x) >= radius) {
+    return 0.0;
+  }
+  const double pi = 3.14159265358979323846;
+  const double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+  const double t = x / radius;
+  return sinc * bessel_i0(alpha * std::sqrt(1.0 - t * t)) / bessel_i0(alpha);
+}
+
+Kernel get_kernel(Filter filter)
+{
+  switch (filter) {
+  case Filter_Bicubic: { const Kernel k = { catmull_rom, 2.0 }; return k; }
+  case Filter_Kaiser: { const Kernel k = { kaiser, 3.0 }; return k; }
+  default:
+  case Filter_Bilinear: { const Kernel k = { triangle, 1.0 }; return k; }
+  }
+}
+
+/** The weights of the filter for one axis.
+
+  The destination pixel i is the sum of the source pixels from first[i] to
+  first[i] + taps - 1 multiplied by weights[i * stride + j]. The indices are
+  always in the source, because the weights outside of the edges are
+  added to the edge pixels.
+*/
+struct Table {
+  int32_t* first;
+  int16_t* weights;
+  uint32_t taps;
+  uint32_t stride; ///< taps rounded up to even, to take the weights by the pair.
+};
+
+uint32_t get_tap_count(uint32_t srcSize, uint32_t dstSize, Filter filter)
+{
+  if (filter == Filter_Nearest) {
+    return 1;
+  }
+  const double filterScale = std::max(static_cast<double>(srcSize) / dstSize, 1.0);
+  const uint32_t taps = static_cast<uint32_t>(std::ceil(get_kernel(filter).radius * filterScale)) * 2 + 1;
+  return std::min(taps, srcSize);
+}
+
+size_t get_table_size(uint32_t srcSize, uint32_t dstSize, Filter filter)
+{
+  const uint32_t stride = (get_tap_count(srcSize, dstSize, filter) + 1) & ~1U;
+  return Arena::aligned_size(sizeof(int32_t) * dstSize) + Arena::aligned_size(sizeof(int16_t) * dstSize * stride);
+}
+
+/** Make the table of the filter.
+
+  The pixel centers of the source and the destination are aligned at the
+  edges of the image. The filter is stretched by the scale on the reduction.
+
+  @param srcSize  the number of pixels of the source.
+  @param dstSize  the number of pixels of the destination.
+  @param filter   the filter.
+  @param p        the memory of get_table_size() bytes.
+
+  @return the table in p.
+*/
+Table make_table(uint32_t srcSize, uint32_t dstSize, Filter filter, uint8_t* p)
+{
+  Table t;
+  t.taps = get_tap_count(srcSize, dstSize, filter);
+  t.stride = (t.taps + 1) & ~1U;
+  t.first = reinterpret_cast<int32_t*>(p);
+  t.weights = reinterpret_cast<int16_t*>(p + Arena::aligned_size(sizeof(int32_t) * dstSize));
+
+  const double scale = static_cast<double>(srcSize) / dstSize;
+  const int32_t lastFirst = static_cast<int32_t>(srcSize - t.taps);
+  if (filter == Filter_Nearest) {
+    for (uint32_t i = 0; i < dstSize; ++i) {
+      const int32_t index = static_cast<int32_t>(std::floor((i + 0.5) * scale));
+      t.first[i] = std::min(std::max(index, 0), lastFirst);
+      t.weights[i * t.stride] = 1 << weightBits;
+      t.weights[i * t.stride + 1] = 0;
+    }
+    return t;
+  }
+
+  const Kernel kernel = get_kernel(filter);
+  const double filterScale = std::max(scale, 1.0);
+  const double support = kernel.radius * filterScale;
+  const int32_t rawTaps = static_cast<int32_t>(std::ceil(support)) * 2 + 1;
+  std::vector<double> w(t.taps);
+  for (uint32_t i = 0; i < dstSize; ++i) {
+    const double center = (i + 0.5) * scale - 0.5;
+    const int32_t rawFirst = static_cast<int32_t>(std::floor(center - support)) + 1;
+    const int32_t first = std::min(std::max(rawFirst, 0), lastFirst);
+    std::fill(w.begin(), w.end(), 0.0);
+    double total = 0.0;
+    for (int32_t j = 0; j < rawTaps; ++j) {
+      const int32_t index = rawFirst + j;
+      const double v = kernel.func((index - center) / filterScale);
+      const int32_t clamped = std::min(std::max(index, 0), static_cast<int32_t>(srcSize) - 1);
+      w[clamped - first] += v;
+      total += v;
+    }
+    // The rounding error is given to the largest weight to keep the sum.
+    int16_t* q = t.weights + i * t.stride;
+    int32_t sum = 0;
+    uint32_t largest = 0;
+    for (uint32_t j = 0; j < t.taps; ++j) {
+      q[j] = static_cast<int16_t>(std::floor(w[j] / total * (1 << weightBits) + 0.5));
+      sum += q[j];
+      if (q[j] > q[largest]) {
+        largest = j;
+      }
+    }
+    q[largest] = static_cast<int16_t>(q[largest] + (1 << weightBits) - sum);
+    if (t.stride > t.taps) {
+      q[t.taps] = 0;
+    }
+    t.first[i] = first;
+  }
+  return t;
+}
+
+/** Convert the weighted sum to 8bit.
+*/
+inline uint8_t to_byte(int32_t sum)
+{
+  const int32_t v = sum >> weightBits;
+  return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+#if ATCCONV_HAS_SSE2
+/** Load one pixel to the lower 16bit lanes.
+*/
+inline __m128i load_pixel(const uint8_t* p, uint32_t bpp)
+{
+  int32_t v = 0;
+  memcpy(&v, p, bpp);
+  return _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), _mm_setzero_si128());
+}
+
+/** Make the pair of the weights for _mm_madd_epi16().
+*/
+inline __m128i weight_pair(int16_t w0, int16_t w1)
+{
+  return _mm_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(w0) | (static_cast<uint32_t>(static_cast<uint16_t>(w1)) << 16)));
+}
+#endif // ATCCONV_HAS_SSE2
+
+/** Resize the row horizontally.
+
+  @param s         the source row.
+  @param d         the destination row.
+  @param srcCount  the number of pixels of the source row.
+  @param count     the number of pixels of the destination row.
+  @param bpp       the bytes per pixel.
+  @param t         the table of the filter.
+*/
+void resample_row(const uint8_t* s, uint8_t* d, uint32_t srcCount, uint32_t count, uint32_t bpp, const Table& t)
+{
+#if ATCCONV_HAS_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const uint8_t* const end = s + srcCount * bpp;
+#endif // ATCCONV_HAS_SSE2
+  for (uint32_t x = 0; x < count; ++x, d += bpp) {
+    const uint8_t* p = s + t.first[x] * bpp;
+    const int16_t* w = t.weights + x * t.stride;
+#if ATCCONV_HAS_SSE2
+    // All channels of the pixel are summed at once, 2 taps per step. The pair
+    // of pixels is loaded at once if it doesn't read over the row.
+    __m128i sum = _mm_set1_epi32(1 << (weightBits - 1));
+    for (uint32_t j = 0; j < t.taps; j += 2) {
+      const uint8_t* q = p + j * bpp;
+      __m128i ab;
+      if (j + 1 < t.taps && q + 8 <= end) {
+        const __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q)), zero);
+        ab = _mm_unpacklo_epi16(v, bpp == 4 ? _mm_srli_si128(v, 8) : _mm_srli_si128(v, 6));
+      } else {
+        const __m128i a = load_pixel(q, bpp);
+        const __m128i b = j + 1 < t.taps ? load_pixel(q + bpp, bpp) : zero;
+        ab = _mm_unpacklo_epi16(a, b);
+      }
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(ab, weight_pair(w[j], w[j + 1])));
+    }
+    sum = _mm_srai_epi32(sum, weightBits);
+    sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), sum);
+    const int32_t v = _mm_cvtsi128_si32(sum);
+    memcpy(d, &v, bpp);
+#else
+    for (uint32_t c = 0; c < bpp; ++c) {
+      int32_t sum = 1 << (weightBits - 1);
+      for (uint32_t j = 0; j < t.taps; ++j) {
+        sum += w[j] * p[j * bpp + c];
+      }
+      d[c] = to_byte(sum);
+    }
+#endif // ATCCONV_HAS_SSE2
+  }
+}
+
+/** Resize the column vertically for one destination row.
+
+  @param rows   the source rows from first.
+  @param d      the destination row.
+  @param count  the number of bytes of the row.
+  @param w      the weights of the row.
+  @param taps   the number of the weights.
+*/
+void resample_column(const uint8_t* const* rows, uint8_t* d, uint32_t count, const int16_t* w, uint32_t taps)
+{
+  uint32_t i = 0;
+#if ATCCONV_HAS_SSE2
+  // The bytes are independent, so 8 bytes are processed at once regardless of the channels.
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= count; i += 8) {
+    __m128i lo = _mm_set1_epi32(1 << (weightBits - 1));
+    __m128i hi = lo;
+    for (uint32_t j = 0; j < taps; j += 2) {
+      const __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[j] + i)), zero);
+      const __m128i b = j + 1 < taps ? _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[j + 1] + i)), zero) : zero;
+      const __m128i wv = weight_pair(w[j], j + 1 < taps ? w[j + 1] : 0);
+      lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wv));
+      hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wv));
+    }
+    const __m128i v = _mm_packs_epi32(_mm_srai_epi32(lo, weightBits), _mm_srai_epi32(hi, weightBits));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(d + i), _mm_packus_epi16(v, v));
+  }
+#endif // ATCCONV_HAS_SSE2
+  for (; i < count; ++i) {
+    int32_t sum = 1 << (weightBits - 1);
+    for (uint32_t j = 0; j < taps; ++j) {
+      sum += w[j] * rows[j][i];
+    }
+    d[i] = to_byte(sum);
+  }
+}
+
+/** Convert the channel to 16bit linear.
+
+  The color channels are converted from sRGB, and the alpha is scaled.
+*/
+inline uint32_t to_linear(const uint8_t* p, uint32_t c)
+{
+  return c < 3 ? srgb_to_linear(p[c]) : p[c] * 257U;
+}
+
+/** Convert 16bit linear to the channel.
+*/
+inline uint8_t from_linear(int64_t v, uint32_t c)
+{
+  const uint32_t clamped = static_cast<uint32_t>(v < 0 ? 0 : (v > 65535 ? 65535 : v));
+  return c < 3 ? linear_to_srgb(clamped) : static_cast<uint8_t>((clamped * 255 + 32767) / 65535);
+}
+
+/** Shrink the sRGB image by the 2x2 box filter in the linear space.
+
+  It is same as downsample() except the color space.
+*/
+void downsample_srgb(const Bitmap& src, const Bitmap& dst)
+{
+  const uint32_t bpp = src.bytesPerPixel;
+  const uint32_t xstep = src.width > 1 ? bpp : 0;
+  for (uint32_t y = 0; y < dst.height; ++y) {
+    const uint8_t* s0 = src.row(y * 2 < src.height ? y * 2 : src.height - 1);
+    const uint8_t* s1 = src.row(y * 2 + 1 < src.height ? y * 2 + 1 : src.height - 1);
+    uint8_t* d = dst.row(y);
+    for (uint32_t x = 0; x < dst.width; ++x) {
+      for (uint32_t c = 0; c < bpp; ++c) {
+        d[c] = from_linear((to_linear(s0, c) + to_linear(s0 + xstep, c) + to_linear(s1, c) + to_linear(s1 + xstep, c) + 2) / 4, c);
+      }
+      s0 += bpp * 2;
+      s1 += bpp * 2;
+      d += bpp;
+    }
+  }
+}
+
+/** Resize the sRGB image in the linear space.
+
+  The passes are same as resample(), but the intermediate image keeps 16bit
+  linear values, so the dark colors aren't rounded between the passes.
+
+  @param src          the source image.
+  @param dst          the destination image.
+  @param tx           the table of the horizontal pass.
+  @param ty           the table of the vertical pass.
+  @param pTmp         the intermediate image of src.width x dst.height.
+  @param threadCount  the maximum number of threads.
+*/
+void resample_srgb(const Bitmap& src, const Bitmap& dst, const Table& tx, const Table& ty, uint16_t* pTmp, uint32_t threadCount)
+{
+  const uint32_t bpp = src.bytesPerPixel;
+  const uint32_t tmpPitch = src.width * bpp;
+  const int64_t half = 1 << (weightBits - 1);
+  Parallel::for_range(dst.height, threadCount, [&](uint32_t begin, uint32_t end) {
+    std::vector<const uint8_t*> rows(ty.taps);
+    for (uint32_t y = begin; y < end; ++y) {
+      for (uint32_t j = 0; j < ty.taps; ++j) {
+        rows[j] = src.row(ty.first[y] + j);
+      }
+      const int16_t* w = ty.weights + y * ty.stride;
+      uint16_t* d = pTmp + static_cast<size_t>(y) * tmpPitch;
+      for (uint32_t x = 0; x < src.width; ++x) {
+        for (uint32_t c = 0; c < bpp; ++c) {
+          int64_t sum = half;
+          for (uint32_t j = 0; j < ty.taps; ++j) {
+            sum += w[j] * static_cast<int64_t>(to_linear(rows[j] + x * bpp, c));
+          }
+          sum >>= weightBits;
+          d[x * bpp + c] = static_cast<uint16_t>(sum < 0 ? 0 : (sum > 65535 ? 65535 : sum));
+        }
+      }
+    }
+  });
+  Parallel::for_range(dst.height, threadCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t y = begin; y < end; ++y) {
+      const uint16_t* s = pTmp + static_cast<size_t>(y) * tmpPitch;
+      uint8_t* d = dst.row(y);
+      for (uint32_t x = 0; x < dst.width; ++x) {
+        const int16_t* w = tx.weights + x * tx.stride;
+        for (uint32_t c = 0; c < bpp; ++c) {
+          int64_t sum = half;
+          for (uint32_t j = 0; j < tx.taps; ++j) {
+            sum += w[j] * static_cast<int64_t>(s[(tx.first[x] + j) * bpp + c]);
+          }
+          d[x * bpp + c] = from_linear(sum >> weightBits, c);
+        }
+      }
+    }
+  });
+}
+
+/// The names of the filters.
+const struct {
+  const char* name;
+  Filter filter;
+} filterNameList[] = {
+  { "mean", Filter_Mean },
+  { "nearest", Filter_Nearest },
+  { "bilinear", Filter_Bilinear },
+  { "bicubic", Filter_Bicubic },
+  { "kaiser", Filter_Kaiser },
+};
+
+} // unnamed namespace
+
+/** Get the filter from its name.
+
+  @param name     the name of the filter. it is same as Q_FLAG_SCALEFILTER_???
+                  in the lower case.
+  @param pFilter  the pointer to store the filter.
+
+  @retval true  the name is found.
+  @retval false the name is unknown.
+*/
+bool get_filter_by_name(const char* name, Filter* pFilter)
+{
+  for (const auto& e : filterNameList) {
+    if (strcmp(e.name, name) == 0) {
+      *pFilter = e.filter;
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Get the name of the filter.
+
+  @return the name passed to get_filter_by_name().
+*/
+const char* get_filter_name(Filter filter)
+{
+  for (const auto& e : filterNameList) {
+    if (e.filter == filter) {
+      return e.name;
+    }
+  }
+  return "unknown";
+}
+
+/** Get the byte size of the work memory for resample().
+
+  The intermediate image of the sRGB image has 16bit per channel.
+*/
+size_t get_resample_work_size(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, uint32_t bytesPerPixel, Filter filter, bool srgb)
+{
+  return get_table_size(srcWidth, dstWidth, filter) +
+    get_table_size(srcHeight, dstHeight, filter) +
+    Arena::aligned_size(get_size(srcWidth, dstHeight, bytesPerPixel) * (srgb ? 2 : 1));
+}
+
+/** Resize the image.
+
+  The image is resized vertically and then horizontally. The vertical pass
+  runs first, because it processes 8 bytes at once and the horizontal pass
+  processes only the destination rows. The weights are calculated once for
+  each axis, and the rows of each pass are split into the threads.
+
+  @param src          the source image.
+  @param dst          the destination image. it has the same bytesPerPixel as
+                      src.
+  @param filter       the filter. Filter_Mean is treated as the triangle
+                      filter, because this function accepts any size.
+  @param srgb         if true, the color is filtered in the linear space.
+  @param pWork        the work memory of get_resample_work_size() bytes.
+  @param threadCount  the maximum number of threads.
+*/
+void resample(const Bitmap& src, const Bitmap& dst, Filter filter, bool srgb, uint8_t* pWork, uint32_t threadCount)
+{
+  if (filter == Filter_Mean) {
+    filter = Filter_Bilinear;
+  }
+  const uint32_t bpp = src.bytesPerPixel;
+  const Table tx = make_table(src.width, dst.width, filter, pWork);
+  pWork += get_table_size(src.width, dst.width, filter);
+  const Table ty = make_table(src.height, dst.height, filter, pWork);
+  pWork += get_table_size(src.height, dst.height, filter);
+  if (srgb) {
+    resample_srgb(src, dst, tx, ty, reinterpret_cast<uint16_t*>(pWork), threadCount);
+    return;
+  }
+  const Bitmap tmp = make_bitmap(pWork, src.width, dst.height, bpp);
+
+  Parallel::for_range(dst.height, threadCount, [&](uint32_t begin, uint32_t end) {
+    std::vector<const uint8_t*> rows(ty.taps);
+    for (uint32_t y = begin; y < end; ++y) {
+      for (uint32_t j = 0; j < ty.taps; ++j) {
+        rows[j] = src.row(ty.first[y] + j);
+      }
+      resample_column(rows.data(), tmp.row(y), src.width * bpp, ty.weights + y * ty.stride, ty.taps);
+    }
+  });
+  Parallel::for_range(dst.height, threadCount, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t y = begin; y < end; ++y) {
+      resample_row(tmp.row(y), dst.row(y), src.width, dst.width, bpp, tx);
+    }
+  });
+}
+
+/** Get the byte size of the work memory for make_mip().
+
+  @param w              the pixel width of the source image.
+  @param h              the pixel height of the source image.
+  @param bytesPerPixel  the bytes per pixel of the image.
+  @param filter         the filter.
+  @param srgb           true if the image is sRGB.
+
+  @return the byte size of the work memory. it is large enough for all the
+          smaller levels.
+*/
+size_t get_mip_work_size(uint32_t w, uint32_t h, uint32_t bytesPerPixel, Filter filter, bool srgb)
+{
+  if (filter == Filter_Mean) {
+    return 0;
+  }
+  return get_resample_work_size(w, h, std::max(w / 2, 1U), std::max(h / 2, 1U), bytesPerPixel, filter, srgb);
+}
+
+/** Shrink the image to the next mip level.
+
+  @param src          the source image.
+  @param dst          the destination image. its size should be
+                      max(src.width / 2, 1) x max(src.height / 2, 1), and it
+                      has the same bytesPerPixel as src.
+  @param filter       the filter. Filter_Mean uses downsample().
+  @param srgb         if true, the color is filtered in the linear space.
+  @param pWork        the work memory of get_mip_work_size() bytes.
+  @param threadCount  the maximum number of threads.
+*/
+void make_mip(const Bitmap& src, const Bitmap& dst, Filter filter, bool srgb, uint8_t* pWork, uint32_t threadCount)
+{
+  if (filter == Filter_Mean) {
+    if (srgb) {
+      downsample_srgb(src, dst);
+    } else {
+      downsample(src, dst);
+    }
+    return;
+  }
+  resample(src, dst, filter, srgb, pWork, threadCount);
+}
+
+} // namespace Image
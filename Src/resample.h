@@ -0,0 +1,33 @@
+/**
+  @file resample.h
+
+  Resize the image with the separable filter.
+*/
+#ifndef RESAMPLE_H_INCLUDED
+#define RESAMPLE_H_INCLUDED
+#include "image.h"
+
+namespace Image {
+
+/** The filter to resize the image.
+
+  They correspond to Q_FLAG_SCALEFILTER_??? of TextureConverter.h.
+*/
+enum Filter {
+  Filter_Mean, ///< 2x2 box filter. it is same as downsample().
+  Filter_Nearest, ///< the nearest pixel.
+  Filter_Bilinear, ///< the triangle filter.
+  Filter_Bicubic, ///< Catmull-Rom spline.
+  Filter_Kaiser, ///< Kaiser windowed sinc filter.
+};
+
+bool get_filter_by_name(const char* name, Filter* pFilter);
+const char* get_filter_name(Filter filter);
+size_t get_resample_work_size(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, uint32_t bytesPerPixel, Filter filter, bool srgb);
+void resample(const Bitmap& src, const Bitmap& dst, Filter filter, bool srgb, uint8_t* pWork, uint32_t threadCount);
+size_t get_mip_work_size(uint32_t w, uint32_t h, uint32_t bytesPerPixel, Filter filter, bool srgb);
+void make_mip(const Bitmap& src, const Bitmap& dst, Filter filter, bool srgb, uint8_t* pWork, uint32_t threadCount);
+
+} // namespace Image
+
+#endif // RESAMPLE_H_INCLUDED
@@ -0,0 +1,16 @@
+/**
+  @file simd.h
+
+  Select the SIMD instruction set that is available in the build.
+*/
+#ifndef SIMD_H_INCLUDED
+#define SIMD_H_INCLUDED
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ATCCONV_HAS_SSE2 1
+#include <emmintrin.h>
+#else
+#define ATCCONV_HAS_SSE2 0
+#endif
+
+#endif // SIMD_H_INCLUDED
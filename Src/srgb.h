@@ -0,0 +1,100 @@
+/**
+  @file srgb.h
+
+  Convert the sRGB color to the linear color and back by the tables.
+
+  The tables are made by the compiler, so they cost nothing at the startup.
+  The functions are C++11 constexpr for Visual Studio 2015.
+*/
+#ifndef SRGB_H_INCLUDED
+#define SRGB_H_INCLUDED
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+namespace Image {
+
+namespace Srgb {
+
+/// The bits of the index of toSrgbTable. the linear value is shifted by 16 - this.
+const uint32_t toSrgbIndexBits = 12;
+
+/// The fifth root of x in [0.05, 1] by Newton's method from 1.
+constexpr double fifth_root(double x, double y = 1.0, int n = 12)
+{
+  return n == 0 ? y : fifth_root(x, (4.0 * y + x / (y * y * y * y)) / 5.0, n - 1);
+}
+
+/// x^2.4 as (x^(1/5))^2 * x^2.
+constexpr double pow_2_4(double x)
+{
+  return fifth_root(x) * fifth_root(x) * x * x;
+}
+
+/// The linear value of the sRGB value c in [0, 1].
+constexpr double to_linear(double c)
+{
+  return c <= 0.04045 ? c / 12.92 : pow_2_4((c + 0.055) / 1.055);
+}
+
+/// The table to convert 8bit sRGB to 16bit linear.
+struct ToLinearTable {
+  uint16_t value[256];
+};
+
+template<std::size_t... I>
+constexpr ToLinearTable make_to_linear_table(std::index_sequence<I...>)
+{
+  return { { static_cast<uint16_t>(to_linear(I / 255.0) * 65535.0 + 0.5)... } };
+}
+
+constexpr ToLinearTable toLinearTable = make_to_linear_table(std::make_index_sequence<256>());
+
+/// The first sRGB value in [lo, hi) whose linear value isn't less than v.
+constexpr uint32_t lower_bound(uint32_t v, uint32_t lo = 0, uint32_t hi = 256)
+{
+  return lo == hi ? lo :
+    (toLinearTable.value[(lo + hi) / 2] < v ? lower_bound(v, (lo + hi) / 2 + 1, hi) : lower_bound(v, lo, (lo + hi) / 2));
+}
+
+/// The sRGB value that is nearest to the linear value v.
+constexpr uint8_t nearest(uint32_t v, uint32_t i)
+{
+  return static_cast<uint8_t>(i == 0 ? 0 : (i == 256 ? 255 : (v - toLinearTable.value[i - 1] < toLinearTable.value[i] - v ? i - 1 : i)));
+}
+
+/// The table to convert the upper bits of 16bit linear to 8bit sRGB.
+struct ToSrgbTable {
+  uint8_t value[1 << toSrgbIndexBits];
+};
+
+template<std::size_t... I>
+constexpr ToSrgbTable make_to_srgb_table(std::index_sequence<I...>)
+{
+  // Each entry is the sRGB value of the center of its range.
+  return { { nearest((I << (16 - toSrgbIndexBits)) + (1 << (15 - toSrgbIndexBits)), lower_bound((I << (16 - toSrgbIndexBits)) + (1 << (15 - toSrgbIndexBits))))... } };
+}
+
+constexpr ToSrgbTable toSrgbTable = make_to_srgb_table(std::make_index_sequence<1 << toSrgbIndexBits>());
+
+} // namespace Srgb
+
+/** Convert 8bit sRGB to 16bit linear.
+*/
+inline uint32_t srgb_to_linear(uint8_t c)
+{
+  return Srgb::toLinearTable.value[c];
+}
+
+/** Convert 16bit linear to 8bit sRGB.
+
+  @param v  the linear value from 0 to 65535.
+*/
+inline uint8_t linear_to_srgb(uint32_t v)
+{
+  return Srgb::toSrgbTable.value[v >> (16 - Srgb::toSrgbIndexBits)];
+}
+
+} // namespace Image
+
+#endif // SRGB_H_INCLUDED
@@ -0,0 +1,265 @@
+/**
+  @file stream.cpp
+*/
+#include "stream.h"
+#include "arena.h"
+#include "convert.h"
+#include "format.h"
+#include "image.h"
+#include "preprocess.h"
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace /* unnamed */ {
+
+/** The state of a mip level in the stream.
+*/
+struct Level {
+  Image::Bitmap band; ///< the rows waiting for the encode. its height is the capacity.
+  uint32_t width;
+  uint32_t height;
+  uint32_t rowsInBand; ///< the number of rows stored in band.
+  uint32_t rowsReceived; ///< the number of rows received from the upper level.
+  uint8_t* pOut; ///< the buffer for the encoded band.
+  uint64_t offset; ///< the file offset to write the next encoded band.
+};
+
+/** The band by band encoder of the mip chain.
+
+  A level receives the rows from the upper level, and passes the downsampled
+  rows to the lower level as soon as the pair of rows is ready. When the band
+  is filled, it is encoded and written to its offset in the file. The offset
+  of each level is known in advance because the encoded size is analytic.
+*/
+class StreamEncoder {
+public:
+  StreamEncoder(std::ostream& s, const Encoder::IBlockEncoder& e, uint32_t format) : ofs(s), blockEncoder(e), outputFormat(format), levelCount(0) {}
+  bool push_rows(uint32_t level, uint32_t count);
+
+  std::ostream& ofs;
+  const Encoder::IBlockEncoder& blockEncoder;
+  uint32_t outputFormat;
+  uint32_t levelCount;
+  Level levels[32];
+
+private:
+  bool flush(uint32_t level);
+};
+
+/** Pass the new rows in the band to the lower level, and flush the band if it is filled.
+
+  @param level  the mip level.
+  @param count  the number of rows that is stored after the last push.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool StreamEncoder::push_rows(uint32_t level, uint32_t count)
+{
+  Level& lv = levels[level];
+  if (level + 1 < levelCount) {
+    Level& next = levels[level + 1];
+    for (uint32_t i = 0; i < count; ++i) {
+      const uint32_t k = lv.rowsInBand + i;
+      const uint32_t r = lv.rowsReceived + i;
+      // The band has the even number of rows, so the pair is always in the same band.
+      const bool isSingleRow = lv.height == 1;
+      if (!isSingleRow && (!(r & 1) || r / 2 >= next.height)) {
+        continue;
+      }
+      Image::Bitmap pair = lv.band;
+      pair.bits = lv.band.row(isSingleRow ? k : k - 1);
+      pair.height = isSingleRow ? 1 : 2;
+      Image::Bitmap dst = next.band;
+      dst.bits = next.band.row(next.rowsInBand);
+      dst.height = 1;
+      Image::downsample(pair, dst);
+      if (!push_rows(level + 1, 1)) {
+        return false;
+      }
+    }
+  }
+  lv.rowsInBand += count;
+  lv.rowsReceived += count;
+  if (lv.rowsInBand == lv.band.height || lv.rowsReceived == lv.height) {
+    return flush(level);
+  }
+  return true;
+}
+
+/** Encode the band and write it to the file.
+
+  @param level  the mip level.
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool StreamEncoder::flush(uint32_t level)
+{
+  Level& lv = levels[level];
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  Image::Bitmap band = lv.band;
+  band.height = lv.rowsInBand;
+  const uint32_t size = TextureFormat::get_image_size(traits, band.width, band.height);
+  if (!EncodeImage(blockEncoder, band, outputFormat, lv.pOut, size)) {
+    return false;
+  }
+  ofs.seekp(lv.offset);
+  ofs.write(reinterpret_cast<const char*>(lv.pOut), size);
+  lv.offset += size;
+  lv.rowsInBand = 0;
+  return !ofs.bad();
+}
+
+/** Get the number of rows in the band of the level.
+*/
+uint32_t GetBandCapacity(uint32_t height, uint32_t bandBlockRows)
+{
+  return std::min(bandBlockRows * 4, (height + 3) & ~3U);
+}
+
+/** Encode the image and its mipmaps band by band, and write them to the stream.
+
+  @retval true  success.
+  @retval false failure. the stream may have the partial file.
+*/
+bool WriteStream(std::ostream& ofs, const Encoder::IBlockEncoder& blockEncoder, RowSource& source, uint32_t outputFormat, uint32_t maxLevel, uint32_t bandBlockRows, bool premultiply, Arena& arena, const KTX::File& ktx)
+{
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t bpp = source.bytes_per_pixel();
+  KTX::File file;
+  file.keyValues = ktx.keyValues;
+  KTX::initialize(&file.header, source.width(), source.height(), traits.glInternalFormat, traits.glBaseInternalFormat);
+  file.header.numberOfMipmapLevels = GetMipLevelCount(source.width(), source.height(), maxLevel);
+
+  StreamEncoder encoder(ofs, blockEncoder, outputFormat);
+  encoder.levelCount = file.header.numberOfMipmapLevels;
+
+  // All offsets are fixed by the header, so the image sizes are written first.
+  uint64_t offset = KTX::write_header(ofs, file, 1);
+  uint32_t w = source.width();
+  uint32_t h = source.height();
+  for (uint32_t level = 0; level < encoder.levelCount; ++level) {
+    Level& lv = encoder.levels[level];
+    const uint32_t capacity = GetBandCapacity(h, bandBlockRows);
+    lv.band = Image::make_bitmap(arena.allocate(Image::get_size(w, capacity, bpp)), w, capacity, bpp);
+    lv.width = w;
+    lv.height = h;
+    lv.rowsInBand = 0;
+    lv.rowsReceived = 0;
+    lv.pOut = arena.allocate_array<uint8_t>(TextureFormat::get_image_size(traits, w, capacity));
+    if (!lv.band.bits || !lv.pOut) {
+      return false;
+    }
+    const uint32_t imageSize = TextureFormat::get_image_size(traits, w, h);
+    uint32_t imageSizeValue;
+    KTX::set_value(&imageSizeValue, imageSize, KTX::get_endian(file.header));
+    ofs.seekp(offset);
+    ofs.write(reinterpret_cast<const char*>(&imageSizeValue), sizeof(imageSizeValue));
+    lv.offset = offset + sizeof(uint32_t);
+    offset = lv.offset + imageSize;
+    w = std::max(w / 2, 1U);
+    h = std::max(h / 2, 1U);
+  }
+
+  Level& top = encoder.levels[0];
+  while (top.rowsReceived < top.height) {
+    const uint32_t count = std::min(top.band.height - top.rowsInBand, top.height - top.rowsReceived);
+    Image::Bitmap rows = top.band;
+    rows.bits = top.band.row(top.rowsInBand);
+    rows.height = count;
+    if (!source.read_rows(rows.bits, rows.pitch, count)) {
+      return false;
+    }
+    if (premultiply) {
+      Image::preprocess(rows, Image::TransparentMode_Premultiply, nullptr);
+    }
+    if (!encoder.push_rows(0, count)) {
+      return false;
+    }
+  }
+  return !ofs.bad();
+}
+
+} // unnamed namespace
+
+/** Read the rows of the bitmap.
+*/
+bool BitmapRowSource::read_rows(uint8_t* p, int32_t pitch, uint32_t count)
+{
+  if (nextRow + count > bitmap.height) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i, ++nextRow, p += pitch) {
+    memcpy(p, bitmap.row(nextRow), bitmap.width * bitmap.bytesPerPixel);
+  }
+  return true;
+}
+
+/** Get the arena size that is used by EncodeStream().
+
+  @param w              the pixel width of the image.
+  @param h              the pixel height of the image.
+  @param bytesPerPixel  the bytes per pixel of the image.
+  @param outputFormat   Q_FORMAT_??? of the compressed image.
+  @param maxLevel       the maximum number of mip levels.
+  @param bandBlockRows  the number of block rows in a band.
+
+  @return the byte size of the arena. it depends on the band size and the
+          image width, but not on the image height.
+*/
+size_t GetStreamArenaSize(uint32_t w, uint32_t h, uint32_t bytesPerPixel, uint32_t outputFormat, uint32_t maxLevel, uint32_t bandBlockRows)
+{
+  const TextureFormat::Traits& traits = *TextureFormat::find(outputFormat);
+  const uint32_t levelCount = GetMipLevelCount(w, h, maxLevel);
+  size_t size = 0;
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const uint32_t capacity = GetBandCapacity(h, bandBlockRows);
+    size += Arena::aligned_size(Image::get_size(w, capacity, bytesPerPixel));
+    size += Arena::aligned_size(TextureFormat::get_image_size(traits, w, capacity));
+    w = std::max(w / 2, 1U);
+    h = std::max(h / 2, 1U);
+  }
+  return size;
+}
+
+/** Encode the image and its mipmaps band by band, and write them to the file.
+
+  @param encoder        the encoder of the blocks.
+  @param source         the source of the rows.
+  @param outputFormat   Q_FORMAT_??? of the compressed image.
+  @param maxLevel       the maximum number of mip levels.
+  @param bandBlockRows  the number of block rows in a band.
+  @param premultiply    if true, the color is multiplied by the alpha.
+  @param arena          the arena for the bands. it should have the space of
+                        GetStreamArenaSize() at least.
+  @param ktx            the KTX file that has the key/value data.
+  @param filename       the output file path. the file is written to the
+                        temporary file first, and it replaces filename when
+                        it is complete as KTX::write_texture().
+
+  @retval true  success.
+  @retval false failure.
+*/
+bool EncodeStream(const Encoder::IBlockEncoder& encoder, RowSource& source, uint32_t outputFormat, uint32_t maxLevel, uint32_t bandBlockRows, bool premultiply, Arena& arena, const KTX::File& ktx, const std::string& filename)
+{
+  const std::string tempname = KTX::get_temporary_name(filename);
+  std::ofstream ofs(tempname.c_str(), std::ios::out | std::ios::binary);
+  if (!ofs) {
+    std::cout << "can't open'" << filename << "'";
+    return false;
+  }
+  const bool result = WriteStream(ofs, encoder, source, outputFormat, maxLevel, bandBlockRows, premultiply, arena, ktx);
+  ofs.close();
+  if (!result || ofs.fail()) {
+    if (result) {
+      std::cout << "can't write'" << filename << "'";
+    }
+    std::remove(tempname.c_str());
+    return false;
+  }
+  return KTX::replace_file(tempname, filename);
+}
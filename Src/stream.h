@@ -0,0 +1,57 @@
+/**
+  @file stream.h
+
+  Encode the image band by band to bound the memory by the band size.
+*/
+#ifndef STREAM_H_INCLUDED
+#define STREAM_H_INCLUDED
+#include "encoder.h"
+#include "image.h"
+#include "ktx.h"
+#include <cstdint>
+#include <string>
+
+class Arena;
+
+/** The source of the image rows.
+
+  The rows are read from top to bottom.
+*/
+class RowSource {
+public:
+  virtual ~RowSource() {}
+  virtual uint32_t width() const = 0;
+  virtual uint32_t height() const = 0;
+  virtual uint32_t bytes_per_pixel() const = 0;
+
+  /** Read the next rows.
+
+    @param p      the buffer to store the rows.
+    @param pitch  the byte offset from a row to the next row in p.
+    @param count  the number of rows to read.
+
+    @retval true  success.
+    @retval false failure.
+  */
+  virtual bool read_rows(uint8_t* p, int32_t pitch, uint32_t count) = 0;
+};
+
+/** The source of the rows in the memory.
+*/
+class BitmapRowSource : public RowSource {
+public:
+  explicit BitmapRowSource(const Image::Bitmap& b) : bitmap(b), nextRow(0) {}
+  virtual uint32_t width() const { return bitmap.width; }
+  virtual uint32_t height() const { return bitmap.height; }
+  virtual uint32_t bytes_per_pixel() const { return bitmap.bytesPerPixel; }
+  virtual bool read_rows(uint8_t* p, int32_t pitch, uint32_t count);
+
+private:
+  Image::Bitmap bitmap;
+  uint32_t nextRow;
+};
+
+size_t GetStreamArenaSize(uint32_t w, uint32_t h, uint32_t bytesPerPixel, uint32_t outputFormat, uint32_t maxLevel, uint32_t bandBlockRows);
+bool EncodeStream(const Encoder::IBlockEncoder& encoder, RowSource& source, uint32_t outputFormat, uint32_t maxLevel, uint32_t bandBlockRows, bool premultiply, Arena& arena, const KTX::File& ktx, const std::string& filename);
+
+#endif // STREAM_H_INCLUDED
@@ -0,0 +1,470 @@
+/**
+  @file watch.cpp
+*/
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+#include "watch.h"
+#include "convert.h"
+#include "cmdline.h"
+#include "arena.h"
+#include <FreeImage.h>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+namespace /* unnamed */ {
+
+typedef std::chrono::steady_clock Clock;
+
+/// The default time in milliseconds that the file should be quiet before the conversion.
+const uint32_t defaultDebounceMs = 100;
+
+/// The default number of the workers.
+const uint32_t defaultWorkerCount = 2;
+
+/** Check the file name has the extension of PNG.
+*/
+bool IsPngFile(const std::string& name) {
+  if (name.size() < 4) {
+    return false;
+  }
+  const char* ext = name.c_str() + name.size() - 4;
+  return ext[0] == '.' && (ext[1] | 0x20) == 'p' && (ext[2] | 0x20) == 'n' && (ext[3] | 0x20) == 'g';
+}
+
+/** Receive the names of the files that are written in the directory.
+
+  The subdirectories aren't watched.
+*/
+class DirectoryWatcher {
+public:
+  DirectoryWatcher();
+  ~DirectoryWatcher();
+  DirectoryWatcher(const DirectoryWatcher&) = delete;
+  DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+  bool open(const std::string& dirname);
+  bool wait(uint32_t timeoutMs, std::vector<std::string>& names);
+
+private:
+#ifdef _WIN32
+  bool read();
+
+  HANDLE dir;
+  HANDLE event;
+  OVERLAPPED overlapped;
+  DWORD buffer[16 * 1024]; ///< FILE_NOTIFY_INFORMATION should be aligned to DWORD.
+#else
+  int fd;
+#endif
+};
+
+#ifdef _WIN32
+
+DirectoryWatcher::DirectoryWatcher() : dir(INVALID_HANDLE_VALUE), event(nullptr)
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+  if (dir != INVALID_HANDLE_VALUE) {
+    CancelIo(dir);
+    CloseHandle(dir);
+  }
+  if (event) {
+    CloseHandle(event);
+  }
+}
+
+/** Start to watch the directory.
+
+  @retval true  success.
+  @retval false the directory can't be opened.
+*/
+bool DirectoryWatcher::open(const std::string& dirname)
+{
+  dir = CreateFileA(dirname.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+  event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+  return dir != INVALID_HANDLE_VALUE && event && read();
+}
+
+/** Request the next notification.
+*/
+bool DirectoryWatcher::read()
+{
+  ResetEvent(event);
+  memset(&overlapped, 0, sizeof(overlapped));
+  overlapped.hEvent = event;
+  return ReadDirectoryChangesW(dir, buffer, sizeof(buffer), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+    nullptr, &overlapped, nullptr) != FALSE;
+}
+
+/** Wait for the writes.
+
+  @param timeoutMs  the maximum time to wait in milliseconds.
+  @param names      the list to append the names of the written files.
+
+  @retval true  success. names may be empty by the timeout.
+  @retval false the directory can't be watched any more.
+*/
+bool DirectoryWatcher::wait(uint32_t timeoutMs, std::vector<std::string>& names)
+{
+  if (WaitForSingleObject(event, timeoutMs) != WAIT_OBJECT_0) {
+    return true;
+  }
+  DWORD size = 0;
+  if (!GetOverlappedResult(dir, &overlapped, &size, FALSE)) {
+    return false;
+  }
+  // The size is 0 if the buffer overflowed. the lost writes are saved again by the user.
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buffer);
+  for (DWORD offset = 0; size; ) {
+    const FILE_NOTIFY_INFORMATION& info = *reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p + offset);
+    if (info.Action == FILE_ACTION_ADDED || info.Action == FILE_ACTION_MODIFIED || info.Action == FILE_ACTION_RENAMED_NEW_NAME) {
+      const int length = static_cast<int>(info.FileNameLength / sizeof(WCHAR));
+      const int n = WideCharToMultiByte(CP_ACP, 0, info.FileName, length, nullptr, 0, nullptr, nullptr);
+      std::string name(n, '\0');
+      if (n > 0 && WideCharToMultiByte(CP_ACP, 0, info.FileName, length, &name[0], n, nullptr, nullptr) == n) {
+        names.push_back(name);
+      }
+    }
+    if (!info.NextEntryOffset) {
+      break;
+    }
+    offset += info.NextEntryOffset;
+  }
+  return read();
+}
+
+#elif defined(__linux__)
+
+DirectoryWatcher::DirectoryWatcher() : fd(-1)
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+/** Start to watch the directory.
+
+  The file is notified when it is closed after the write, or it is renamed
+  to the directory as the editors save the file by the temporary file.
+
+  @retval true  success.
+  @retval false the directory can't be watched.
+*/
+bool DirectoryWatcher::open(const std::string& dirname)
+{
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  return fd >= 0 && inotify_add_watch(fd, dirname.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0;
+}
+
+/** Wait for the writes.
+
+  @param timeoutMs  the maximum time to wait in milliseconds.
+  @param names      the list to append the names of the written files.
+
+  @retval true  success. names may be empty by the timeout.
+  @retval false the directory can't be watched any more.
+*/
+bool DirectoryWatcher::wait(uint32_t timeoutMs, std::vector<std::string>& names)
+{
+  pollfd pfd = { fd, POLLIN, 0 };
+  const int ready = poll(&pfd, 1, static_cast<int>(timeoutMs));
+  if (ready <= 0) {
+    return ready == 0 || errno == EINTR;
+  }
+  alignas(inotify_event) char buffer[16 * 1024];
+  for (;;) {
+    const ssize_t size = read(fd, buffer, sizeof(buffer));
+    if (size <= 0) {
+      return size < 0 && (errno == EAGAIN || errno == EINTR);
+    }
+    for (ssize_t offset = 0; offset < size; ) {
+      const inotify_event& e = *reinterpret_cast<const inotify_event*>(buffer + offset);
+      if (e.len) {
+        names.push_back(e.name);
+      }
+      offset += sizeof(inotify_event) + e.len;
+    }
+  }
+}
+
+#else
+
+DirectoryWatcher::DirectoryWatcher() : fd(-1)
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+}
+
+/** The watch isn't supported on this platform.
+
+  @return always false.
+*/
+bool DirectoryWatcher::open(const std::string&)
+{
+  return false;
+}
+
+bool DirectoryWatcher::wait(uint32_t, std::vector<std::string>&)
+{
+  return false;
+}
+
+#endif
+
+/** The file that is ready to convert.
+*/
+struct Job {
+  std::string filename; ///< the path of the PNG file.
+  uint32_t focusRank; ///< the line in the focus list. UINT32_MAX if it isn't in the list.
+  Clock::time_point savedAt; ///< the time of the last write.
+};
+
+/** The files that are shared by the watcher and the workers.
+*/
+struct JobQueue {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<Job> jobs;
+  std::set<std::string> running; ///< the files in the conversion. they wait for it if they are saved again.
+  bool isStopped;
+
+  JobQueue() : isStopped(false) {}
+
+  /** Take the job that is nearest to the focus.
+
+    The file in the focus list precedes the others, and the later saved file
+    precedes in the same rank, because the user looks at it now. The file in
+    the conversion is skipped.
+
+    @retval true  job has the file, and it is added to running.
+    @retval false the queue is stopped.
+  */
+  bool take(Job& job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      if (isStopped) {
+        return false;
+      }
+      auto best = jobs.end();
+      for (auto i = jobs.begin(); i != jobs.end(); ++i) {
+        if (running.count(i->filename)) {
+          continue;
+        }
+        if (best == jobs.end() || i->focusRank < best->focusRank || (i->focusRank == best->focusRank && i->savedAt > best->savedAt)) {
+          best = i;
+        }
+      }
+      if (best != jobs.end()) {
+        job = *best;
+        jobs.erase(best);
+        running.insert(job.filename);
+        return true;
+      }
+      cv.wait(lock);
+    }
+  }
+};
+
+/** Convert the files in the queue until it is stopped.
+
+  The arena is kept between the files, so the memory for the same size of
+  the image is allocated only once.
+*/
+void RunJobs(JobQueue& queue, const ConvertOptions& baseOptions) {
+  Arena arena;
+  Job job;
+  while (queue.take(job)) {
+    ConvertOptions options = baseOptions;
+    options.infilename = job.filename;
+    options.outfilename = GetOutputFileName(job.filename);
+    const auto start = Clock::now();
+    const ConvertResult result = ConvertFile(options, arena);
+    const auto end = Clock::now();
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (result == ConvertResult_Success) {
+      std::cout << options.outfilename << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, ready in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - job.savedAt).count() << " ms after the save." << std::endl;
+    } else {
+      std::cout << "Error: can't convert '" << job.filename << "'(" << static_cast<int>(result) << ")." << std::endl;
+    }
+    queue.running.erase(job.filename);
+    queue.cv.notify_all();
+  }
+}
+
+/** Get the rank of the file in the focus list.
+
+  @param focus     the lines of the focus list. each line is the path or the
+                   name in the watched directory.
+  @param filename  the path of the file.
+  @param name      the name of the file in the watched directory.
+
+  @return the index of the line. UINT32_MAX if it isn't in the list.
+*/
+uint32_t GetFocusRank(const std::vector<std::string>& focus, const std::string& filename, const std::string& name) {
+  for (size_t i = 0; i < focus.size(); ++i) {
+    if (focus[i] == filename || focus[i] == name) {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  return UINT32_MAX;
+}
+
+} // unnamed namespace
+
+/** Convert the PNG files in the directory whenever they are saved.
+
+  usage: --watch dir [-workers count] [-debounce ms] [-focus listfile] [options...]
+
+  The file is converted after it isn't written for the debounce time, so a
+  burst of the writes by one save is converted once. The options are same
+  as the conversion, and the output is the file that has replaced the
+  extension to '.ktx'. The focus list is read again whenever the files are
+  queued, so the editor can update it at any time.
+
+  @param dirname  the directory to watch.
+  @param argc     the number of arguments after dir.
+  @param argv     the arguments after dir.
+
+  @return the exit code. it returns only if the watch is failed.
+*/
+int RunWatch(const char* dirname, int argc, char** argv) {
+  uint32_t workerCount = defaultWorkerCount;
+  uint32_t debounceMs = defaultDebounceMs;
+  std::string focusfilename;
+  std::vector<char*> rest;
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-workers") == 0 && i + 1 < argc) {
+      workerCount = std::max(1, std::atoi(argv[++i]));
+    } else if (strcmp(argv[i], "-debounce") == 0 && i + 1 < argc) {
+      debounceMs = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+    } else if (strcmp(argv[i], "-focus") == 0 && i + 1 < argc) {
+      focusfilename = argv[++i];
+    } else {
+      rest.push_back(argv[i]);
+    }
+  }
+  ConvertOptions baseOptions;
+  rest.push_back(nullptr);
+  if (!ParseConvertOptions(static_cast<int>(rest.size() - 1), rest.data(), baseOptions)) {
+    return 1;
+  }
+  if (!baseOptions.infilename.empty() || baseOptions.preview) {
+    std::cout << "Error: '--watch' can't be used with infile, outfile and '--preview'." << std::endl;
+    return 1;
+  }
+
+  DirectoryWatcher watcher;
+  if (!watcher.open(dirname)) {
+    std::cout << "Error: can't watch '" << dirname << "'." << std::endl;
+    return 1;
+  }
+  std::string prefix = dirname;
+  if (!prefix.empty() && prefix.back() != '/' && prefix.back() != '\\') {
+    prefix += '/';
+  }
+
+#ifdef FREE_IMAGE_STATIC_LIBRARY
+  FreeImage_Initialise(FALSE);
+#endif // FREE_ISTATIC_LIBRARY
+
+  JobQueue queue;
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < workerCount; ++i) {
+    workers.emplace_back(RunJobs, std::ref(queue), std::cref(baseOptions));
+  }
+  std::cout << "watching '" << dirname << "' by " << workerCount << " worker(s). press Ctrl+C to stop." << std::endl;
+
+  // The files that are written in the debounce time. the value is the time of the last write.
+  std::map<std::string, Clock::time_point> settling;
+  std::vector<std::string> names;
+  std::vector<std::string> focus;
+  int exitCode = 0;
+  for (;;) {
+    const uint32_t timeoutMs = settling.empty() ? 1000 : std::max(debounceMs / 4, 1U);
+    names.clear();
+    if (!watcher.wait(timeoutMs, names)) {
+      std::cout << "Error: the watch of '" << dirname << "' is stopped." << std::endl;
+      exitCode = 1;
+      break;
+    }
+    const auto now = Clock::now();
+    for (const auto& name : names) {
+      if (IsPngFile(name)) {
+        settling[name] = now;
+      }
+    }
+    bool hasFocus = false;
+    for (auto i = settling.begin(); i != settling.end(); ) {
+      if (now - i->second < std::chrono::milliseconds(debounceMs)) {
+        ++i;
+        continue;
+      }
+      if (!hasFocus) {
+        focus.clear();
+        if (!focusfilename.empty()) {
+          ReadFileList(focusfilename, focus);
+        }
+        hasFocus = true;
+      }
+      Job job;
+      job.filename = prefix + i->first;
+      job.focusRank = GetFocusRank(focus, job.filename, i->first);
+      job.savedAt = i->second;
+      {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        auto j = std::find_if(queue.jobs.begin(), queue.jobs.end(), [&job](const Job& e) { return e.filename == job.filename; });
+        if (j != queue.jobs.end()) {
+          *j = job;
+        } else {
+          queue.jobs.push_back(job);
+        }
+      }
+      queue.cv.notify_one();
+      i = settling.erase(i);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.isStopped = true;
+  }
+  queue.cv.notify_all();
+  for (auto& e : workers) {
+    e.join();
+  }
+
+#ifdef FREE_IMAGE_STATIC_LIBRARY
+  FreeImage_Deinitialise();
+#endif // FREE_ISTATIC_LIBRARY
+  return exitCode;
+}
@@ -0,0 +1,15 @@
+/**
+  @file watch.h
+
+  Convert the PNG files in the directory again whenever they are saved.
+
+  The saves are notified by inotify on Linux and ReadDirectoryChangesW on
+  Windows. The burst of the writes to a file is debounced, and the files are
+  converted by the workers that are kept during the watch.
+*/
+#ifndef WATCH_H_INCLUDED
+#define WATCH_H_INCLUDED
+
+int RunWatch(const char* dirname, int argc, char** argv);
+
+#endif // WATCH_H_INCLUDED